@@ -0,0 +1,229 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../runtime/event_loop.h"
+#include "../runtime/socket.h"
+#include "spawn.h"
+
+// Echo server written as one straight-line coroutine per connection, and
+// round trips per second against it and against a callback server built
+// like algorithm/reactor's edge-triggered Acceptor/Connection handlers.
+//
+//   echo_bench [clients] [round trips]   both servers, in process
+//   echo_bench server [port]             just the coroutine server
+
+Spawn<EventLoop> serve(EventLoop& loop, Socket conn) {
+  char buf[4096];
+  while (true) {
+    ssize_t num = co_await conn.read(buf, sizeof(buf));
+    if (num <= 0) {
+      break;
+    }
+    for (ssize_t sent = 0; sent < num;) {
+      ssize_t written = co_await conn.write(buf + sent, num - sent);
+      if (written < 0) {
+        co_return;
+      }
+      sent += written;
+    }
+  }
+}
+
+// accepts `connections` clients, or forever when it is negative
+Spawn<EventLoop> acceptor(EventLoop& loop, Socket& listener, int connections) {
+  for (int accepted = 0; connections < 0 || accepted < connections;) {
+    Socket conn = co_await listener.accept();
+    if (!conn.valid()) {
+      continue;
+    }
+    accepted++;
+    loop.add_task(serve(loop, std::move(conn)).handle_);
+  }
+}
+
+// the reactor's design with the echo finished: one epoll thread calling
+// handlers that read until EAGAIN and write the data straight back
+class CallbackServer {
+public:
+  explicit CallbackServer(int connections): connections_(connections) {
+    epoll_fd_ = epoll_create1(0);
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int opt = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listen_fd_, SOMAXCONN) < 0) {
+      throw std::runtime_error("Failed to listen on socket");
+    }
+    socklen_t len = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &len);
+    port_ = ntohs(address.sin_port);
+    add(listen_fd_, EPOLLIN | EPOLLET);
+  }
+  ~CallbackServer() {
+    close(listen_fd_);
+    close(epoll_fd_);
+  }
+  uint16_t port() const {
+    return port_;
+  }
+  // returns when every connection has been accepted and closed
+  void run() {
+    epoll_event events[64];
+    int open = 0;
+    int accepted = 0;
+    while (accepted < connections_ || open > 0) {
+      int num = epoll_wait(epoll_fd_, events, 64, -1);
+      for (int i = 0; i < num; i++) {
+        int fd = events[i].data.fd;
+        if (fd == listen_fd_) {
+          int conn;
+          while ((conn = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+            add(conn, EPOLLIN | EPOLLET | EPOLLRDHUP);
+            accepted++;
+            open++;
+          }
+        } else if (!handle_read(fd)) {
+          epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+          close(fd);
+          open--;
+        }
+      }
+    }
+  }
+
+private:
+  void add(int fd, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  }
+  // false once the connection is done
+  bool handle_read(int fd) {
+    char buf[4096];
+    while (true) {
+      ssize_t num = read(fd, buf, sizeof(buf));
+      if (num < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      } else if (num == 0) {
+        return false;
+      }
+      // echo payloads fit the socket buffer; a full one would need EPOLLOUT
+      if (send(fd, buf, num, MSG_NOSIGNAL) != num) {
+        return false;
+      }
+    }
+  }
+
+  int connections_;
+  int epoll_fd_;
+  int listen_fd_;
+  uint16_t port_;
+};
+
+// blocking ping-pong clients, one thread each; returns round trips per second
+static double run_clients(uint16_t port, int clients, int rounds) {
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads;
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < clients; i++) {
+    threads.emplace_back([&]() {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      int opt = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      address.sin_port = htons(port);
+      if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        failures++;
+        close(fd);
+        return;
+      }
+      char out[64];
+      char in[64];
+      memset(out, 'x', sizeof(out));
+      for (int round = 0; round < rounds; round++) {
+        if (write(fd, out, sizeof(out)) != ssize_t(sizeof(out))) {
+          failures++;
+          break;
+        }
+        size_t got = 0;
+        while (got < sizeof(in)) {
+          ssize_t num = read(fd, in + got, sizeof(in) - got);
+          if (num <= 0) {
+            break;
+          }
+          got += num;
+        }
+        if (got != sizeof(in)) {
+          failures++;
+          break;
+        }
+      }
+      close(fd);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  if (failures) {
+    std::cerr << failures << " clients failed" << std::endl;
+  }
+  return double(clients) * rounds / std::chrono::duration<double>(t2 - t1).count();
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "server") {
+    EventLoop loop;
+    Socket listener = Socket::listen(loop, argc > 2 ? atoi(argv[2]) : 8080);
+    std::cout << "coroutine echo server on port " << listener.local_port() << std::endl;
+    loop.add_task(acceptor(loop, listener, -1).handle_);
+    loop.run();
+    return 0;
+  }
+  int clients = argc > 1 ? atoi(argv[1]) : 4;
+  int rounds = argc > 2 ? atoi(argv[2]) : 10000;
+
+  {
+    EventLoop loop;
+    Socket listener = Socket::listen(loop, 0);
+    loop.add_task(acceptor(loop, listener, clients).handle_);
+    double rate = 0;
+    std::thread client([&]() {
+      rate = run_clients(listener.local_port(), clients, rounds);
+    });
+    loop.run();
+    client.join();
+    std::cout << "coroutine server: " << rate << " round trips/s (" << clients << " clients, "
+              << loop.thread_num() << " workers)" << std::endl;
+  }
+  {
+    CallbackServer server(clients);
+    double rate = 0;
+    std::thread client([&]() {
+      rate = run_clients(server.port(), clients, rounds);
+    });
+    server.run();
+    client.join();
+    std::cout << "callback server:  " << rate << " round trips/s (" << clients << " clients)"
+              << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+#include "../runtime/event_loop.h"
+#include "../runtime/frame_pool.h"
+#include "../runtime/task.h"
+
+// Heap allocations of a spawn-heavy workload with and without the
+// FramePool: every spawned task awaits two short Tasks and hops through
+// the loop once.
+//
+//   frame_bench [tasks] [threads]
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+static EventLoop* loop;
+
+Task<int> leaf(int value) {
+  co_return value;
+}
+
+Task<int> work(int value) {
+  int first = co_await leaf(value);
+  co_await loop->schedule();
+  co_return first + co_await leaf(1);
+}
+
+// the spawner waits for each batch like when_all does: it counts as one
+// more member so that workers finishing early cannot resume it
+struct Batch {
+  void finish() {
+    if (left_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      loop->post_task(spawner_);
+    }
+  }
+  bool await_ready() const {
+    return false;
+  }
+  bool await_suspend(std::coroutine_handle<> handle) {
+    spawner_ = handle;
+    return left_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+  }
+  void await_resume() const {}
+
+  std::atomic<int> left_;
+  std::coroutine_handle<> spawner_;
+};
+
+Task<> worker(int value, std::atomic<int64_t>& sum, Batch& batch) {
+  sum.fetch_add(co_await work(value), std::memory_order_relaxed);
+  batch.finish();
+}
+
+// spawns batches of 64 tasks, each after the previous one has finished,
+// so that the pool gets to reuse frames
+Task<> spawner(int tasks, std::atomic<int64_t>& sum) {
+  Batch batch;
+  for (int i = 0; i < tasks;) {
+    int size = std::min(64, tasks - i);
+    batch.left_.store(size + 1, std::memory_order_relaxed);
+    for (int end = i + size; i < end; i++) {
+      spawn(*loop, worker(i, sum, batch));
+    }
+    co_await batch;
+  }
+}
+
+static void run(int tasks, int threads, bool pooled, bool counted) {
+  FramePool::set_enabled(pooled);
+  FramePool::set_stats_enabled(counted);
+  FramePool::reset_stats();
+  std::atomic<int64_t> sum{0};
+  EventLoop event_loop(threads);
+  loop = &event_loop;
+  uint64_t before = allocations.load();
+  auto t1 = Clock::now();
+  sync_wait(event_loop, spawner(tasks, sum));
+  auto t2 = Clock::now();
+  uint64_t allocated = allocations.load() - before;
+  if (sum != int64_t(tasks) * (tasks - 1) / 2 + tasks) {
+    std::cerr << "wrong sum " << sum << std::endl;
+    exit(1);
+  }
+  double ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / tasks;
+  FramePool::Stats stats = FramePool::stats();
+  std::cout << (pooled ? "pooled frames: " : "global new:    ") << double(allocated) / tasks
+            << " allocations/task, " << ns << " ns/task";
+  if (counted) {
+    std::cout << " (counted: " << stats.allocations << " frames, " << stats.system_allocations
+              << " from the system)";
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int tasks = argc > 1 ? atoi(argv[1]) : 1000000;
+  int threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  run(tasks, threads, false, false);
+  run(tasks, threads, true, false);
+  // the same with the pool's counters on, for their cost and the sizes
+  run(tasks, threads, false, true);
+  run(tasks, threads, true, true);
+
+  FramePool::Stats stats = FramePool::stats();
+  std::cout << "frame sizes:";
+  for (size_t i = 0; i < FramePool::kClasses; i++) {
+    if (stats.sizes[i]) {
+      std::cout << " <=" << (i + 1) * FramePool::kClassSize << ": " << stats.sizes[i];
+    }
+  }
+  std::cout << " larger: " << stats.large << std::endl;
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "../runtime/event_loop.h"
+#include "../runtime/metrics.h"
+#include "../runtime/sleep.h"
+#include "../runtime/task.h"
+#include "spawn.h"
+
+// The loop's instrumentation on a mixed load: short coroutines hopping
+// through the queues, sleepers, and one hog whose long slice holds up its
+// worker. Prints the counters and histograms, finds the hog in the trace,
+// and compares hop throughput with stats and tracing off and on.
+//
+//   metrics_bench [trace.json]
+
+using Clock = std::chrono::steady_clock;
+
+// co_await frame_address() gives the calling coroutine's frame address,
+// the id the trace knows it by
+struct FrameAddress {
+  bool await_ready() const noexcept {
+    return false;
+  }
+  bool await_suspend(std::coroutine_handle<> handle) noexcept {
+    address_ = uintptr_t(handle.address());
+    return false;
+  }
+  uintptr_t await_resume() const noexcept {
+    return address_;
+  }
+  uintptr_t address_ = 0;
+};
+
+Task<> hopper(EventLoop& loop, int hops) {
+  for (int i = 0; i < hops; i++) {
+    co_await loop.schedule();
+  }
+}
+
+Task<> sleeper(std::atomic<int>& started, int ms) {
+  started++;
+  co_await sleep_for(std::chrono::milliseconds(ms));
+}
+
+Task<> hog(EventLoop& loop, uintptr_t& id) {
+  co_await loop.schedule();
+  id = co_await FrameAddress();
+  auto until = Clock::now() + std::chrono::milliseconds(20);
+  while (Clock::now() < until) {
+  }
+}
+
+// samples the loop once the sleepers wait
+Task<> monitor(EventLoop& loop, std::atomic<int>& started, int sleepers, LoopStats& sample) {
+  while (started < sleepers) {
+    co_await sleep_for(std::chrono::milliseconds(1));
+  }
+  sample = loop.stats();
+}
+
+static void print_histogram(const char* name, const Histogram& histogram) {
+  std::cout << "  " << name << ": " << histogram.count() << " samples, mean " << histogram.mean()
+            << " ns, p50 < " << histogram.percentile(0.5) << " ns, p99 < "
+            << histogram.percentile(0.99) << " ns, max " << histogram.max() << " ns" << std::endl;
+}
+
+static void mixed_load(const char* trace_path) {
+  EventLoop loop(std::max(2u, std::thread::hardware_concurrency()));
+  loop.set_stats_enabled(true);
+  loop.set_tracing(1 << 20);
+  uintptr_t hog_id = 0;
+  LoopStats sample;
+  std::atomic<int> started{0};
+  for (int i = 0; i < 100; i++) {
+    spawn(loop, sleeper(started, 200 + i));
+  }
+  for (int i = 0; i < 1000; i++) {
+    spawn(loop, hopper(loop, 100));
+  }
+  spawn(loop, hog(loop, hog_id));
+  spawn(loop, monitor(loop, started, 100, sample));
+  loop.run();
+
+  std::cout << "while sleeping: " << sample.in_flight() << " in flight, " << sample.queued()
+            << " queued, " << sample.running << " running, " << sample.suspended()
+            << " suspended" << std::endl;
+  check(sample.suspended() >= 90, "sleepers counted as suspended");
+  LoopStats stats = loop.stats();
+  std::cout << "after run: " << stats.spawned << " spawned, " << stats.completed << " completed, "
+            << stats.posted << " posted, " << stats.resumed << " resumed" << std::endl;
+  check(stats.spawned == 1102 && stats.completed == 1102 && stats.in_flight() == 0,
+        "spawned and completed");
+  check(stats.queued() == 0 && stats.resumed >= 1000 * 100, "posted and resumed");
+  print_histogram("queue wait", stats.queue_wait);
+  print_histogram("slices", stats.slice);
+
+  // the longest slice in the trace is the hog's
+  TraceEvent longest{0, 0, -1, 0, TraceEvent::kSlice};
+  size_t events = 0;
+  for (auto& worker : loop.trace()) {
+    events += worker.size();
+    for (auto& event : worker) {
+      if (event.kind == TraceEvent::kSlice && event.duration_ns > longest.duration_ns) {
+        longest = event;
+      }
+    }
+  }
+  std::cout << "trace: " << events << " events, longest slice " << longest.duration_ns / 1000
+            << " us by 0x" << std::hex << longest.id << std::dec << " (the hog is 0x" << std::hex
+            << hog_id << std::dec << ")" << std::endl;
+  check(longest.id == hog_id && longest.duration_ns >= 20000000, "hog found");
+  if (trace_path) {
+    std::ofstream out(trace_path);
+    loop.write_trace(out);
+    std::cout << "trace written to " << trace_path << std::endl;
+  }
+}
+
+static double hops_per_second(bool stats, bool trace) {
+  EventLoop loop(1);
+  loop.set_stats_enabled(stats);
+  loop.set_tracing(trace ? 1 << 16 : 0);
+  constexpr int kCoroutines = 1000;
+  constexpr int kHops = 1000;
+  for (int i = 0; i < kCoroutines; i++) {
+    spawn(loop, hopper(loop, kHops));
+  }
+  auto t1 = Clock::now();
+  loop.run();
+  double seconds = std::chrono::duration<double>(Clock::now() - t1).count();
+  return double(kCoroutines) * kHops / seconds;
+}
+
+int main(int argc, char** argv) {
+  mixed_load(argc > 1 ? argv[1] : nullptr);
+  std::cout << "hops, off:          " << hops_per_second(false, false) / 1e6 << " M/s" << std::endl;
+  std::cout << "hops, stats:        " << hops_per_second(true, false) / 1e6 << " M/s" << std::endl;
+  std::cout << "hops, stats, trace: " << hops_per_second(true, true) / 1e6 << " M/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "../../threads_pool/singleton.h"
+#include "../runtime/event_loop.h"
+#include "../runtime/offload.h"
+#include "../runtime/sleep.h"
+#include "../runtime/task.h"
+#include "spawn.h"
+
+// CPU-heavy work from a coroutine, done inline on the loop, on the pool
+// through a blocking future.get(), and on the pool through co_await
+// pool.submit_async(). A ticker coroutine on the same single-worker loop
+// measures how late its 1 ms ticks get meanwhile; only the last way keeps
+// the loop responsive. Then checks run_on() and sync_wait() on the pool.
+//
+//   offload_bench [pool threads]
+
+using Clock = std::chrono::steady_clock;
+
+// about ms milliseconds of arithmetic
+static uint64_t crunch(int ms) {
+  uint64_t x = 88172645463325252ull;
+  auto until = Clock::now() + std::chrono::milliseconds(ms);
+  while (Clock::now() < until) {
+    for (int i = 0; i < 1000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+    }
+  }
+  return x;
+}
+
+enum class Mode {
+  kInline,
+  kBlocking,
+  kAsync,
+};
+
+Task<> ticker(std::atomic<bool>& done, int64_t& worst_us) {
+  while (!done) {
+    auto before = Clock::now();
+    co_await sleep_for(std::chrono::milliseconds(1));
+    int64_t late = std::chrono::duration_cast<std::chrono::microseconds>(
+                       Clock::now() - before - std::chrono::milliseconds(1))
+                       .count();
+    worst_us = std::max(worst_us, late);
+  }
+}
+
+Task<> cruncher(ThreadsPool& pool, Mode mode, std::atomic<bool>& done) {
+  // let the ticker get going
+  co_await sleep_for(std::chrono::milliseconds(5));
+  for (int i = 0; i < 5; i++) {
+    uint64_t x = 0;
+    switch (mode) {
+    case Mode::kInline:
+      x = crunch(20);
+      break;
+    case Mode::kBlocking:
+      x = pool.submit(crunch, 20).get();
+      break;
+    case Mode::kAsync:
+      x = co_await pool.submit_async(crunch, 20);
+      break;
+    }
+    check(x != 0, "crunched");
+  }
+  done = true;
+}
+
+static void lateness(ThreadsPool& pool, Mode mode, const char* name) {
+  EventLoop loop(1);
+  std::atomic<bool> done{false};
+  int64_t worst_us = 0;
+  spawn(loop, ticker(done, worst_us));
+  spawn(loop, cruncher(pool, mode, done));
+  auto t1 = Clock::now();
+  loop.run();
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t1).count();
+  std::cout << "  " << name << ": " << ms << " ms, worst tick " << worst_us << " us late"
+            << std::endl;
+  if (mode == Mode::kAsync) {
+    check(worst_us < 15000, "loop kept ticking");
+  }
+}
+
+static int fails(int n) {
+  if (n > 0) {
+    throw std::runtime_error("fails");
+  }
+  return n;
+}
+
+Task<int> on_pool_sum(ThreadsPool& pool, int n) {
+  check(EventLoop::current() == nullptr, "task runs off the loop");
+  // pool jobs from a task already on the pool resume it in place
+  int a = co_await pool.submit_async([n]() {
+    return n;
+  });
+  int b = co_await pool.submit_async([n]() {
+    return n * 2;
+  });
+  co_return a + b;
+}
+
+Task<> throws_on_pool() {
+  throw std::runtime_error("from the pool");
+  co_return;
+}
+
+Task<> bridge(ThreadsPool& pool, EventLoop& loop, int& checks) {
+  bool caught = false;
+  try {
+    co_await pool.submit_async(fails, 1);
+  } catch (const std::runtime_error&) {
+    caught = true;
+  }
+  check(caught && EventLoop::current() == &loop, "job exception rethrown on the loop");
+  co_await pool.submit_async([]() {});
+  check(EventLoop::current() == &loop, "void job resumes on the loop");
+  checks++;
+
+  int sum = co_await run_on(pool, on_pool_sum(pool, 7));
+  check(sum == 21 && EventLoop::current() == &loop, "run_on result back on the loop");
+  caught = false;
+  try {
+    co_await run_on(pool, throws_on_pool());
+  } catch (const std::runtime_error&) {
+    caught = true;
+  }
+  check(caught && EventLoop::current() == &loop, "run_on exception back on the loop");
+  checks++;
+}
+
+static void bridges(ThreadsPool& pool) {
+  EventLoop loop(2);
+  int checks = 0;
+  spawn(loop, bridge(pool, loop, checks));
+  loop.run();
+  check(checks == 2, "bridge ran");
+
+  check(sync_wait(pool, on_pool_sum(pool, 5)) == 15, "sync_wait on the pool");
+  bool caught = false;
+  try {
+    sync_wait(pool, throws_on_pool());
+  } catch (const std::runtime_error&) {
+    caught = true;
+  }
+  check(caught, "sync_wait on the pool rethrows");
+  std::cout << "bridges: ok" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int threads = argc > 1 ? atoi(argv[1]) : 2;
+  ThreadsPool& pool = *Singleton<ThreadsPool>::get_instance(threads);
+  std::cout << "ticker lateness while crunching 5 x 20 ms:" << std::endl;
+  lateness(pool, Mode::kInline, "inline               ");
+  lateness(pool, Mode::kBlocking, "future.get()         ");
+  lateness(pool, Mode::kAsync, "co_await submit_async");
+  bridges(pool);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include "../runtime/async_generator.h"
+#include "../runtime/event_loop.h"
+#include "../runtime/sleep.h"
+#include "../runtime/task.h"
+
+// A read-chunk -> parse -> transform -> write pipeline of AsyncGenerators.
+// The source and the sink stall now and then like I/O would; run in
+// lockstep the stalls add up, with buffered() stages they overlap while
+// each queue stays within its capacity.
+//
+//   pipeline_bench [lines] [capacity] [threads]
+
+using Clock = std::chrono::steady_clock;
+
+// the source stalls every kChunkStall chunks, the sink every kValueStall values
+static constexpr int kChunkStall = 16;
+static constexpr int kValueStall = 8192;
+static constexpr auto kStall = std::chrono::milliseconds(1);
+
+// chunks of newline-terminated numbers, cut regardless of line ends
+AsyncGenerator<std::string> read_chunks(int64_t lines) {
+  std::string chunk;
+  int chunks = 0;
+  for (int64_t i = 0; i < lines; i++) {
+    chunk += std::to_string(i);
+    chunk += '\n';
+    if (chunk.size() >= 4096) {
+      if (++chunks % kChunkStall == 0) {
+        co_await sleep_for(kStall);
+      }
+      co_yield chunk.substr(0, 4096);
+      chunk.erase(0, 4096);
+    }
+  }
+  if (!chunk.empty()) {
+    co_yield std::move(chunk);
+  }
+}
+
+AsyncGenerator<int64_t> parse(AsyncGenerator<std::string> chunks) {
+  int64_t number = 0;
+  while (std::optional<std::string> chunk = co_await chunks.next()) {
+    for (char c : *chunk) {
+      if (c == '\n') {
+        co_yield number;
+        number = 0;
+      } else {
+        number = number * 10 + (c - '0');
+      }
+    }
+  }
+}
+
+AsyncGenerator<int64_t> transform(AsyncGenerator<int64_t> numbers) {
+  while (std::optional<int64_t> number = co_await numbers.next()) {
+    co_yield *number % 1000 * 3;
+  }
+}
+
+Task<int64_t> write_all(AsyncGenerator<int64_t> values) {
+  int64_t sum = 0;
+  int64_t count = 0;
+  while (std::optional<int64_t> value = co_await values.next()) {
+    sum += *value;
+    if (++count % kValueStall == 0) {
+      co_await sleep_for(kStall);
+    }
+  }
+  co_return sum;
+}
+
+// queues go at the two stages that wait; buffered() must be called on the
+// loop, hence inside the task
+Task<int64_t> pipeline(int64_t lines, size_t capacity) {
+  if (capacity == 0) {
+    co_return co_await write_all(transform(parse(read_chunks(lines))));
+  }
+  co_return co_await write_all(
+      buffered(transform(parse(buffered(read_chunks(lines), capacity))), capacity * kValueStall));
+}
+
+int main(int argc, char** argv) {
+  int64_t lines = argc > 1 ? atoll(argv[1]) : 10000000;
+  size_t capacity = argc > 2 ? atoi(argv[2]) : 16;
+  int threads = argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+
+  int64_t expected = 0;
+  for (int64_t i = 0; i < lines; i++) {
+    expected += i % 1000 * 3;
+  }
+  for (size_t stage_capacity : {size_t(0), capacity}) {
+    EventLoop loop(threads);
+    auto t1 = Clock::now();
+    int64_t sum = sync_wait(loop, pipeline(lines, stage_capacity));
+    auto t2 = Clock::now();
+    if (sum != expected) {
+      std::cerr << "wrong sum " << sum << std::endl;
+      return 1;
+    }
+    double seconds = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << (stage_capacity ? "buffered: " : "lockstep: ") << lines / seconds / 1e6
+              << " M lines/s";
+    if (stage_capacity) {
+      std::cout << " (queues of " << stage_capacity << " chunks and "
+                << stage_capacity * kValueStall << " numbers)";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
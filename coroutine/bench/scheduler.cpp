@@ -0,0 +1,106 @@
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "../runtime/event_loop.h"
+#include "spawn.h"
+
+// Resumes per second: many short coroutines that each hop back onto the
+// loop a number of times, on the work stealing EventLoop and on the
+// previous design (one queue, coroutines resumed under its mutex).
+//
+//   scheduler_bench [coroutines] [hops]
+
+// the old EventLoop from timer.cpp, with task_num_ made atomic and initialised
+struct LockedLoop {
+  explicit LockedLoop(uint64_t thread_num): thread_num_(thread_num) {}
+  void run() {
+    for (uint64_t i = 0; i < thread_num_; i++) {
+      threads_.emplace_back([this]() {
+        while (task_num_) {
+          std::unique_lock<std::mutex> lock(mtx_);
+          cv_.wait(lock, [this](){return !q_.empty() || task_num_ == 0;});
+          if (!q_.empty()) {
+            auto handle = q_.front();
+            q_.pop();
+            if (handle.done()) {
+              handle.destroy();
+              task_num_ -= 1;
+              if (task_num_ == 0) {
+                cv_.notify_all();
+              }
+            } else {
+              handle.resume();
+            }
+          }
+        }
+      });
+    }
+    for (auto& thread: threads_) {
+      thread.join();
+    }
+  }
+  void add_task(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    q_.push(handle);
+    task_num_ += 1;
+    cv_.notify_one();
+  }
+  // called with mtx_ held when the coroutine runs inside run()
+  void post_task(std::coroutine_handle<> handle) {
+    q_.push(handle);
+    cv_.notify_one();
+  }
+
+  std::atomic<uint64_t> task_num_{0};
+  uint64_t thread_num_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<std::thread> threads_;
+  std::queue<std::coroutine_handle<>> q_;
+};
+
+static std::atomic<uint64_t> resumes{0};
+
+template <typename Loop>
+Spawn<Loop> hopper(Loop& loop, int hops) {
+  for (int i = 0; i < hops; i++) {
+    co_await Hop<Loop>{loop};
+  }
+  resumes.fetch_add(hops, std::memory_order_relaxed);
+}
+
+template <typename Loop>
+static void bench(const char* name, uint64_t threads, int coroutines, int hops) {
+  Loop loop(threads);
+  resumes = 0;
+  for (int i = 0; i < coroutines; i++) {
+    loop.add_task(hopper(loop, hops).handle_);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  loop.run();
+  auto t2 = std::chrono::steady_clock::now();
+  double sec = std::chrono::duration<double>(t2 - t1).count();
+  std::cout << name << " x" << threads << ": " << resumes / sec / 1e6 << " M resumes/s"
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int coroutines = argc > 1 ? atoi(argv[1]) : 10000;
+  int hops = argc > 2 ? atoi(argv[2]) : 200;
+  std::cout << coroutines << " coroutines x " << hops << " hops, "
+            << std::thread::hardware_concurrency() << " cores" << std::endl;
+  uint64_t most = std::max(4u, std::thread::hardware_concurrency());
+  for (uint64_t threads = 1; threads <= most; threads *= 2) {
+    bench<EventLoop>("work stealing", threads, coroutines, hops);
+    bench<LockedLoop>("global mutex ", threads, coroutines, hops);
+  }
+  return 0;
+}
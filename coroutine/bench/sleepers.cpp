@@ -0,0 +1,94 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include "../runtime/event_loop.h"
+#include "../runtime/sleep.h"
+#include "spawn.h"
+
+// Many coroutines sleeping at once on the shared TimerService: how late
+// they wake up and how many threads the process needs for it.
+//
+//   timer_bench [coroutines] [max sleep ms]
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<int64_t> late_total{0};
+static std::atomic<int64_t> late_max{0};
+static std::atomic<int> peak_threads{0};
+
+static int thread_count() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("Threads:", 0) == 0) {
+      return atoi(line.c_str() + 8);
+    }
+  }
+  return 0;
+}
+
+Spawn<EventLoop> sleeper(EventLoop& loop, int64_t sleep_us) {
+  auto deadline = Clock::now() + std::chrono::microseconds(sleep_us);
+  co_await sleep_until(deadline);
+  int64_t late = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - deadline).count();
+  late_total.fetch_add(late, std::memory_order_relaxed);
+  int64_t seen = late_max.load(std::memory_order_relaxed);
+  while (late > seen && !late_max.compare_exchange_weak(seen, late)) {}
+}
+
+Spawn<EventLoop> watcher(EventLoop& loop, int64_t until_us) {
+  auto end = Clock::now() + std::chrono::microseconds(until_us);
+  while (Clock::now() < end) {
+    int threads = thread_count();
+    if (threads > peak_threads) {
+      peak_threads = threads;
+    }
+    co_await sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+// Timeout fires unless cancelled, and never after its destructor
+static void check_timeout(EventLoop& loop) {
+  std::atomic<int> fired{0};
+  {
+    Timeout early(loop.timers(), Clock::now(), [&fired]() { fired++; });
+    Timeout late(loop.timers(), Clock::now() + std::chrono::hours(1), [&fired]() { fired += 100; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    bool cancelled = late.cancel();
+    if (fired != 1 || !cancelled || early.cancel()) {
+      std::cerr << "timeout check failed" << std::endl;
+      exit(1);
+    }
+  }
+  std::cout << "timeout: ok" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int coroutines = argc > 1 ? atoi(argv[1]) : 100000;
+  int64_t max_ms = argc > 2 ? atoi(argv[2]) : 1000;
+  EventLoop loop;
+  check_timeout(loop);
+
+  std::mt19937 gen(42);
+  for (int i = 0; i < coroutines; i++) {
+    loop.add_task(sleeper(loop, gen() % (max_ms * 1000)).handle_);
+  }
+  loop.add_task(watcher(loop, max_ms * 1000).handle_);
+  auto t1 = Clock::now();
+  loop.run();
+  auto t2 = Clock::now();
+
+  std::cout << coroutines << " sleepers over " << max_ms << " ms: done in "
+            << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms, "
+            << "late by " << late_total / coroutines << " us on average, "
+            << late_max << " us at most, " << peak_threads << " threads ("
+            << loop.thread_num() << " workers)" << std::endl;
+  return 0;
+}
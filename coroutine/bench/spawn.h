@@ -0,0 +1,72 @@
+#ifndef __SPAWN_H
+#define __SPAWN_H
+
+#include <coroutine>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+// correctness checks of the benchmarks, kept in release builds unlike
+// assert(): prints what failed and exits with status 1
+inline void check(bool ok, const char* what) {
+  if (!ok) {
+    std::cerr << "check failed: " << what << std::endl;
+    exit(1);
+  }
+}
+
+// Fire-and-forget coroutine for the benchmarks: started by loop.add_task(),
+// hands itself to loop.finish_task() when finished (or, for loops without
+// one, posts itself back), and the loop destroys it. The loop is the
+// coroutine's first argument.
+template <typename Loop>
+struct Spawn {
+  struct promise_type {
+    template <typename... Args>
+    promise_type(Loop& loop, const Args&...): loop_(&loop) {}
+    Spawn get_return_object() {
+      return Spawn{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+    // back to the loop, which destroys finished frames
+    struct FinalAwaiter {
+      bool await_ready() noexcept {
+        return false;
+      }
+      void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        Loop* loop = handle.promise().loop_;
+        if constexpr (requires { loop->finish_task(handle); }) {
+          loop->finish_task(handle);
+        } else {
+          loop->post_task(handle);
+        }
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept {
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() {
+      std::terminate();
+    }
+    Loop* loop_;
+  };
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename Loop>
+struct Hop {
+  bool await_ready() {
+    return false;
+  }
+  void await_suspend(std::coroutine_handle<> handle) {
+    loop_.post_task(handle);
+  }
+  void await_resume() {}
+  Loop& loop_;
+};
+
+#endif
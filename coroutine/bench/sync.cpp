@@ -0,0 +1,235 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <thread>
+#include <vector>
+#include "../runtime/event_loop.h"
+#include "../runtime/sync.h"
+#include "../runtime/task.h"
+#include "spawn.h"
+
+// Contention of the coroutine synchronization primitives against their
+// thread-blocking counterparts: many coroutines on the loop's workers
+// against as many threads using std::mutex, std::counting_semaphore and a
+// condition variable queue.
+//
+//   sync_bench [tasks] [threads]
+
+using Clock = std::chrono::steady_clock;
+
+static EventLoop* loop;
+
+static void report(const char* name, double ops, Clock::time_point t1) {
+  double seconds = std::chrono::duration<double>(Clock::now() - t1).count();
+  std::cout << "  " << std::left << std::setw(26) << name << ops / seconds / 1e6 << " M ops/s"
+            << std::endl;
+}
+
+// spawns count copies of task(i) and waits for them on a latch
+template <typename F>
+Task<> fork_join(int count, F task) {
+  AsyncLatch done(count);
+  for (int i = 0; i < count; i++) {
+    spawn(*loop, task(i, done));
+  }
+  co_await done.wait();
+}
+
+// runs count threads of f(i) to completion
+template <typename F>
+void threads_join(int count, F f) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < count; i++) {
+    threads.emplace_back(f, i);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+static constexpr int kLocks = 20000;
+static constexpr int kPermits = 4;
+static constexpr int kAcquires = 2000;
+static constexpr int kItems = 20000;
+
+Task<> mutex_bench(int tasks) {
+  AsyncMutex mutex;
+  int64_t counter = 0;
+  auto t1 = Clock::now();
+  co_await fork_join(tasks, [&](int, AsyncLatch& done) -> Task<> {
+    for (int i = 0; i < kLocks; i++) {
+      AsyncLockGuard lock = co_await mutex.scoped_lock();
+      counter++;
+    }
+    done.count_down();
+  });
+  report("AsyncMutex:", double(tasks) * kLocks, t1);
+  check(counter == int64_t(tasks) * kLocks, "mutex counter");
+}
+
+// permits are held across a suspension, which std::counting_semaphore can
+// only do by keeping the thread
+Task<> semaphore_bench(int tasks) {
+  AsyncSemaphore semaphore(kPermits);
+  std::atomic<int> inside{0};
+  std::atomic<bool> exceeded{false};
+  auto t1 = Clock::now();
+  co_await fork_join(tasks, [&](int, AsyncLatch& done) -> Task<> {
+    for (int i = 0; i < kAcquires; i++) {
+      co_await semaphore.acquire();
+      if (inside.fetch_add(1) >= kPermits) {
+        exceeded = true;
+      }
+      co_await loop->schedule();
+      inside.fetch_sub(1);
+      semaphore.release();
+    }
+    done.count_down();
+  });
+  report("AsyncSemaphore:", double(tasks) * kAcquires, t1);
+  check(!exceeded && semaphore.count() == kPermits, "semaphore permits");
+}
+
+Task<> channel_bench(int tasks) {
+  Channel<int64_t> channel(64);
+  int producers = std::max(1, tasks / 2);
+  AsyncLatch sent(producers);
+  std::atomic<int64_t> sum{0};
+  auto t1 = Clock::now();
+  co_await fork_join(tasks, [&](int index, AsyncLatch& done) -> Task<> {
+    if (index < producers) {
+      for (int i = 0; i < kItems; i++) {
+        check(co_await channel.send(i), "send");
+      }
+      sent.count_down();
+    } else if (index == producers) {
+      // closes once every producer is done, then receives like the others
+      co_await sent.wait();
+      channel.close();
+    }
+    if (index >= producers) {
+      int64_t local = 0;
+      while (std::optional<int64_t> item = co_await channel.receive()) {
+        local += *item;
+      }
+      sum += local;
+    }
+    done.count_down();
+  });
+  report("Channel:", double(producers) * kItems, t1);
+  check(sum == int64_t(producers) * kItems * (kItems - 1) / 2, "channel sum");
+}
+
+// a condition variable queue, the usual blocking channel
+class BlockingQueue {
+public:
+  explicit BlockingQueue(size_t capacity): capacity_(capacity) {}
+  void push(int64_t item) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    not_full_.wait(lock, [&]() {
+      return items_.size() < capacity_;
+    });
+    items_.push_back(item);
+    not_empty_.notify_one();
+  }
+  std::optional<int64_t> pop() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    not_empty_.wait(lock, [&]() {
+      return !items_.empty() || closed_;
+    });
+    if (items_.empty()) {
+      return std::nullopt;
+    }
+    int64_t item = items_.front();
+    items_.pop_front();
+    not_full_.notify_one();
+    return item;
+  }
+  void close() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<int64_t> items_;
+  size_t capacity_;
+  bool closed_ = false;
+};
+
+static void blocking_benches(int tasks) {
+  {
+    std::mutex mutex;
+    int64_t counter = 0;
+    auto t1 = Clock::now();
+    threads_join(tasks, [&](int) {
+      for (int i = 0; i < kLocks; i++) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counter++;
+      }
+    });
+    report("std::mutex:", double(tasks) * kLocks, t1);
+    check(counter == int64_t(tasks) * kLocks, "std::mutex counter");
+  }
+  {
+    std::counting_semaphore<> semaphore(kPermits);
+    auto t1 = Clock::now();
+    threads_join(tasks, [&](int) {
+      for (int i = 0; i < kAcquires; i++) {
+        semaphore.acquire();
+        std::this_thread::yield();
+        semaphore.release();
+      }
+    });
+    report("std::counting_semaphore:", double(tasks) * kAcquires, t1);
+  }
+  {
+    BlockingQueue queue(64);
+    int producers = std::max(1, tasks / 2);
+    std::atomic<int> sending{producers};
+    std::atomic<int64_t> sum{0};
+    auto t1 = Clock::now();
+    threads_join(tasks, [&](int index) {
+      if (index < producers) {
+        for (int i = 0; i < kItems; i++) {
+          queue.push(i);
+        }
+        if (--sending == 0) {
+          queue.close();
+        }
+        return;
+      }
+      int64_t local = 0;
+      while (std::optional<int64_t> item = queue.pop()) {
+        local += *item;
+      }
+      sum += local;
+    });
+    report("condition variable queue:", double(producers) * kItems, t1);
+    check(sum == int64_t(producers) * kItems * (kItems - 1) / 2, "queue sum");
+  }
+}
+
+int main(int argc, char** argv) {
+  int tasks = argc > 1 ? atoi(argv[1]) : 64;
+  int threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  EventLoop event_loop(threads);
+  loop = &event_loop;
+  std::cout << tasks << " coroutines on " << event_loop.thread_num() << " workers:" << std::endl;
+  sync_wait(event_loop, mutex_bench(tasks));
+  sync_wait(event_loop, semaphore_bench(tasks));
+  sync_wait(event_loop, channel_bench(tasks));
+  std::cout << tasks << " threads:" << std::endl;
+  blocking_benches(tasks);
+  return 0;
+}
@@ -0,0 +1,311 @@
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <vector>
+#include "../runtime/async_generator.h"
+#include "../runtime/event_loop.h"
+#include "../runtime/sleep.h"
+#include "../runtime/socket.h"
+#include "../runtime/task.h"
+#include "spawn.h"
+
+// Cost of Task<T> await chains by depth, and checks of when_all/when_any,
+// of cancellation and of the loop's run modes.
+//
+//   task_bench [max depth]
+
+using Clock = std::chrono::steady_clock;
+
+static EventLoop* loop;
+
+// depth nested awaits; the leaf optionally suspends through the loop
+Task<int64_t> chain(int depth, bool suspend) {
+  if (depth == 0) {
+    if (suspend) {
+      co_await loop->schedule();
+    }
+    co_return 0;
+  }
+  co_return 1 + co_await chain(depth - 1, suspend);
+}
+
+Task<int> delayed(int value, int ms) {
+  co_await sleep_for(std::chrono::milliseconds(ms));
+  co_return value;
+}
+
+Task<int> failing(int ms) {
+  co_await sleep_for(std::chrono::milliseconds(ms));
+  throw std::runtime_error("failing task");
+}
+
+Task<> nothing() {
+  co_return;
+}
+
+Task<std::string> text() {
+  co_return "text";
+}
+
+Task<> combinators() {
+  std::vector<Task<int>> tasks;
+  for (int i = 0; i < 10; i++) {
+    tasks.push_back(delayed(i, 30 - 3 * i));
+  }
+  auto t1 = Clock::now();
+  std::vector<int> values = co_await when_all(std::move(tasks));
+  auto waited = Clock::now() - t1;
+  check(values.size() == 10, "when_all size");
+  for (int i = 0; i < 10; i++) {
+    check(values[i] == i, "when_all keeps task order");
+  }
+  // the sleeps overlap: about the longest one, not their sum
+  check(waited < std::chrono::milliseconds(100), "when_all overlaps waits");
+
+  auto [number, none, str] = co_await when_all(delayed(7, 1), nothing(), text());
+  check(number == 7 && str == "text", "when_all tuple");
+  (void)none;
+
+  std::vector<Task<int>> failing_tasks;
+  failing_tasks.push_back(delayed(1, 5));
+  failing_tasks.push_back(failing(1));
+  bool thrown = false;
+  try {
+    co_await when_all(std::move(failing_tasks));
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  check(thrown, "when_all rethrows");
+
+  std::vector<Task<int>> racers;
+  racers.push_back(delayed(1, 50));
+  racers.push_back(delayed(2, 5));
+  racers.push_back(delayed(3, 30));
+  auto first = co_await when_any(std::move(racers));
+  check(first.index == 1 && first.value == 2, "when_any picks the first");
+
+  std::vector<Task<int>> none_tasks;
+  check((co_await when_all(std::move(none_tasks))).empty(), "when_all of nothing");
+  thrown = false;
+  try {
+    co_await when_any(std::vector<Task<int>>());
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  check(thrown, "when_any of nothing throws");
+  std::cout << "when_all/when_any: ok" << std::endl;
+}
+
+// sleeps in a nested task, so the token has to travel down the chain
+Task<int> nested_sleep(int ms) {
+  co_return co_await delayed(1, ms);
+}
+
+Task<> stop_after(std::stop_source& source, int ms) {
+  co_await sleep_for(std::chrono::milliseconds(ms));
+  source.request_stop();
+}
+
+Task<ssize_t> read_one(Socket& conn) {
+  char byte;
+  co_return co_await conn.read(&byte, 1);
+}
+
+AsyncGenerator<int> slow_numbers(int ms) {
+  for (int i = 0;; i++) {
+    co_yield i;
+    co_await sleep_for(std::chrono::milliseconds(ms));
+  }
+}
+
+Task<> drain(AsyncGenerator<int> numbers, bool buffer) {
+  if (buffer) {
+    numbers = buffered(std::move(numbers), 4);
+  }
+  while (std::optional<int> number = co_await numbers.next()) {
+  }
+}
+
+template <typename T>
+static Task<bool> throws_cancelled(Task<T> task) {
+  try {
+    co_await std::move(task);
+  } catch (const OperationCancelled&) {
+    co_return true;
+  }
+  co_return false;
+}
+
+Task<> cancellation() {
+  // a stop request wakes a sleep deep in the chain at once
+  std::stop_source source;
+  Task<bool> sleeper = throws_cancelled(nested_sleep(5000));
+  sleeper.set_stop_token(source.get_token());
+  auto t1 = Clock::now();
+  auto [cancelled, none] = co_await when_all(std::move(sleeper), stop_after(source, 10));
+  (void)none;
+  check(cancelled && Clock::now() - t1 < std::chrono::seconds(1), "sleep cancelled early");
+
+  t1 = Clock::now();
+  bool timed_out = false;
+  try {
+    co_await with_timeout(nested_sleep(5000), std::chrono::milliseconds(10));
+  } catch (const TimedOut&) {
+    timed_out = true;
+  }
+  check(timed_out && Clock::now() - t1 < std::chrono::seconds(1), "with_timeout times out");
+  int value = co_await with_timeout(delayed(7, 1), std::chrono::seconds(5));
+  check(value == 7, "with_timeout result");
+
+  // a generator sleeps with its consumer's token, through buffered() too
+  for (int pass = 0; pass < 2; pass++) {
+    bool buffer = pass == 1;
+    std::stop_source drain_source;
+    Task<bool> drainer = throws_cancelled(drain(slow_numbers(5000), buffer));
+    drainer.set_stop_token(drain_source.get_token());
+    t1 = Clock::now();
+    auto [drained, ignored] = co_await when_all(std::move(drainer), stop_after(drain_source, 10));
+    (void)ignored;
+    check(drained && Clock::now() - t1 < std::chrono::seconds(1),
+          buffer ? "buffered generator cancelled" : "generator cancelled");
+  }
+
+  // the losers of a when_any are stopped, not waited for
+  std::vector<Task<int>> racers;
+  racers.push_back(nested_sleep(5000));
+  racers.push_back(delayed(2, 5));
+  t1 = Clock::now();
+  auto first = co_await when_any(std::move(racers));
+  check(first.index == 1, "when_any winner");
+
+  // a read with nothing to read ends with -ECANCELED
+  Socket listener = Socket::listen(*loop, 0);
+  Socket client = co_await Socket::connect(*loop, "127.0.0.1", listener.local_port());
+  Socket server = co_await listener.accept();
+  std::stop_source read_source;
+  Task<ssize_t> reader = read_one(server);
+  reader.set_stop_token(read_source.get_token());
+  auto [result, unused] = co_await when_all(std::move(reader), stop_after(read_source, 10));
+  (void)unused;
+  check(result == -ECANCELED, "read cancelled");
+  std::cout << "cancellation: ok" << std::endl;
+}
+
+Task<> set_after(std::atomic<bool>& flag, int ms) {
+  co_await sleep_for(std::chrono::milliseconds(ms));
+  flag = true;
+}
+
+// shuts target down and tries to spawn one more task
+Task<> shut_down_after(EventLoop& target, bool drain, int ms, std::atomic<bool>& refused) {
+  co_await sleep_for(std::chrono::milliseconds(ms));
+  target.shutdown(drain);
+  std::atomic<bool> unused{false};
+  refused = !spawn(target, set_after(unused, 0));
+}
+
+Task<> cancellable_sleep(std::atomic<bool>& cancelled) {
+  try {
+    co_await sleep_for(std::chrono::seconds(10));
+  } catch (const OperationCancelled&) {
+    cancelled = true;
+  }
+}
+
+static double cpu_seconds() {
+  return double(std::clock()) / CLOCKS_PER_SEC;
+}
+
+static void lifecycle() {
+  EventLoop event_loop(4);
+  // tasks left waiting on a timer stay for the next run
+  std::atomic<bool> quick{false};
+  std::atomic<bool> slow{false};
+  spawn(event_loop, set_after(quick, 0));
+  spawn(event_loop, set_after(slow, 200));
+  auto t1 = Clock::now();
+  event_loop.run_until_idle();
+  check(quick && !slow && Clock::now() - t1 < std::chrono::milliseconds(150), "run_until_idle");
+  // parked workers don't burn the CPU while the sleep runs out
+  double cpu = cpu_seconds();
+  event_loop.run();
+  check(slow, "run after run_until_idle");
+  std::cout << "lifecycle: " << (cpu_seconds() - cpu) * 1000 << " ms of CPU over a 200 ms sleep"
+            << std::endl;
+
+  // draining, the tasks there finish but no new ones come in
+  std::atomic<bool> finished{false};
+  std::atomic<bool> refused{false};
+  spawn(event_loop, shut_down_after(event_loop, true, 10, refused));
+  spawn(event_loop, set_after(finished, 50));
+  event_loop.run();
+  check(finished && refused, "drained");
+
+  // not draining, run() returns with the sleeper still waiting; cancelled,
+  // it is done at the next run
+  std::stop_source source;
+  std::atomic<bool> cancelled{false};
+  spawn(event_loop, cancellable_sleep(cancelled), source.get_token());
+  spawn(event_loop, shut_down_after(event_loop, false, 10, refused));
+  t1 = Clock::now();
+  event_loop.run();
+  check(!cancelled && Clock::now() - t1 < std::chrono::seconds(1), "shutdown without drain");
+  check(spawn(event_loop, set_after(finished, 0)), "tasks taken after shutdown");
+  source.request_stop();
+  event_loop.run();
+  check(cancelled, "left task cancelled");
+  std::cout << "lifecycle: ok" << std::endl;
+}
+
+// times chains inside one task, so starting the loop's threads isn't measured
+Task<> bench_chains(int max_depth) {
+  for (int depth = 1; depth <= max_depth; depth *= 10) {
+    for (bool suspend : {false, true}) {
+      int runs = std::max(1, 1000000 / depth);
+      auto t1 = Clock::now();
+      int64_t sum = 0;
+      for (int run = 0; run < runs; run++) {
+        sum += co_await chain(depth, suspend);
+        // without tail calls every await here nests deeper; a trip through
+        // the loop starts the stack over
+        if (run % 100 == 99) {
+          co_await loop->schedule();
+        }
+      }
+      auto t2 = Clock::now();
+      check(sum == int64_t(depth) * runs, "chain result");
+      double ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / runs;
+      std::cout << "depth " << depth << (suspend ? ", leaf suspends: " : ": ") << ns
+                << " ns per chain, " << ns / depth << " ns per level" << std::endl;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  // deeper chains need an optimized build: GCC only turns symmetric
+  // transfer into tail calls when optimizing, without them every await
+  // nests on the stack
+#ifdef __OPTIMIZE__
+  int max_depth = argc > 1 ? atoi(argv[1]) : 10000;
+#else
+  int max_depth = argc > 1 ? atoi(argv[1]) : 100;
+#endif
+  EventLoop event_loop(1);
+  loop = &event_loop;
+  sync_wait(event_loop, combinators());
+  auto t1 = Clock::now();
+  sync_wait(event_loop, cancellation());
+  // run() only returns when the cancelled tasks, the when_any loser
+  // included, have finished
+  check(Clock::now() - t1 < std::chrono::seconds(2), "cancelled tasks finish early");
+  lifecycle();
+  sync_wait(event_loop, bench_chains(max_depth));
+  return 0;
+}
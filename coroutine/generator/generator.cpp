@@ -1,57 +1,16 @@
-#include <coroutine>
-#include <exception>
-#include <stdexcept>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../runtime/generator.h"
 
-class Generator{
- public:
-  struct promise_type {
-    Generator get_return_object() {
-      return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
-    }
-    std::suspend_always initial_suspend() noexcept {
-      return {};
-    }
-    std::suspend_always final_suspend() noexcept {
-      return {};
-    }
-    std::suspend_always yield_value(int val) {
-      val_ = val;
-      return {};
-    }
-    void unhandled_exception() {
-      exception_ptr_ = std::current_exception();
-    }
-    int val_;
-    std::exception_ptr exception_ptr_;
-  };
-  Generator(std::coroutine_handle<promise_type> h): handle_(h) {}
-
-  int operator() () {
-    resume();
-    return handle_.promise().val_;
-  }
-
-  ~Generator(){
-    if (handle_) {
-      handle_.destroy();
-    }
-  }
-
- private:
-  void resume() {
-    if (handle_.promise().exception_ptr_) {
-      std::rethrow_exception(handle_.promise().exception_ptr_);
-    }
-    if (handle_.done()) {
-      throw std::runtime_error("coroutine handle is done can't resume");
-    }
-    handle_.resume();
-  }
-  std::coroutine_handle<promise_type> handle_;
-};
+static_assert(std::ranges::input_range<Generator<int>>);
+static_assert(std::ranges::view<Generator<std::string>>);
 
-Generator fibonacci() {
+Generator<int> fibonacci() {
   int prev = 0;
   int next = 1;
   int curr = prev;
@@ -63,11 +22,91 @@ Generator fibonacci() {
   }
 }
 
+struct Node {
+  std::string name_;
+  std::vector<std::unique_ptr<Node>> children_;
+};
+
+// pre-order walk, yielding references into the tree
+Generator<const Node&> walk(const Node& node) {
+  co_yield node;
+  for (const auto& child : node.children_) {
+    co_yield elements_of(walk(*child));
+  }
+}
+
+// the elements can be changed through Generator<T&>
+Generator<int&> items(std::vector<int>& values) {
+  for (int& value : values) {
+    co_yield value;
+  }
+}
+
+Generator<int> failing() {
+  co_yield 1;
+  throw std::runtime_error("failing generator");
+}
+
+Generator<int> outer() {
+  co_yield 0;
+  try {
+    co_yield elements_of(failing());
+  } catch (const std::runtime_error& error) {
+    std::cout << "caught from nested generator: " << error.what() << "\n";
+  }
+  co_yield 2;
+}
 
 int main() {
-  auto gen = fibonacci();
-  for (int i = 0; i < 20; i++) {
-    std::cout << gen() << "\n";
+  for (int value : fibonacci() | std::views::take(20)) {
+    std::cout << value << "\n";
+  }
+
+  Node root{"root", {}};
+  for (int i = 0; i < 3; i++) {
+    auto child = std::make_unique<Node>(Node{"child" + std::to_string(i), {}});
+    child->children_.push_back(std::make_unique<Node>(Node{child->name_ + ".leaf", {}}));
+    root.children_.push_back(std::move(child));
+  }
+  for (const Node& node : walk(root)) {
+    std::cout << node.name_ << " ";
+  }
+  std::cout << "\n";
+
+  std::vector<int> values{1, 2, 3};
+  for (int& value : items(values)) {
+    value *= 10;
+  }
+  std::cout << values[0] << " " << values[1] << " " << values[2] << "\n";
+
+  for (int value : outer()) {
+    std::cout << value << "\n";
+  }
+
+  // a list-shaped tree: nesting depth grows with the size, yet each
+  // element is reached by resuming the innermost generator directly
+  for (int depth : {1000, 10000}) {
+    Node list{"0", {}};
+    Node* last = &list;
+    for (int i = 1; i < depth; i++) {
+      last->children_.push_back(std::make_unique<Node>(Node{"", {}}));
+      last = last->children_.back().get();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    int count = 0;
+    for (const Node& node : walk(list)) {
+      (void)node;
+      count++;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    std::cout << "depth " << depth << ": " << count << " nodes, "
+              << std::chrono::duration<double, std::nano>(t2 - t1).count() / count
+              << " ns per node\n";
+    // the default destructor would recurse as deep as the list
+    while (!list.children_.empty()) {
+      auto next = std::move(list.children_.back());
+      list.children_ = std::move(next->children_);
+    }
   }
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,344 @@
+#ifndef __ASYNC_GENERATOR_H
+#define __ASYNC_GENERATOR_H
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <utility>
+#include "event_loop.h"
+#include "frame_pool.h"
+#include "task.h"
+
+// Lazy asynchronous sequence of T: a coroutine that may co_await (sleeps,
+// sockets, Tasks) between its co_yields.
+//
+//   AsyncGenerator<std::string> chunks(Socket& conn) {
+//     char buf[4096];
+//     for (ssize_t n; (n = co_await conn.read(buf, sizeof(buf))) > 0;) {
+//       co_yield std::string(buf, n);
+//     }
+//   }
+//   while (auto chunk = co_await gen.next()) { ... }
+//
+// The consumer pulls: next() runs the generator up to its next co_yield and
+// the generator waits there until the consumer asks again, so a pipeline of
+// generators holds one element per stage. Control passes between consumer
+// and generator by symmetric transfer. next() returns std::nullopt at the
+// end and rethrows what the generator throws. Wrap a stage in buffered() to
+// let it run ahead of its consumer.
+//
+// Like a Task, a generator carries the stop token it was given or else
+// takes the one of the coroutine that first asks it for an element, so
+// sleeps and socket awaits in its body give up when the consuming task is
+// cancelled; buffered() hands the token on to its pump.
+template <typename T>
+class AsyncGenerator {
+public:
+  class promise_type : public PooledFrame {
+  public:
+    AsyncGenerator get_return_object() noexcept {
+      return AsyncGenerator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+
+    // back to the consumer waiting in next()
+    struct YieldAwaiter {
+      bool await_ready() const noexcept {
+        return false;
+      }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        return handle.promise().consumer_;
+      }
+      void await_resume() const noexcept {}
+    };
+    YieldAwaiter final_suspend() const noexcept {
+      return {};
+    }
+    template <typename U>
+    YieldAwaiter yield_value(U&& value) {
+      value_.emplace(std::forward<U>(value));
+      return {};
+    }
+    void return_void() const noexcept {}
+    void unhandled_exception() noexcept {
+      exception_ = std::current_exception();
+    }
+    const std::stop_token& stop_token() const noexcept {
+      return stop_token_;
+    }
+    void set_stop_token(std::stop_token token) noexcept {
+      stop_token_ = std::move(token);
+    }
+
+  private:
+    friend class AsyncGenerator;
+
+    std::stop_token stop_token_;
+    std::coroutine_handle<> consumer_;
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+  };
+
+  AsyncGenerator() = default;
+  AsyncGenerator(AsyncGenerator&& other) noexcept
+    : handle_(std::exchange(other.handle_, nullptr)) {}
+  AsyncGenerator& operator=(AsyncGenerator&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  AsyncGenerator(const AsyncGenerator&) = delete;
+  AsyncGenerator& operator=(const AsyncGenerator&) = delete;
+  // must not be destroyed while a next() is pending
+  ~AsyncGenerator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // before the first next(); otherwise it takes the consumer's token
+  void set_stop_token(std::stop_token token) {
+    handle_.promise().set_stop_token(std::move(token));
+  }
+
+  struct NextAwaiter {
+    bool await_ready() const noexcept {
+      return !handle_ || handle_.done();
+    }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> consumer) noexcept {
+      promise_type& promise = handle_.promise();
+      if (!promise.stop_token_.stop_possible()) {
+        if (const std::stop_token* token = stop_token_of(consumer)) {
+          promise.set_stop_token(*token);
+        }
+      }
+      promise.consumer_ = consumer;
+      return handle_;
+    }
+    std::optional<T> await_resume() {
+      if (!handle_) {
+        return std::nullopt;
+      }
+      promise_type& promise = handle_.promise();
+      if (promise.exception_) {
+        std::rethrow_exception(std::exchange(promise.exception_, nullptr));
+      }
+      std::optional<T> value = std::move(promise.value_);
+      promise.value_.reset();
+      return value;
+    }
+    std::coroutine_handle<promise_type> handle_;
+  };
+  // the next element, or std::nullopt when the generator has finished
+  NextAwaiter next() noexcept {
+    return NextAwaiter{handle_};
+  }
+
+private:
+  explicit AsyncGenerator(std::coroutine_handle<promise_type> handle): handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// Bounded queue between the pump of buffered() and its consumer. Both run
+// on loop, where waiting coroutines are posted back when woken.
+template <typename T>
+class BufferQueue {
+public:
+  BufferQueue(EventLoop& loop, size_t capacity): loop_(loop), capacity_(capacity ? capacity : 1) {}
+
+  // producer side; false once the consumer has gone away
+  struct PushAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+    bool await_suspend(std::coroutine_handle<> producer) {
+      std::coroutine_handle<> consumer;
+      {
+        std::lock_guard<std::mutex> lock(queue_.mtx_);
+        if (queue_.cancelled_) {
+          pushed_ = false;
+          return false;
+        }
+        if (queue_.consumer_) {
+          // the consumer waits on an empty queue: hand the value over
+          queue_.out_->emplace(std::move(value_));
+          consumer = std::exchange(queue_.consumer_, nullptr);
+        } else if (queue_.items_.size() < queue_.capacity_) {
+          queue_.items_.push_back(std::move(value_));
+        } else {
+          queue_.producer_ = producer;
+          queue_.pending_ = &value_;
+          queue_.pushed_ = &pushed_;
+          return true;
+        }
+      }
+      if (consumer) {
+        queue_.loop_.post_task(consumer);
+      }
+      return false;
+    }
+    bool await_resume() const noexcept {
+      return pushed_;
+    }
+    BufferQueue& queue_;
+    T& value_;
+    bool pushed_ = true;
+  };
+  // value must stay alive until the co_await completes
+  PushAwaiter push(T& value) {
+    return PushAwaiter{*this, value};
+  }
+
+  // consumer side; leaves item empty at the end
+  struct PopAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+    bool await_suspend(std::coroutine_handle<> consumer) {
+      std::coroutine_handle<> producer;
+      {
+        std::lock_guard<std::mutex> lock(queue_.mtx_);
+        if (!queue_.items_.empty()) {
+          item_.emplace(std::move(queue_.items_.front()));
+          queue_.items_.pop_front();
+          if (queue_.producer_) {
+            // room again for the value the producer is waiting with
+            queue_.items_.push_back(std::move(*queue_.pending_));
+            producer = std::exchange(queue_.producer_, nullptr);
+          }
+        } else if (!queue_.closed_) {
+          queue_.consumer_ = consumer;
+          queue_.out_ = &item_;
+          return true;
+        }
+      }
+      if (producer) {
+        queue_.loop_.post_task(producer);
+      }
+      return false;
+    }
+    void await_resume() const {
+      if (!item_ && queue_.error_) {
+        std::rethrow_exception(queue_.error_);
+      }
+    }
+    BufferQueue& queue_;
+    std::optional<T>& item_;
+  };
+  // item must be empty and stay alive until the co_await completes
+  PopAwaiter pop(std::optional<T>& item) {
+    return PopAwaiter{*this, item};
+  }
+
+  // producer side: no more items, optionally because of error
+  void close(std::exception_ptr error) {
+    std::coroutine_handle<> consumer;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      closed_ = true;
+      error_ = error;
+      consumer = std::exchange(consumer_, nullptr);
+    }
+    if (consumer) {
+      loop_.post_task(consumer);
+    }
+  }
+  // consumer side: stops a producer waiting for room, now and later
+  void cancel() {
+    std::coroutine_handle<> producer;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      cancelled_ = true;
+      items_.clear();
+      if (producer_) {
+        *pushed_ = false;
+        producer = std::exchange(producer_, nullptr);
+      }
+    }
+    if (producer) {
+      loop_.post_task(producer);
+    }
+  }
+
+private:
+  EventLoop& loop_;
+  std::mutex mtx_;
+  size_t capacity_;
+  std::deque<T> items_;
+  // a producer waiting for room, with the value it brings
+  std::coroutine_handle<> producer_;
+  T* pending_ = nullptr;
+  bool* pushed_ = nullptr;
+  // a consumer waiting for an item, and where it goes
+  std::coroutine_handle<> consumer_;
+  std::optional<T>* out_ = nullptr;
+  bool closed_ = false;
+  bool cancelled_ = false;
+  std::exception_ptr error_;
+};
+
+// moves source's elements into queue until either side is done
+template <typename T>
+Task<> buffered_pump(AsyncGenerator<T> source, std::shared_ptr<BufferQueue<T>> queue) {
+  std::exception_ptr error;
+  try {
+    while (std::optional<T> item = co_await source.next()) {
+      if (!co_await queue->push(*item)) {
+        co_return;
+      }
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  queue->close(error);
+}
+
+// cancels the pump when the consumer drops the buffered generator
+template <typename T>
+struct BufferedGuard {
+  ~BufferedGuard() {
+    queue_->cancel();
+  }
+  BufferQueue<T>* queue_;
+};
+
+// Runs source as a task of its own on the current EventLoop, up to capacity
+// elements ahead of the consumer, so the two stages overlap their waits and
+// can run on different workers while memory stays bounded. The task starts
+// with the first next() and stops when source ends or the returned
+// generator is destroyed.
+template <typename T>
+AsyncGenerator<T> buffered(AsyncGenerator<T> source, size_t capacity) {
+  EventLoop& loop = *EventLoop::current();
+  auto queue = std::make_shared<BufferQueue<T>>(loop, capacity);
+  BufferedGuard<T> guard{queue.get()};
+  // the pump is a task of its own, it gets the consumer's token explicitly
+  std::stop_token token = co_await get_stop_token();
+  if (!spawn(loop, buffered_pump(std::move(source), queue), std::move(token))) {
+    // the loop is shutting down
+    queue->close(std::make_exception_ptr(OperationCancelled()));
+  }
+  while (true) {
+    std::optional<T> item;
+    co_await queue->pop(item);
+    if (!item) {
+      break;
+    }
+    co_yield std::move(*item);
+  }
+}
+
+#endif
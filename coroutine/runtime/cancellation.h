@@ -0,0 +1,67 @@
+#ifndef __CANCELLATION_H
+#define __CANCELLATION_H
+
+#include <coroutine>
+#include <exception>
+#include <stop_token>
+
+// Cancellation follows std::stop_token. A Task carries the token it was
+// given (Task::set_stop_token(), spawn()) or else the one of the task
+// awaiting it, so a whole chain of tasks shares one token. Awaitables that
+// wait for something outside (sleep_for, socket I/O) watch the token of
+// the awaiting task and give up early when stop is requested; code in
+// between can check co_await get_stop_token().
+
+// thrown by sleeps of a task whose stop was requested
+class OperationCancelled : public std::exception {
+public:
+  const char* what() const noexcept override {
+    return "operation cancelled";
+  }
+};
+
+// thrown by with_timeout() when the deadline cancelled the task
+class TimedOut : public OperationCancelled {
+public:
+  const char* what() const noexcept override {
+    return "timed out";
+  }
+};
+
+// the stop token of the coroutine behind handle, nullptr if it has none
+// that could ever be triggered
+template <typename Promise>
+const std::stop_token* stop_token_of(std::coroutine_handle<Promise> handle) noexcept {
+  if constexpr (requires { handle.promise().stop_token(); }) {
+    const std::stop_token& token = handle.promise().stop_token();
+    return token.stop_possible() ? &token : nullptr;
+  } else {
+    return nullptr;
+  }
+}
+
+// co_await get_stop_token() returns the awaiting task's token without
+// suspending
+class StopTokenAwaiter {
+public:
+  bool await_ready() const noexcept {
+    return false;
+  }
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+    token_ = stop_token_of(handle);
+    return false;
+  }
+  std::stop_token await_resume() const noexcept {
+    return token_ ? *token_ : std::stop_token();
+  }
+
+private:
+  const std::stop_token* token_ = nullptr;
+};
+
+inline StopTokenAwaiter get_stop_token() noexcept {
+  return {};
+}
+
+#endif
@@ -0,0 +1,451 @@
+#include "event_loop.h"
+#include <algorithm>
+#include <chrono>
+
+// The usual formulation uses standalone fences; seq_cst operations on top_
+// and bottom_ give the same ordering and are understood by TSan. Every
+// store to bottom_ releases, so a thief that reads any bottom_ also sees
+// the handles pushed before it.
+
+WorkStealingQueue::WorkStealingQueue(int64_t capacity) {
+  int64_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+  rings_.push_back(std::make_unique<Ring>(size));
+  ring_.store(rings_.back().get(), std::memory_order_relaxed);
+}
+
+void WorkStealingQueue::push(std::coroutine_handle<> handle, int64_t stamp) {
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_acquire);
+  Ring* ring = ring_.load(std::memory_order_relaxed);
+  if (b - t > ring->mask) {
+    auto bigger = std::make_unique<Ring>(2 * (ring->mask + 1));
+    for (int64_t i = t; i < b; i++) {
+      bigger->put(i, ring->get(i), ring->stamp(i));
+    }
+    ring = bigger.get();
+    rings_.push_back(std::move(bigger));
+    ring_.store(ring, std::memory_order_release);
+  }
+  ring->put(b, handle.address(), stamp);
+  bottom_.store(b + 1, std::memory_order_release);
+}
+
+std::coroutine_handle<> WorkStealingQueue::pop(int64_t& stamp) {
+  int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  Ring* ring = ring_.load(std::memory_order_relaxed);
+  bottom_.store(b, std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_seq_cst);
+  if (t > b) {
+    bottom_.store(b + 1, std::memory_order_release);
+    return {};
+  }
+  void* address = ring->get(b);
+  stamp = ring->stamp(b);
+  if (t == b) {
+    // the last one: race the thieves for it
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      address = nullptr;
+    }
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+  return std::coroutine_handle<>::from_address(address);
+}
+
+std::coroutine_handle<> WorkStealingQueue::steal(int64_t& stamp) {
+  int64_t t = top_.load(std::memory_order_seq_cst);
+  int64_t b = bottom_.load(std::memory_order_seq_cst);
+  if (t >= b) {
+    return {};
+  }
+  Ring* ring = ring_.load(std::memory_order_acquire);
+  void* address = ring->get(t);
+  stamp = ring->stamp(t);
+  if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed)) {
+    return {};
+  }
+  return std::coroutine_handle<>::from_address(address);
+}
+
+thread_local EventLoop::Worker* EventLoop::current_worker_ = nullptr;
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// counters with a single writer need no read-modify-write
+static void bump(std::atomic<uint64_t>& counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+EventLoop::EventLoop(uint64_t thread_num): thread_num_(std::max<uint64_t>(thread_num, 1)) {
+  for (uint64_t i = 0; i < thread_num_; i++) {
+    workers_.push_back(std::make_unique<Worker>(this, i));
+  }
+}
+
+EventLoop::~EventLoop() {
+  for (auto& thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+EventLoop* EventLoop::current() {
+  return current_worker_ ? current_worker_->loop : nullptr;
+}
+
+void EventLoop::run() {
+  start(false);
+}
+
+void EventLoop::run_until_idle() {
+  start(true);
+}
+
+void EventLoop::start(bool until_idle) {
+  until_idle_ = until_idle;
+  for (auto& worker : workers_) {
+    threads_.emplace_back([this, worker = worker.get()]() {
+      work(*worker);
+    });
+  }
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  // waits for a post from outside the workers that may still be waking
+  std::lock_guard<std::mutex> lock(mtx_);
+  idle_.store(false, std::memory_order_relaxed);
+  stopping_.store(false, std::memory_order_relaxed);
+  shutdown_.store(false, std::memory_order_relaxed);
+}
+
+void EventLoop::shutdown(bool drain) {
+  shutdown_.store(true, std::memory_order_release);
+  if (!drain) {
+    stopping_.store(true, std::memory_order_release);
+    wake_all();
+  }
+}
+
+bool EventLoop::add_task(std::coroutine_handle<> handle) {
+  if (shutting_down()) {
+    handle.destroy();
+    return false;
+  }
+  if (mode_.load(std::memory_order_relaxed) & kStats) {
+    spawned_.fetch_add(1, std::memory_order_relaxed);
+  }
+  task_num_.fetch_add(1, std::memory_order_relaxed);
+  post_task(handle);
+  return true;
+}
+
+void EventLoop::post_task(std::coroutine_handle<> handle) {
+  uint8_t mode = mode_.load(std::memory_order_relaxed);
+  int64_t stamp = mode ? now_ns() : 0;
+  Worker* worker = current_worker_;
+  if (worker && worker->loop == this) {
+    if (mode & kStats) {
+      bump(worker->stats.posted);
+    }
+    worker->queue.push(handle, stamp);
+    // the worker gets to the handle anyway, a parked one would only help
+    // out: no fence, and no second wakeup while one is on its way
+    if (parked_.load(std::memory_order_relaxed) != 0 &&
+        !waking_.exchange(true, std::memory_order_relaxed)) {
+      wake_some();
+    }
+    return;
+  }
+  if (mode & kStats) {
+    posted_outside_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // the wakeup under the lock too: once the handle is taken the loop may
+  // finish, and start() takes the lock before the loop can go away
+  std::lock_guard<std::mutex> lock(mtx_);
+  q_.push_back(Injected{handle, stamp});
+  q_size_.store(q_.size(), std::memory_order_relaxed);
+  wake_one();
+}
+
+void EventLoop::finish_task(std::coroutine_handle<> handle) {
+  Worker* worker = current_worker_;
+  if (!worker || worker->loop != this) {
+    // counting out could end the loop under another thread's feet
+    post_task(handle);
+    return;
+  }
+  if ((mode_.load(std::memory_order_relaxed) & kTrace) && worker->trace.size() < trace_limit_) {
+    worker->trace.push_back(
+        TraceEvent{uintptr_t(handle.address()), now_ns(), 0, 0, TraceEvent::kFinish});
+  }
+  handle.destroy();
+  count_out(*worker);
+}
+
+void EventLoop::count_out(Worker& worker) {
+  if (mode_.load(std::memory_order_relaxed) & kStats) {
+    bump(worker.stats.completed);
+  }
+  if (task_num_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    wake_all();
+  }
+}
+
+void EventLoop::work(Worker& worker) {
+  current_worker_ = &worker;
+  worker.slice_end = 0;
+  int idle = 0;
+  while (!finished()) {
+    int64_t stamp;
+    if (auto handle = next(worker, stamp)) {
+      idle = 0;
+      execute(worker, handle, stamp);
+      continue;
+    }
+    worker.slice_end = 0;
+    if (++idle < 64) {
+      std::this_thread::yield();
+    } else {
+      idle = 0;
+      park();
+    }
+  }
+  current_worker_ = nullptr;
+}
+
+bool EventLoop::finished() const {
+  return task_num_.load(std::memory_order_acquire) == 0 ||
+         idle_.load(std::memory_order_acquire) || stopping_.load(std::memory_order_acquire);
+}
+
+bool EventLoop::has_work() const {
+  if (q_size_.load(std::memory_order_relaxed) != 0) {
+    return true;
+  }
+  for (auto& worker : workers_) {
+    if (!worker->queue.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A parking worker counts itself in parked_ and then looks for work once
+// more, a poster from outside publishes its handle and then looks at
+// parked_; with a fence on both sides one of them sees the other. epoch_
+// is read before, so a wakeup in between is not lost either.
+void EventLoop::park() {
+  uint32_t epoch = epoch_.load(std::memory_order_acquire);
+  uint64_t parked = parked_.fetch_add(1, std::memory_order_relaxed) + 1;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!finished() && !has_work()) {
+    if (until_idle_ && parked == thread_num_) {
+      // everyone is parked with nothing queued
+      idle_.store(true, std::memory_order_release);
+      wake_all();
+    } else {
+      epoch_.wait(epoch, std::memory_order_acquire);
+    }
+  }
+  parked_.fetch_sub(1, std::memory_order_relaxed);
+  waking_.store(false, std::memory_order_relaxed);
+}
+
+void EventLoop::wake_one() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (parked_.load(std::memory_order_relaxed) != 0) {
+    wake_some();
+  }
+}
+
+void EventLoop::wake_some() {
+  epoch_.fetch_add(1, std::memory_order_release);
+  epoch_.notify_one();
+}
+
+void EventLoop::wake_all() {
+  epoch_.fetch_add(1, std::memory_order_release);
+  epoch_.notify_all();
+}
+
+std::coroutine_handle<> EventLoop::next(Worker& worker, int64_t& stamp) {
+  // now and then serve the oldest work first, so a coroutine that keeps
+  // yielding can't starve the ones queued behind it
+  if (++worker.tick % 61 == 0) {
+    if (auto handle = take_injected(worker, stamp)) {
+      return handle;
+    }
+    if (auto handle = worker.queue.steal(stamp)) {
+      return handle;
+    }
+  }
+  if (auto handle = worker.queue.pop(stamp)) {
+    return handle;
+  }
+  if (auto handle = take_injected(worker, stamp)) {
+    return handle;
+  }
+  return steal(worker, stamp);
+}
+
+std::coroutine_handle<> EventLoop::take_injected(Worker& worker, int64_t& stamp) {
+  if (q_size_.load(std::memory_order_relaxed) == 0) {
+    return {};
+  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (q_.empty()) {
+    return {};
+  }
+  Injected first = q_.front();
+  q_.pop_front();
+  // take a share of the rest along, so the lock is not taken per handle
+  size_t batch = std::min<size_t>(q_.size() / thread_num_ + 1, 32);
+  for (size_t i = 0; i < batch && !q_.empty(); i++) {
+    worker.queue.push(q_.front().handle, q_.front().stamp);
+    q_.pop_front();
+  }
+  q_size_.store(q_.size(), std::memory_order_relaxed);
+  stamp = first.stamp;
+  return first.handle;
+}
+
+std::coroutine_handle<> EventLoop::steal(Worker& worker, int64_t& stamp) {
+  if (thread_num_ == 1) {
+    return {};
+  }
+  // xorshift, so the workers don't all raid the same victim
+  worker.seed ^= worker.seed << 13;
+  worker.seed ^= worker.seed >> 17;
+  worker.seed ^= worker.seed << 5;
+  size_t start = worker.seed % thread_num_;
+  for (size_t i = 0; i < thread_num_; i++) {
+    size_t victim = (start + i) % thread_num_;
+    if (victim == worker.index) {
+      continue;
+    }
+    if (auto handle = workers_[victim]->queue.steal(stamp)) {
+      return handle;
+    }
+  }
+  return {};
+}
+
+void EventLoop::execute(Worker& worker, std::coroutine_handle<> handle, int64_t stamp) {
+  uint8_t mode = mode_.load(std::memory_order_relaxed);
+  if (handle.done()) {
+    if (mode & kStats) {
+      bump(worker.stats.reaped);
+    }
+    handle.destroy();
+    count_out(worker);
+  } else if (mode) {
+    execute_instrumented(worker, handle, stamp, mode);
+  } else {
+    handle.resume();
+  }
+}
+
+void EventLoop::execute_instrumented(Worker& worker, std::coroutine_handle<> handle,
+                                     int64_t stamp, uint8_t mode) {
+  // the frame may be gone once resume() returns
+  uintptr_t id = uintptr_t(handle.address());
+  int64_t start = worker.slice_end ? worker.slice_end : now_ns();
+  // handles posted before the stamps were switched on have none
+  int64_t queued = stamp ? start - stamp : 0;
+  if (mode & kStats) {
+    bump(worker.stats.resumed);
+    worker.stats.running.store(true, std::memory_order_relaxed);
+  }
+  handle.resume();
+  worker.slice_end = now_ns();
+  int64_t duration = worker.slice_end - start;
+  if (mode & kStats) {
+    worker.stats.running.store(false, std::memory_order_relaxed);
+    if (stamp) {
+      worker.stats.queue_wait.record(queued);
+    }
+    worker.stats.slice.record(duration);
+  }
+  if ((mode & kTrace) && worker.trace.size() < trace_limit_) {
+    worker.trace.push_back(TraceEvent{id, start, duration, queued, TraceEvent::kSlice});
+  }
+}
+
+void EventLoop::set_stats_enabled(bool enabled) {
+  if (enabled) {
+    mode_.fetch_or(kStats, std::memory_order_relaxed);
+  } else {
+    mode_.fetch_and(uint8_t(~kStats), std::memory_order_relaxed);
+  }
+}
+
+LoopStats EventLoop::stats() const {
+  LoopStats stats;
+  // what was taken before what was posted, so that queued() does not come
+  // out negative
+  for (auto& worker : workers_) {
+    stats.completed += worker->stats.completed.load(std::memory_order_relaxed);
+    stats.resumed += worker->stats.resumed.load(std::memory_order_relaxed);
+    stats.reaped += worker->stats.reaped.load(std::memory_order_relaxed);
+    stats.running += worker->stats.running.load(std::memory_order_relaxed);
+    stats.queue_wait.merge(worker->stats.queue_wait);
+    stats.slice.merge(worker->stats.slice);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  for (auto& worker : workers_) {
+    stats.posted += worker->stats.posted.load(std::memory_order_relaxed);
+  }
+  stats.posted += posted_outside_.load(std::memory_order_relaxed);
+  stats.spawned = spawned_.load(std::memory_order_relaxed);
+  stats.completed = std::min(stats.completed, stats.spawned);
+  stats.posted = std::max(stats.posted, stats.resumed + stats.reaped);
+  return stats;
+}
+
+void EventLoop::reset_stats() {
+  for (auto& worker : workers_) {
+    worker->stats.completed.store(0, std::memory_order_relaxed);
+    worker->stats.posted.store(0, std::memory_order_relaxed);
+    worker->stats.resumed.store(0, std::memory_order_relaxed);
+    worker->stats.reaped.store(0, std::memory_order_relaxed);
+    worker->stats.queue_wait = Histogram();
+    worker->stats.slice = Histogram();
+  }
+  spawned_.store(0, std::memory_order_relaxed);
+  posted_outside_.store(0, std::memory_order_relaxed);
+}
+
+void EventLoop::set_tracing(size_t max_events) {
+  trace_limit_ = max_events;
+  for (auto& worker : workers_) {
+    worker->trace.clear();
+    worker->trace.reserve(std::min<size_t>(max_events, 4096));
+  }
+  if (max_events) {
+    mode_.fetch_or(kTrace, std::memory_order_relaxed);
+  } else {
+    mode_.fetch_and(uint8_t(~kTrace), std::memory_order_relaxed);
+  }
+}
+
+std::vector<std::vector<TraceEvent>> EventLoop::trace() const {
+  std::vector<std::vector<TraceEvent>> traces;
+  for (auto& worker : workers_) {
+    traces.push_back(worker->trace);
+  }
+  return traces;
+}
+
+void EventLoop::write_trace(std::ostream& out) const {
+  write_chrome_trace(out, trace());
+}
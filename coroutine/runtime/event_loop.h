@@ -0,0 +1,240 @@
+#ifndef __EVENT_LOOP_H
+#define __EVENT_LOOP_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "io_service.h"
+#include "metrics.h"
+#include "timer_service.h"
+
+// Chase-Lev work stealing deque of coroutine handles (Le et al., "Correct
+// and Efficient Work-Stealing for Weak Memory Models"). The owning worker
+// pushes and pops at the bottom without contention, other workers steal
+// from the top with one CAS. The ring grows when full; old rings are kept
+// until the queue dies because a thief may still be reading one.
+class WorkStealingQueue {
+public:
+  explicit WorkStealingQueue(int64_t capacity = 256);
+  WorkStealingQueue(const WorkStealingQueue&) = delete;
+  WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+  // owner only; stamp goes along with the handle, see EventLoop's stats
+  void push(std::coroutine_handle<> handle, int64_t stamp = 0);
+  std::coroutine_handle<> pop(int64_t& stamp);
+  // any thread; an empty handle when the queue is empty or a race was lost
+  std::coroutine_handle<> steal(int64_t& stamp);
+  bool empty() const {
+    return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Ring {
+    explicit Ring(int64_t capacity)
+      : mask(capacity - 1),
+        slots(new std::atomic<void*>[capacity]),
+        stamps(new std::atomic<int64_t>[capacity]) {}
+    void put(int64_t index, void* address, int64_t stamp) {
+      slots[index & mask].store(address, std::memory_order_relaxed);
+      stamps[index & mask].store(stamp, std::memory_order_relaxed);
+    }
+    void* get(int64_t index) const {
+      return slots[index & mask].load(std::memory_order_relaxed);
+    }
+    int64_t stamp(int64_t index) const {
+      return stamps[index & mask].load(std::memory_order_relaxed);
+    }
+    int64_t mask;
+    std::unique_ptr<std::atomic<void*>[]> slots;
+    std::unique_ptr<std::atomic<int64_t>[]> stamps;
+  };
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Ring*> ring_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+// Multi-threaded coroutine scheduler.
+//
+// Every worker thread owns a WorkStealingQueue. A handle posted from a
+// worker goes to that worker's queue, a handle posted from any other thread
+// to a shared injection queue. A worker runs its own queue newest first,
+// takes batches from the injection queue and steals from the others when
+// both are empty. Handles are resumed without holding any lock, so as many
+// coroutines run at once as there are workers.
+//
+// A worker that finds nothing to run, after a few yields, parks on an
+// atomic wait until a post wakes it.
+//
+// add_task() hands over a new task: the loop owns the frame from then on.
+// The task's final_suspend calls finish_task(), which destroys the frame
+// and counts the task out right there (posting it back finished works
+// too, at the cost of one more trip through the queues). run() returns
+// once every task added has finished, run_until_idle() as soon as nothing
+// is left to run for now; tasks still waiting for timers or sockets then
+// go on at the next run.
+//
+// With stats or tracing on, every post is stamped with the time, so the
+// workers can tell how long a coroutine waited in the queues and how long
+// its slice ran; see metrics.h. That is a clock read per post and one per
+// slice; off, a relaxed load each.
+//
+// shutdown() makes the running (or next) run() wind down: the loop takes
+// no new tasks and, draining, returns once the tasks it has are finished.
+// Otherwise it returns as soon as every worker is out of the coroutine it
+// is running; unfinished tasks stay suspended and go on if the loop runs
+// again (to end them first, cancel them, see cancellation.h). After run()
+// returns the loop takes tasks again.
+class EventLoop {
+public:
+  EventLoop(): EventLoop(std::thread::hardware_concurrency()) {}
+  explicit EventLoop(uint64_t thread_num);
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+  ~EventLoop();
+
+  void run();
+  void run_until_idle();
+  // drain: let the tasks finish, instead of requesting their stop
+  void shutdown(bool drain = true);
+  bool shutting_down() const {
+    return shutdown_.load(std::memory_order_acquire);
+  }
+  // false, with the frame destroyed, once the loop is shutting down
+  bool add_task(std::coroutine_handle<> handle);
+  // (re)schedules a suspended coroutine
+  void post_task(std::coroutine_handle<> handle);
+  // destroys the frame of a finished task, from its final_suspend
+  void finish_task(std::coroutine_handle<> handle);
+
+  // co_await loop.schedule() continues the coroutine on one of the workers;
+  // from a worker it is a yield to the other coroutines queued there
+  struct ScheduleAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle) const {
+      loop_->post_task(handle);
+    }
+    void await_resume() const noexcept {}
+    EventLoop* loop_;
+  };
+  ScheduleAwaiter schedule() {
+    return ScheduleAwaiter{this};
+  }
+
+  uint64_t thread_num() const {
+    return thread_num_;
+  }
+  // the loop running the calling thread, nullptr outside any worker
+  static EventLoop* current();
+  // timers of this loop's coroutines, see sleep.h
+  TimerService& timers() {
+    return timers_;
+  }
+  // readiness of this loop's sockets, see socket.h
+  IoService& io() {
+    return io_;
+  }
+
+  // scheduler counters and histograms; switch them while the loop is not
+  // running, read them from anywhere
+  void set_stats_enabled(bool enabled);
+  LoopStats stats() const;
+  void reset_stats();
+  // Records up to max_events events per worker from now on, dropping those
+  // recorded before; 0 stops recording. Like trace() and write_trace(),
+  // only while the loop is not running.
+  void set_tracing(size_t max_events);
+  // the events of each worker
+  std::vector<std::vector<TraceEvent>> trace() const;
+  void write_trace(std::ostream& out) const;
+
+private:
+  static constexpr uint8_t kStats = 1;
+  static constexpr uint8_t kTrace = 2;
+
+  // a worker's counters, written by the worker alone
+  struct WorkerStats {
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> posted{0};
+    std::atomic<uint64_t> resumed{0};
+    std::atomic<uint64_t> reaped{0};
+    std::atomic<bool> running{false};
+    Histogram queue_wait;
+    Histogram slice;
+  };
+  struct Worker {
+    Worker(EventLoop* loop, size_t index)
+      : loop(loop), index(index), seed(uint32_t(index) * 2654435761u + 1) {}
+    EventLoop* loop;
+    size_t index;
+    WorkStealingQueue queue;
+    uint64_t tick = 0;
+    uint32_t seed;
+    WorkerStats stats;
+    std::vector<TraceEvent> trace;
+    // end of the last instrumented slice, while the worker went straight
+    // on to the next; it saves a clock read as that slice's start
+    int64_t slice_end = 0;
+  };
+  // a handle posted from outside the workers, with its stamp
+  struct Injected {
+    std::coroutine_handle<> handle;
+    int64_t stamp;
+  };
+  void start(bool until_idle);
+  void work(Worker& worker);
+  bool finished() const;
+  bool has_work() const;
+  void park();
+  void wake_one();
+  void wake_some();
+  void wake_all();
+  void count_out(Worker& worker);
+  std::coroutine_handle<> next(Worker& worker, int64_t& stamp);
+  std::coroutine_handle<> take_injected(Worker& worker, int64_t& stamp);
+  std::coroutine_handle<> steal(Worker& worker, int64_t& stamp);
+  void execute(Worker& worker, std::coroutine_handle<> handle, int64_t stamp);
+  void execute_instrumented(Worker& worker, std::coroutine_handle<> handle, int64_t stamp,
+                            uint8_t mode);
+
+  static thread_local Worker* current_worker_;
+
+  std::atomic<uint64_t> task_num_{0};
+  uint64_t thread_num_;
+  // parked workers wait for epoch_ to change; waking_ while a wakeup is
+  // on its way
+  std::atomic<uint64_t> parked_{0};
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<bool> waking_{false};
+  bool until_idle_ = false;
+  // makes the workers return
+  std::atomic<bool> idle_{false};
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> shutdown_{false};
+  // kStats | kTrace
+  std::atomic<uint8_t> mode_{0};
+  size_t trace_limit_ = 0;
+  // counted outside the workers
+  std::atomic<uint64_t> spawned_{0};
+  std::atomic<uint64_t> posted_outside_{0};
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  // injection queue, for handles posted from outside the workers
+  std::mutex mtx_;
+  std::deque<Injected> q_;
+  std::atomic<size_t> q_size_{0};
+  // last, so their threads stop before anything they could post to goes away
+  TimerService timers_;
+  IoService io_;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "frame_pool.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace {
+
+struct FreeFrame {
+  FreeFrame* next_;
+};
+
+std::atomic<bool> enabled_{true};
+std::atomic<bool> stats_enabled_{false};
+std::mutex stats_mtx_;
+FramePool::Stats exited_stats_;
+
+void merge(FramePool::Stats& into, const FramePool::Stats& from) {
+  into.allocations += from.allocations;
+  into.system_allocations += from.system_allocations;
+  for (size_t i = 0; i < FramePool::kClasses; i++) {
+    into.sizes[i] += from.sizes[i];
+  }
+  into.large += from.large;
+}
+
+struct Cache {
+  ~Cache();
+
+  std::array<FreeFrame*, FramePool::kClasses> heads_{};
+  std::array<size_t, FramePool::kClasses> counts_{};
+  FramePool::Stats stats_;
+};
+
+thread_local Cache cache_;
+// frames may still be freed by thread_local destructors that run later
+thread_local bool cache_gone_ = false;
+
+Cache::~Cache() {
+  for (FreeFrame* head : heads_) {
+    while (head) {
+      FreeFrame* next = head->next_;
+      ::operator delete(head);
+      head = next;
+    }
+  }
+  cache_gone_ = true;
+  std::lock_guard<std::mutex> lock(stats_mtx_);
+  merge(exited_stats_, stats_);
+}
+
+}  // namespace
+
+void* FramePool::allocate(size_t size) {
+  if (cache_gone_) {
+    return ::operator new(size);
+  }
+  bool counting = stats_enabled_.load(std::memory_order_relaxed);
+  if (size > kMaxPooled) {
+    if (counting) {
+      cache_.stats_.allocations++;
+      cache_.stats_.large++;
+      cache_.stats_.system_allocations++;
+    }
+    return ::operator new(size);
+  }
+  size_t index = (size - 1) / kClassSize;
+  if (counting) {
+    cache_.stats_.allocations++;
+    cache_.stats_.sizes[index]++;
+  }
+  FreeFrame* frame = cache_.heads_[index];
+  if (frame && enabled_.load(std::memory_order_relaxed)) {
+    cache_.heads_[index] = frame->next_;
+    cache_.counts_[index]--;
+    return frame;
+  }
+  if (counting) {
+    cache_.stats_.system_allocations++;
+  }
+  // always the whole class, so the frame can be reused for any size in it
+  return ::operator new((index + 1) * kClassSize);
+}
+
+void FramePool::deallocate(void* frame, size_t size) noexcept {
+  if (size > kMaxPooled || cache_gone_ || !enabled_.load(std::memory_order_relaxed)) {
+    ::operator delete(frame);
+    return;
+  }
+  size_t index = (size - 1) / kClassSize;
+  if (cache_.counts_[index] >= kMaxCached) {
+    ::operator delete(frame);
+    return;
+  }
+  auto free_frame = static_cast<FreeFrame*>(frame);
+  free_frame->next_ = cache_.heads_[index];
+  cache_.heads_[index] = free_frame;
+  cache_.counts_[index]++;
+}
+
+void FramePool::set_enabled(bool enabled) {
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool FramePool::enabled() {
+  return enabled_.load(std::memory_order_relaxed);
+}
+
+void FramePool::set_stats_enabled(bool enabled) {
+  stats_enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool FramePool::stats_enabled() {
+  return stats_enabled_.load(std::memory_order_relaxed);
+}
+
+FramePool::Stats FramePool::stats() {
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lock(stats_mtx_);
+    stats = exited_stats_;
+  }
+  if (!cache_gone_) {
+    merge(stats, cache_.stats_);
+  }
+  return stats;
+}
+
+void FramePool::reset_stats() {
+  {
+    std::lock_guard<std::mutex> lock(stats_mtx_);
+    exited_stats_ = Stats();
+  }
+  if (!cache_gone_) {
+    cache_.stats_ = Stats();
+  }
+}
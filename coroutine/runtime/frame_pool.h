@@ -0,0 +1,56 @@
+#ifndef __FRAME_POOL_H
+#define __FRAME_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Recycles coroutine frames through thread-local free lists, one per size
+// class of kClassSize bytes up to kMaxPooled. A frame freed on another
+// thread than the one that allocated it simply joins that thread's list.
+// Larger frames, and every frame while the pool is disabled, go to the
+// global operator new. Each list keeps at most kMaxCached frames, and a
+// thread's lists are released when it exits.
+class FramePool {
+public:
+  static constexpr size_t kClassSize = 64;
+  static constexpr size_t kMaxPooled = 1024;
+  static constexpr size_t kClasses = kMaxPooled / kClassSize;
+  static constexpr size_t kMaxCached = 1024;
+
+  struct Stats {
+    // frames allocated, and how many of them came from the system
+    uint64_t allocations = 0;
+    uint64_t system_allocations = 0;
+    // frames by size class; frames above kMaxPooled are counted in large
+    std::array<uint64_t, kClasses> sizes{};
+    uint64_t large = 0;
+  };
+
+  static void* allocate(size_t size);
+  static void deallocate(void* frame, size_t size) noexcept;
+
+  // on by default; frames allocated either way can be freed either way
+  static void set_enabled(bool enabled);
+  static bool enabled();
+
+  // Counting is off by default and costs a few increments per allocation
+  // when on. stats() sums what was counted while it was on.
+  static void set_stats_enabled(bool enabled);
+  static bool stats_enabled();
+  // counters of exited threads plus those of the calling thread
+  static Stats stats();
+  static void reset_stats();
+};
+
+// Base of the runtime's promise types: coroutine frames come from FramePool.
+struct PooledFrame {
+  static void* operator new(size_t size) {
+    return FramePool::allocate(size);
+  }
+  static void operator delete(void* frame, size_t size) noexcept {
+    FramePool::deallocate(frame, size);
+  }
+};
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef __GENERATOR_H
+#define __GENERATOR_H
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include "frame_pool.h"
+
+template <typename T>
+class Generator;
+
+// co_yield elements_of(gen) yields everything gen yields, see Generator.
+template <typename G>
+struct ElementsOf {
+  G generator_;
+};
+
+template <typename T>
+ElementsOf<Generator<T>> elements_of(Generator<T>&& generator) {
+  return {std::move(generator)};
+}
+
+// Lazy sequence of T, an input range.
+//
+//   Generator<int> count(int n) { for (int i = 0; i < n; i++) co_yield i; }
+//   for (const int& i : count(10)) { ... }
+//   auto evens = count(10) | std::views::filter(is_even);
+//
+// Elements are handed out by reference to the yielded object, which stays
+// alive while the generator is suspended, so nothing is copied: yielding
+// a local passes a reference to it. Generator<T&> yields mutable
+// references. A generator may yield all elements of another one with
+// co_yield elements_of(other()); the nested generators form a stack whose
+// innermost frame the iterator resumes directly, so each element costs the
+// same at any nesting depth. Exceptions propagate out of elements_of and
+// out of the iterator's increment. Frames come from the FramePool.
+template <typename T>
+class Generator : public std::ranges::view_interface<Generator<T>> {
+public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = std::conditional_t<std::is_reference_v<T>, T, const T&>;
+
+  class promise_type : public PooledFrame {
+  public:
+    Generator get_return_object() noexcept {
+      return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+
+    // a finished nested generator hands control back to its parent
+    struct FinalAwaiter {
+      bool await_ready() const noexcept {
+        return false;
+      }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        promise_type& promise = handle.promise();
+        if (!promise.parent_) {
+          return std::noop_coroutine();
+        }
+        promise.root_->active_ = promise.parent_;
+        return promise.parent_;
+      }
+      void await_resume() const noexcept {}
+    };
+    FinalAwaiter final_suspend() const noexcept {
+      return {};
+    }
+
+    std::suspend_always yield_value(reference value) noexcept {
+      root_->value_ = std::addressof(value);
+      return {};
+    }
+
+    struct NestedAwaiter {
+      bool await_ready() const noexcept {
+        return !nested_;
+      }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        promise_type& promise = nested_.promise();
+        promise.root_ = handle.promise().root_;
+        promise.parent_ = handle;
+        promise.root_->active_ = nested_;
+        return nested_;
+      }
+      void await_resume() const {
+        if (nested_ && nested_.promise().exception_) {
+          std::rethrow_exception(nested_.promise().exception_);
+        }
+      }
+      std::coroutine_handle<promise_type> nested_;
+    };
+    // the nested generator stays alive as the co_yield operand
+    NestedAwaiter yield_value(ElementsOf<Generator>&& elements) noexcept {
+      return NestedAwaiter{elements.generator_.handle_};
+    }
+
+    void return_void() const noexcept {}
+    void unhandled_exception() noexcept {
+      exception_ = std::current_exception();
+    }
+    // generators are synchronous: co_await is not available in them
+    template <typename U>
+    void await_transform(U&&) = delete;
+
+  private:
+    friend class Generator;
+
+    // the outermost generator's promise, where the innermost active one
+    // and the current element are kept
+    promise_type* root_ = this;
+    std::coroutine_handle<promise_type> active_ =
+        std::coroutine_handle<promise_type>::from_promise(*this);
+    std::coroutine_handle<promise_type> parent_;
+    std::add_pointer_t<reference> value_ = nullptr;
+    std::exception_ptr exception_;
+  };
+
+  class iterator {
+  public:
+    using value_type = Generator::value_type;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    iterator(iterator&& other) noexcept: handle_(std::exchange(other.handle_, nullptr)) {}
+    iterator& operator=(iterator&& other) noexcept {
+      handle_ = std::exchange(other.handle_, nullptr);
+      return *this;
+    }
+
+    reference operator*() const noexcept {
+      return static_cast<reference>(*handle_.promise().value_);
+    }
+    iterator& operator++() {
+      advance(handle_);
+      return *this;
+    }
+    void operator++(int) {
+      ++*this;
+    }
+    friend bool operator==(const iterator& it, std::default_sentinel_t) noexcept {
+      return it.handle_.done();
+    }
+
+  private:
+    friend class Generator;
+    explicit iterator(std::coroutine_handle<promise_type> handle): handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+  Generator() = default;
+  Generator(Generator&& other) noexcept: handle_(std::exchange(other.handle_, nullptr)) {}
+  Generator& operator=(Generator&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  Generator(const Generator&) = delete;
+  Generator& operator=(const Generator&) = delete;
+  ~Generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // starts the generator; call once
+  iterator begin() {
+    advance(handle_);
+    return iterator(handle_);
+  }
+  std::default_sentinel_t end() const noexcept {
+    return {};
+  }
+
+private:
+  explicit Generator(std::coroutine_handle<promise_type> handle): handle_(handle) {}
+
+  // runs the innermost active generator up to its next element
+  static void advance(std::coroutine_handle<promise_type> root) {
+    root.promise().active_.resume();
+    if (root.done() && root.promise().exception_) {
+      std::rethrow_exception(std::exchange(root.promise().exception_, nullptr));
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "io_service.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include "event_loop.h"
+
+IoAwaiter* const IoService::kReady = reinterpret_cast<IoAwaiter*>(uintptr_t(1));
+IoAwaiter* const IoService::kCancelled = reinterpret_cast<IoAwaiter*>(uintptr_t(2));
+
+IoService::~IoService() {
+  if (thread_.joinable()) {
+    stop_.store(true, std::memory_order_release);
+    wake();
+    thread_.join();
+  }
+  for (IoEntry* entry : removed_) {
+    delete entry;
+  }
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+void IoService::start() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    return;
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  if (wake_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+    int error = errno;
+    close(epoll_fd_);
+    epoll_fd_ = -1;
+    errno = error;
+    return;
+  }
+  thread_ = std::thread([this]() {
+    run();
+  });
+}
+
+IoEntry* IoService::add(int fd) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (epoll_fd_ < 0) {
+      start();
+      if (epoll_fd_ < 0) {
+        return nullptr;
+      }
+    }
+  }
+  IoEntry* entry = new IoEntry;
+  entry->fd_ = fd;
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = entry;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    delete entry;
+    return nullptr;
+  }
+  return entry;
+}
+
+void IoService::remove(IoEntry* entry) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, entry->fd_, nullptr);
+  close(entry->fd_);
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    removed_.push_back(entry);
+  }
+  wake();
+}
+
+bool IoService::wait(std::atomic<IoAwaiter*>& slot, IoAwaiter* awaiter) {
+  while (true) {
+    IoAwaiter* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, awaiter, std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+      return true;
+    }
+    if (expected == kCancelled) {
+      return false;
+    }
+    // an edge came since the last attempt: use it up and try again (unless
+    // a cancel() came in between)
+    if (!slot.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed)) {
+      continue;
+    }
+    if (awaiter->attempt_(awaiter)) {
+      return false;
+    }
+  }
+}
+
+void IoService::cancel(std::atomic<IoAwaiter*>& slot, IoAwaiter* awaiter) {
+  IoAwaiter* current = slot.load(std::memory_order_acquire);
+  while (current != kCancelled) {
+    if (current == awaiter) {
+      if (slot.compare_exchange_weak(current, nullptr, std::memory_order_acquire)) {
+        awaiter->loop_->post_task(awaiter->handle_);
+        return;
+      }
+    } else if (slot.compare_exchange_weak(current, kCancelled, std::memory_order_release,
+                                          std::memory_order_acquire)) {
+      return;
+    }
+  }
+}
+
+void IoService::clear_cancelled(std::atomic<IoAwaiter*>& slot) {
+  // a lost edge costs nothing: every operation tries its call first
+  IoAwaiter* expected = kCancelled;
+  slot.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed);
+}
+
+void IoService::ready(std::atomic<IoAwaiter*>& slot) {
+  IoAwaiter* current = slot.load(std::memory_order_acquire);
+  while (current != kReady && current != kCancelled) {
+    if (current == nullptr) {
+      if (slot.compare_exchange_weak(current, kReady, std::memory_order_release,
+                                     std::memory_order_acquire)) {
+        return;
+      }
+    } else if (slot.compare_exchange_weak(current, nullptr, std::memory_order_acquire)) {
+      IoAwaiter* expected = nullptr;
+      if (current->attempt_(current)) {
+        current->loop_->post_task(current->handle_);
+      } else if (!slot.compare_exchange_strong(expected, current, std::memory_order_release)) {
+        // cancelled while this thread held it: the poller gives up for it
+        slot.store(nullptr, std::memory_order_relaxed);
+        current->loop_->post_task(current->handle_);
+      }
+      // otherwise the edge was for data the coroutine already took and it
+      // waits for the next
+      return;
+    }
+  }
+}
+
+void IoService::wake() {
+  uint64_t one = 1;
+  ssize_t written = write(wake_fd_, &one, sizeof(one));
+  (void)written;
+}
+
+void IoService::run() {
+  epoll_event events[64];
+  std::vector<IoEntry*> removed;
+  while (!stop_.load(std::memory_order_acquire)) {
+    int num = epoll_wait(epoll_fd_, events, 64, -1);
+    for (int i = 0; i < num; i++) {
+      auto entry = static_cast<IoEntry*>(events[i].data.ptr);
+      uint32_t flags = events[i].events;
+      if (!entry) {
+        uint64_t count;
+        ssize_t got = read(wake_fd_, &count, sizeof(count));
+        (void)got;
+        continue;
+      }
+      if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        ready(entry->reader_);
+      }
+      if (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        ready(entry->writer_);
+      }
+    }
+    // nothing of this batch refers to them any more
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      removed.swap(removed_);
+    }
+    for (IoEntry* entry : removed) {
+      delete entry;
+    }
+    removed.clear();
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef __IO_SERVICE_H
+#define __IO_SERVICE_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class EventLoop;
+
+// A coroutine waiting for a socket. attempt_ makes the non-blocking system
+// call and returns false on EAGAIN; the awaiter keeps the result itself.
+struct IoAwaiter {
+  bool (*attempt_)(IoAwaiter* awaiter) = nullptr;
+  std::coroutine_handle<> handle_;
+  EventLoop* loop_ = nullptr;
+};
+
+// Readiness of one registered fd. Each direction holds nullptr, kReady (an
+// edge came while nobody waited), kCancelled (the operation in progress was
+// cancelled before it could wait) or the waiting awaiter; at most one
+// reader and one writer wait at a time.
+struct IoEntry {
+  int fd_;
+  std::atomic<IoAwaiter*> reader_{nullptr};
+  std::atomic<IoAwaiter*> writer_{nullptr};
+};
+
+// Edge-triggered epoll driven by one thread, shared by the sockets of an
+// EventLoop. Every fd is registered once for both directions. On an edge
+// the thread retries the waiting awaiter's system call itself and posts
+// the coroutine to its loop only when the call got through, so a resumed
+// coroutine always has its result and an edge that raced with the
+// coroutine's own attempt costs nothing but a retry.
+class IoService {
+public:
+  static IoAwaiter* const kReady;
+  static IoAwaiter* const kCancelled;
+
+  IoService() = default;
+  IoService(const IoService&) = delete;
+  IoService& operator=(const IoService&) = delete;
+  ~IoService();
+
+  // registers a non-blocking fd; nullptr with errno set on failure
+  IoEntry* add(int fd);
+  // deregisters and closes the fd; the entry is freed once the poller
+  // thread can no longer be looking at it
+  void remove(IoEntry* entry);
+  // parks awaiter in slot; false if the operation completed (or was
+  // cancelled) meanwhile and the coroutine should not suspend
+  static bool wait(std::atomic<IoAwaiter*>& slot, IoAwaiter* awaiter);
+  // Gives up the operation of awaiter, from any thread: a waiting awaiter
+  // is taken out of slot and posted without a result. Otherwise the slot is
+  // marked so that the wait about to start, or the poller retrying it,
+  // gives up instead. The awaiter must call clear_cancelled() once resumed.
+  static void cancel(std::atomic<IoAwaiter*>& slot, IoAwaiter* awaiter);
+  static void clear_cancelled(std::atomic<IoAwaiter*>& slot);
+
+private:
+  void start();
+  void run();
+  void ready(std::atomic<IoAwaiter*>& slot);
+  void wake();
+
+  std::mutex mtx_;
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+  // removed entries waiting for the end of the current batch
+  std::vector<IoEntry*> removed_;
+};
+
+#endif
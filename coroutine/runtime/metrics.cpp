@@ -0,0 +1,105 @@
+#include "metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cstdio>
+
+Histogram& Histogram::operator=(const Histogram& other) {
+  for (auto& cell : buckets_) {
+    cell.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+  merge(other);
+  return *this;
+}
+
+void Histogram::record(int64_t ns) {
+  if (ns < 0) {
+    ns = 0;
+  }
+  size_t index = std::min<size_t>(std::bit_width(uint64_t(ns)), kBuckets - 1);
+  bump(buckets_[index], 1);
+  bump(count_, 1);
+  bump(sum_, ns);
+  if (ns > max_.load(std::memory_order_relaxed)) {
+    max_.store(ns, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::merge(const Histogram& other) {
+  for (size_t i = 0; i < kBuckets; i++) {
+    bump(buckets_[i], other.bucket(i));
+  }
+  bump(count_, other.count());
+  bump(sum_, other.sum_.load(std::memory_order_relaxed));
+  if (other.max() > max()) {
+    max_.store(other.max(), std::memory_order_relaxed);
+  }
+}
+
+double Histogram::mean() const {
+  uint64_t count = this->count();
+  return count ? double(sum_.load(std::memory_order_relaxed)) / count : 0;
+}
+
+int64_t Histogram::percentile(double q) const {
+  uint64_t count = this->count();
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; i++) {
+    seen += bucket(i);
+    if (seen > 0 && double(seen) >= q * count) {
+      return std::min<int64_t>(int64_t(1) << i, max());
+    }
+  }
+  return max();
+}
+
+// microseconds with the nanoseconds kept, as the format wants
+static void print_us(std::ostream& out, int64_t ns) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%" PRId64 ".%03" PRId64, ns / 1000, ns % 1000);
+  out << buf;
+}
+
+static void print_id(std::ostream& out, uintptr_t id) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\"0x%" PRIxPTR "\"", id);
+  out << buf;
+}
+
+void write_chrome_trace(std::ostream& out, const std::vector<std::vector<TraceEvent>>& workers) {
+  // timestamps from the earliest event, so they stay readable
+  int64_t origin = INT64_MAX;
+  for (auto& events : workers) {
+    for (auto& event : events) {
+      origin = std::min(origin, event.start_ns);
+    }
+  }
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (size_t tid = 0; tid < workers.size(); tid++) {
+    out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << tid << ",\"args\":{\"name\":\"worker " << tid << "\"}}";
+    first = false;
+    for (auto& event : workers[tid]) {
+      out << ",\n{\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+      print_us(out, event.start_ns - origin);
+      if (event.kind == TraceEvent::kSlice) {
+        out << ",\"name\":\"resume\",\"cat\":\"coroutine\",\"ph\":\"X\",\"dur\":";
+        print_us(out, event.duration_ns);
+        out << ",\"args\":{\"id\":";
+        print_id(out, event.id);
+        out << ",\"queued_us\":";
+        print_us(out, event.queued_ns);
+        out << "}}";
+      } else {
+        out << ",\"name\":\"finish\",\"cat\":\"coroutine\",\"ph\":\"i\",\"s\":\"t\",\"args\":{\"id\":";
+        print_id(out, event.id);
+        out << "}}";
+      }
+    }
+  }
+  out << "\n]}\n";
+}
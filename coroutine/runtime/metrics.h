@@ -0,0 +1,106 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Instrumentation of an EventLoop, see EventLoop::set_stats_enabled() and
+// EventLoop::set_tracing(). Times are steady_clock nanoseconds.
+
+// Durations in power-of-two buckets: bucket i counts the values below 2^i
+// ns that don't fit an earlier one. One thread records, any thread may
+// copy it meanwhile (and gets each cell as it was at some point).
+class Histogram {
+public:
+  static constexpr size_t kBuckets = 48;
+
+  Histogram() = default;
+  Histogram(const Histogram& other) {
+    merge(other);
+  }
+  Histogram& operator=(const Histogram& other);
+
+  void record(int64_t ns);
+  void merge(const Histogram& other);
+
+  uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+  int64_t max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+  double mean() const;
+  // upper bound of the bucket holding the q quantile (0 < q <= 1), or
+  // max() if that is lower
+  int64_t percentile(double q) const;
+  uint64_t bucket(size_t index) const {
+    return buckets_[index].load(std::memory_order_relaxed);
+  }
+
+private:
+  static void bump(std::atomic<uint64_t>& cell, uint64_t n) {
+    cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<int64_t> max_{0};
+};
+
+// Scheduler counters of a loop. A coroutine is posted whenever it is made
+// runnable (spawning one posts it too) and resumed when a worker runs it
+// up to its next suspension: one slice.
+struct LoopStats {
+  uint64_t spawned = 0;
+  uint64_t completed = 0;
+  uint64_t posted = 0;
+  uint64_t resumed = 0;
+  // finished tasks that were posted back instead of finished in place
+  uint64_t reaped = 0;
+  // workers in a slice right now
+  uint64_t running = 0;
+  // from post to resume, and the slices themselves
+  Histogram queue_wait;
+  Histogram slice;
+
+  uint64_t in_flight() const {
+    return spawned - completed;
+  }
+  uint64_t queued() const {
+    return posted - resumed - reaped;
+  }
+  // Tasks waiting for something outside the loop (a timer, a socket, a
+  // lock): those in flight that are neither queued nor running. Only
+  // roughly right while tasks run when_all children, which can be
+  // queued several at a time.
+  uint64_t suspended() const {
+    uint64_t busy = queued() + running;
+    return in_flight() > busy ? in_flight() - busy : 0;
+  }
+};
+
+// one slice of one coroutine on one worker; the coroutine is known by its
+// frame address, which is unique among coroutines alive at the same time
+struct TraceEvent {
+  enum Kind : uint8_t {
+    kSlice,
+    kFinish,
+  };
+  uintptr_t id;
+  int64_t start_ns;
+  int64_t duration_ns;
+  int64_t queued_ns;
+  Kind kind;
+};
+
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev) of the events of
+// each worker: slices become complete events on the worker's track,
+// finishes instant ones.
+void write_chrome_trace(std::ostream& out, const std::vector<std::vector<TraceEvent>>& workers);
+
+#endif
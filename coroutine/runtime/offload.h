@@ -0,0 +1,196 @@
+#ifndef __OFFLOAD_H
+#define __OFFLOAD_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "../../threads_pool/threads_pool.h"
+#include "event_loop.h"
+#include "frame_pool.h"
+#include "task.h"
+
+// Bridges between coroutines and the ThreadsPool, for CPU-heavy work that
+// would otherwise hold up an EventLoop worker (or park a thread on a
+// future):
+//
+//   int sum = co_await pool.submit_async(checksum, data);  // job on the pool
+//   int sum = co_await run_on(pool, checksum_task(data));  // task on the pool
+//   int sum = sync_wait(pool, checksum_task(data));        // from plain code
+//
+// A coroutine of an EventLoop is posted back to that loop when the pool is
+// done; one running on the pool itself goes on right there. On the pool
+// there is no EventLoop, so a task run there may await other tasks, the
+// combinators and pool jobs, but not sleeps, sockets or the sync.h
+// primitives.
+
+// co_await pool.submit_async(...): runs job on the pool, keeping its
+// result or exception for the awaiting coroutine
+template <typename Job>
+class PoolJobAwaiter {
+public:
+  using Ret = std::invoke_result_t<Job&>;
+
+  PoolJobAwaiter(ThreadsPool& pool, Job job): pool_(pool), job_(std::move(job)) {}
+  PoolJobAwaiter(const PoolJobAwaiter&) = delete;
+  PoolJobAwaiter& operator=(const PoolJobAwaiter&) = delete;
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+  void await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    loop_ = EventLoop::current();
+    // from here on the job may finish, and the coroutine go on, at any time
+    pool_.execute([this]() {
+      run();
+    });
+  }
+  Ret await_resume() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if constexpr (!std::is_void_v<Ret>) {
+      return std::move(*result_);
+    }
+  }
+
+private:
+  void run() {
+    try {
+      if constexpr (std::is_void_v<Ret>) {
+        job_();
+      } else {
+        result_.emplace(job_());
+      }
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+    if (loop_) {
+      loop_->post_task(handle_);
+    } else {
+      handle_.resume();
+    }
+  }
+
+  ThreadsPool& pool_;
+  Job job_;
+  std::coroutine_handle<> handle_;
+  EventLoop* loop_ = nullptr;
+  std::optional<WhenAllValue<Ret>> result_;
+  std::exception_ptr error_;
+};
+
+template <typename Func, typename... Args>
+auto ThreadsPool::submit_async(Func&& func, Args&&... args) {
+  auto job = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+  return PoolJobAwaiter<decltype(job)>(*this, std::move(job));
+}
+
+// co_await resume_on(pool) continues the coroutine on one of the pool's
+// threads
+class PoolHop {
+public:
+  explicit PoolHop(ThreadsPool& pool): pool_(pool) {}
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+  void await_suspend(std::coroutine_handle<> handle) {
+    pool_.execute([handle]() {
+      handle.resume();
+    });
+  }
+  void await_resume() const noexcept {}
+
+private:
+  ThreadsPool& pool_;
+};
+
+inline PoolHop resume_on(ThreadsPool& pool) {
+  return PoolHop(pool);
+}
+
+// Runs task on the pool and returns its result (or rethrows) back on the
+// awaiting coroutine's loop. The task starts on a pool thread and goes on
+// on whichever pool threads its awaits resume it.
+template <typename T>
+Task<T> run_on(ThreadsPool& pool, Task<T> task) {
+  EventLoop* loop = EventLoop::current();
+  co_await resume_on(pool);
+  std::optional<WhenAllValue<T>> result;
+  std::exception_ptr error;
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      result.emplace();
+    } else {
+      result.emplace(co_await task);
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (loop) {
+    co_await loop->schedule();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if constexpr (!std::is_void_v<T>) {
+    co_return std::move(*result);
+  }
+}
+
+// coroutine behind sync_wait(pool, ...): starts at once and frees itself
+class PoolRun {
+public:
+  struct promise_type : PooledFrame {
+    PoolRun get_return_object() const noexcept {
+      return {};
+    }
+    std::suspend_never initial_suspend() const noexcept {
+      return {};
+    }
+    std::suspend_never final_suspend() const noexcept {
+      return {};
+    }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept {
+      std::terminate();
+    }
+  };
+};
+
+template <typename T>
+PoolRun pool_run(ThreadsPool& pool, Task<T> task, std::promise<WhenAllValue<T>> done) {
+  co_await resume_on(pool);
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      done.set_value({});
+    } else {
+      done.set_value(co_await task);
+    }
+  } catch (...) {
+    done.set_exception(std::current_exception());
+  }
+}
+
+// Runs task to completion on the pool and returns its result, blocking
+// the calling thread (which must not be one of the pool's) meanwhile.
+template <typename T>
+T sync_wait(ThreadsPool& pool, Task<T> task) {
+  std::promise<WhenAllValue<T>> done;
+  std::future<WhenAllValue<T>> result = done.get_future();
+  pool_run(pool, std::move(task), std::move(done));
+  if constexpr (std::is_void_v<T>) {
+    result.get();
+  } else {
+    return result.get();
+  }
+}
+
+#endif
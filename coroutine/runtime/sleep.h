@@ -0,0 +1,146 @@
+#ifndef __SLEEP_H
+#define __SLEEP_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include "cancellation.h"
+#include "event_loop.h"
+#include "task.h"
+#include "timer_service.h"
+
+// co_await sleep_for(100ms) suspends the calling coroutine on its loop's
+// TimerService; the timer thread posts it back to the loop at the deadline.
+// The awaiter is the timer node, so a sleep does not allocate, and a
+// deadline already passed does not suspend at all. Must be awaited from a
+// coroutine running on an EventLoop.
+//
+// In a task with a stop token, a stop request expires the timer at once
+// and the sleep throws OperationCancelled, as does any sleep that would
+// have to wait after the request.
+class SleepAwaiter : private TimerNode {
+public:
+  explicit SleepAwaiter(Clock::time_point deadline) {
+    deadline_ = deadline;
+  }
+  SleepAwaiter(const SleepAwaiter&) = delete;
+  SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+
+  bool await_ready() const {
+    return deadline_ <= Clock::now();
+  }
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> handle) {
+    loop_ = EventLoop::current();
+    handle_ = handle;
+    fire_ = [](TimerNode* node) {
+      auto self = static_cast<SleepAwaiter*>(node);
+      self->loop_->post_task(self->handle_);
+    };
+    token_ = stop_token_of(handle);
+    if (token_) {
+      // before add(): a request from now on expires the timer, even one
+      // that comes before it is queued (or right here)
+      stop_callback_.emplace(*token_, Expire{this});
+    }
+    loop_->timers().add(*this);
+  }
+  void await_resume() {
+    // waits for a callback still running on another thread
+    stop_callback_.reset();
+    if (token_ && token_->stop_requested()) {
+      throw OperationCancelled();
+    }
+  }
+
+private:
+  struct Expire {
+    void operator()() const {
+      self_->loop_->timers().expire(*self_);
+    }
+    SleepAwaiter* self_;
+  };
+
+  EventLoop* loop_ = nullptr;
+  std::coroutine_handle<> handle_;
+  const std::stop_token* token_ = nullptr;
+  std::optional<std::stop_callback<Expire>> stop_callback_;
+};
+
+inline SleepAwaiter sleep_until(TimerNode::Clock::time_point deadline) {
+  return SleepAwaiter(deadline);
+}
+
+template <typename Rep, typename Period>
+SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> duration) {
+  return SleepAwaiter(TimerNode::Clock::now() +
+                      std::chrono::duration_cast<TimerNode::Clock::duration>(duration));
+}
+
+// the two halves of with_timeout: each stops the other when it is done
+template <typename T>
+Task<> timeout_work(Task<T>& task, std::optional<WhenAllValue<T>>& result,
+                    std::stop_source& timer) {
+  struct StopTimer {
+    ~StopTimer() {
+      timer_.request_stop();
+    }
+    std::stop_source& timer_;
+  } stop_timer{timer};
+  if constexpr (std::is_void_v<T>) {
+    co_await task;
+    result.emplace();
+  } else {
+    result.emplace(co_await task);
+  }
+}
+
+template <typename Rep, typename Period>
+Task<> timeout_timer(std::chrono::duration<Rep, Period> duration, std::stop_source& work,
+                     std::atomic<bool>& fired) {
+  try {
+    co_await sleep_for(duration);
+  } catch (const OperationCancelled&) {
+    co_return;
+  }
+  fired.store(true, std::memory_order_relaxed);
+  work.request_stop();
+}
+
+// Runs task, but requests its stop once duration has passed; a stop of
+// the awaiting task is passed on too. Returns the task's result, or throws
+// TimedOut if the deadline stopped it. Cancellation is cooperative: the
+// task ends when its sleeps and socket calls give up (or it checks its
+// token), and with_timeout waits until then.
+template <typename T, typename Rep, typename Period>
+Task<T> with_timeout(Task<T> task, std::chrono::duration<Rep, Period> duration) {
+  std::stop_source work;
+  std::stop_source timer;
+  std::atomic<bool> fired{false};
+  std::stop_token parent = co_await get_stop_token();
+  auto forward = [&work]() {
+    work.request_stop();
+  };
+  std::stop_callback<decltype(forward)> forward_stop(parent, forward);
+  task.set_stop_token(work.get_token());
+  Task<> timer_task = timeout_timer(duration, work, fired);
+  timer_task.set_stop_token(timer.get_token());
+  std::optional<WhenAllValue<T>> result;
+  try {
+    co_await when_all(timeout_work(task, result, timer), std::move(timer_task));
+  } catch (const OperationCancelled&) {
+    if (fired.load(std::memory_order_relaxed) && !parent.stop_requested()) {
+      throw TimedOut();
+    }
+    throw;
+  }
+  if constexpr (!std::is_void_v<T>) {
+    co_return std::move(*result);
+  }
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include "socket.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+
+ReadAwaiter::ReadAwaiter(IoEntry* entry, void* buf, size_t len)
+  : SocketAwaiter(entry ? &entry->reader_ : nullptr), fd_(entry ? entry->fd_ : -1),
+    buf_(buf), len_(len) {}
+
+bool ReadAwaiter::try_io() {
+  ssize_t num = ::read(fd_, buf_, len_);
+  if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return false;
+  }
+  result_ = num < 0 ? -errno : num;
+  return true;
+}
+
+WriteAwaiter::WriteAwaiter(IoEntry* entry, const void* buf, size_t len)
+  : SocketAwaiter(entry ? &entry->writer_ : nullptr), fd_(entry ? entry->fd_ : -1),
+    buf_(buf), len_(len) {}
+
+bool WriteAwaiter::try_io() {
+  // send() rather than write(): no SIGPIPE when the peer has gone
+  ssize_t num = ::send(fd_, buf_, len_, MSG_NOSIGNAL);
+  if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return false;
+  }
+  result_ = num < 0 ? -errno : num;
+  return true;
+}
+
+AcceptAwaiter::AcceptAwaiter(IoService* io, IoEntry* entry)
+  : SocketAwaiter(entry ? &entry->reader_ : nullptr), io_(io), fd_(entry ? entry->fd_ : -1) {}
+
+bool AcceptAwaiter::try_io() {
+  int fd = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return false;
+  }
+  result_ = fd < 0 ? -errno : fd;
+  return true;
+}
+
+Socket AcceptAwaiter::await_resume() {
+  if (!finish()) {
+    return Socket::failed(ECANCELED);
+  }
+  if (result_ < 0) {
+    return Socket::failed(-result_);
+  }
+  return Socket(*io_, result_);
+}
+
+ConnectAwaiter::ConnectAwaiter(IoService& io, const sockaddr_in& address)
+  : SocketAwaiter(nullptr), io_(io) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    result_ = -errno;
+    return;
+  }
+  entry_ = io_.add(fd);
+  if (!entry_) {
+    result_ = -errno;
+    ::close(fd);
+    return;
+  }
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+    done_ = true;
+  } else if (errno != EINPROGRESS) {
+    result_ = -errno;
+    done_ = true;
+  }
+  // without a slot await_ready() doesn't wait
+  if (!done_) {
+    slot_ = &entry_->writer_;
+  }
+}
+
+ConnectAwaiter::~ConnectAwaiter() {
+  if (entry_) {
+    io_.remove(entry_);
+  }
+}
+
+bool ConnectAwaiter::try_io() {
+  if (done_) {
+    return true;
+  }
+  pollfd poll_fd{entry_->fd_, POLLOUT, 0};
+  if (poll(&poll_fd, 1, 0) == 0) {
+    return false;
+  }
+  int error = 0;
+  socklen_t len = sizeof(error);
+  getsockopt(entry_->fd_, SOL_SOCKET, SO_ERROR, &error, &len);
+  result_ = -error;
+  done_ = true;
+  return true;
+}
+
+Socket ConnectAwaiter::await_resume() {
+  if (!finish()) {
+    return Socket::failed(ECANCELED);
+  }
+  if (result_ < 0) {
+    return Socket::failed(-result_);
+  }
+  Socket socket;
+  socket.io_ = &io_;
+  std::swap(socket.entry_, entry_);
+  return socket;
+}
+
+Socket::Socket(IoService& io, int fd): io_(&io), entry_(io.add(fd)) {
+  if (!entry_) {
+    error_ = errno;
+    ::close(fd);
+  }
+}
+
+Socket::Socket(Socket&& other) noexcept
+  : io_(other.io_), entry_(other.entry_), error_(other.error_) {
+  other.entry_ = nullptr;
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+  if (this != &other) {
+    close();
+    io_ = other.io_;
+    entry_ = other.entry_;
+    error_ = other.error_;
+    other.entry_ = nullptr;
+  }
+  return *this;
+}
+
+void Socket::close() {
+  if (entry_) {
+    io_->remove(entry_);
+    entry_ = nullptr;
+  }
+}
+
+uint16_t Socket::local_port() const {
+  sockaddr_in address{};
+  socklen_t len = sizeof(address);
+  if (!entry_ || getsockname(entry_->fd_, reinterpret_cast<sockaddr*>(&address), &len) < 0) {
+    return 0;
+  }
+  return ntohs(address.sin_port);
+}
+
+Socket Socket::listen(EventLoop& loop, uint16_t port, int backlog) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to create socket");
+  }
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to bind socket");
+  }
+  if (::listen(fd, backlog) < 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to listen on socket");
+  }
+  Socket socket(loop.io(), fd);
+  if (!socket.valid()) {
+    throw std::runtime_error("Failed to register socket");
+  }
+  return socket;
+}
+
+ConnectAwaiter Socket::connect(EventLoop& loop, const std::string& host, uint16_t port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    address.sin_addr.s_addr = INADDR_NONE;
+  }
+  return ConnectAwaiter(loop.io(), address);
+}
@@ -0,0 +1,201 @@
+#ifndef __SOCKET_H
+#define __SOCKET_H
+
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <cerrno>
+#include <cstdint>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include "cancellation.h"
+#include "event_loop.h"
+#include "io_service.h"
+
+class Socket;
+
+// Common part of the socket awaitables. The system call is tried right
+// away and the coroutine suspends only on EAGAIN; the IoService retries it
+// on the next edge. Derived::try_io() makes the call and returns false on
+// EAGAIN. Results follow the system call, with -errno for errors. In a task
+// with a stop token, a stop request ends a wait with -ECANCELED.
+template <typename Derived>
+class SocketAwaiter : public IoAwaiter {
+public:
+  explicit SocketAwaiter(std::atomic<IoAwaiter*>* slot): slot_(slot) {
+    attempt_ = [](IoAwaiter* self) {
+      auto derived = static_cast<Derived*>(self);
+      derived->completed_ = derived->try_io();
+      return derived->completed_;
+    };
+  }
+  SocketAwaiter(const SocketAwaiter&) = delete;
+  SocketAwaiter& operator=(const SocketAwaiter&) = delete;
+
+  bool await_ready() {
+    completed_ = !slot_ || static_cast<Derived*>(this)->try_io();
+    return completed_;
+  }
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> handle) {
+    handle_ = handle;
+    loop_ = EventLoop::current();
+    if (const std::stop_token* token = stop_token_of(handle)) {
+      // may run right here, and then the wait gives up at once
+      stop_callback_.emplace(*token, Cancel{this});
+    }
+    return IoService::wait(*slot_, this);
+  }
+
+protected:
+  // call first in await_resume(); false if the operation was cancelled
+  bool finish() {
+    if (stop_callback_) {
+      // waits for a callback still running on another thread
+      stop_callback_.reset();
+      IoService::clear_cancelled(*slot_);
+    }
+    return completed_;
+  }
+
+  std::atomic<IoAwaiter*>* slot_;
+  bool completed_ = false;
+
+private:
+  struct Cancel {
+    void operator()() const {
+      IoService::cancel(*self_->slot_, self_);
+    }
+    SocketAwaiter* self_;
+  };
+
+  std::optional<std::stop_callback<Cancel>> stop_callback_;
+};
+
+class ReadAwaiter : public SocketAwaiter<ReadAwaiter> {
+public:
+  ReadAwaiter(IoEntry* entry, void* buf, size_t len);
+  bool try_io();
+  ssize_t await_resume() {
+    return finish() ? result_ : -ECANCELED;
+  }
+
+private:
+  int fd_;
+  void* buf_;
+  size_t len_;
+  ssize_t result_ = -EBADF;
+};
+
+class WriteAwaiter : public SocketAwaiter<WriteAwaiter> {
+public:
+  WriteAwaiter(IoEntry* entry, const void* buf, size_t len);
+  bool try_io();
+  ssize_t await_resume() {
+    return finish() ? result_ : -ECANCELED;
+  }
+
+private:
+  int fd_;
+  const void* buf_;
+  size_t len_;
+  ssize_t result_ = -EBADF;
+};
+
+class AcceptAwaiter : public SocketAwaiter<AcceptAwaiter> {
+public:
+  AcceptAwaiter(IoService* io, IoEntry* entry);
+  bool try_io();
+  // an invalid Socket on error, see Socket::error()
+  Socket await_resume();
+
+private:
+  IoService* io_;
+  int fd_;
+  int result_ = -EBADF;
+};
+
+class ConnectAwaiter : public SocketAwaiter<ConnectAwaiter> {
+public:
+  ConnectAwaiter(IoService& io, const sockaddr_in& address);
+  ConnectAwaiter(const ConnectAwaiter&) = delete;
+  ConnectAwaiter& operator=(const ConnectAwaiter&) = delete;
+  ~ConnectAwaiter();
+  bool try_io();
+  Socket await_resume();
+
+private:
+  IoService& io_;
+  IoEntry* entry_ = nullptr;
+  int result_ = 0;
+  // connect() finished (or failed) without waiting
+  bool done_ = false;
+};
+
+// A non-blocking TCP socket registered with an EventLoop's IoService.
+//
+//   Socket conn = co_await listener.accept();
+//   ssize_t n = co_await conn.read(buf, sizeof(buf));
+//   ssize_t sent = co_await conn.write(buf, n);
+//
+// One coroutine may read while another writes, but two reads (or two
+// writes) must not wait on the same socket at once. Sockets must be closed
+// before their EventLoop is destroyed.
+class Socket {
+public:
+  Socket() = default;
+  // takes over a non-blocking fd
+  Socket(IoService& io, int fd);
+  Socket(Socket&& other) noexcept;
+  Socket& operator=(Socket&& other) noexcept;
+  Socket(const Socket&) = delete;
+  Socket& operator=(const Socket&) = delete;
+  ~Socket() {
+    close();
+  }
+
+  // a listening socket on 0.0.0.0:port (port 0 picks a free one);
+  // throws std::runtime_error on failure like the reactor's Acceptor
+  static Socket listen(EventLoop& loop, uint16_t port, int backlog = SOMAXCONN);
+  static ConnectAwaiter connect(EventLoop& loop, const std::string& host, uint16_t port);
+
+  AcceptAwaiter accept() {
+    return AcceptAwaiter(io_, entry_);
+  }
+  // bytes read, 0 at end of stream
+  ReadAwaiter read(void* buf, size_t len) {
+    return ReadAwaiter(entry_, buf, len);
+  }
+  // bytes written, possibly fewer than len
+  WriteAwaiter write(const void* buf, size_t len) {
+    return WriteAwaiter(entry_, buf, len);
+  }
+
+  bool valid() const {
+    return entry_ != nullptr;
+  }
+  int fd() const {
+    return entry_ ? entry_->fd_ : -1;
+  }
+  // errno of the accept or connect that produced an invalid socket
+  int error() const {
+    return error_;
+  }
+  uint16_t local_port() const;
+  void close();
+
+private:
+  friend class AcceptAwaiter;
+  friend class ConnectAwaiter;
+  static Socket failed(int error) {
+    Socket socket;
+    socket.error_ = error;
+    return socket;
+  }
+
+  IoService* io_ = nullptr;
+  IoEntry* entry_ = nullptr;
+  int error_ = 0;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "sync.h"
+#include <algorithm>
+
+// the waiters of a stack, oldest first
+static AsyncWaiter* reverse(AsyncWaiter* waiter) {
+  AsyncWaiter* reversed = nullptr;
+  while (waiter) {
+    AsyncWaiter* next = waiter->next_;
+    waiter->next_ = reversed;
+    reversed = waiter;
+    waiter = next;
+  }
+  return reversed;
+}
+
+bool AsyncMutex::LockAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+  handle_ = handle;
+  loop_ = EventLoop::current();
+  uintptr_t state = mutex_.state_.load(std::memory_order_relaxed);
+  while (true) {
+    if (state == kUnlocked) {
+      if (mutex_.state_.compare_exchange_weak(state, kLocked, std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+        return false;
+      }
+    } else {
+      next_ = reinterpret_cast<AsyncWaiter*>(state);
+      if (mutex_.state_.compare_exchange_weak(state, reinterpret_cast<uintptr_t>(this),
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+}
+
+void AsyncMutex::unlock() {
+  if (!waiters_) {
+    uintptr_t state = kLocked;
+    if (state_.compare_exchange_strong(state, kUnlocked, std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+      return;
+    }
+    // waiters came: take them all, the mutex stays locked
+    state = state_.exchange(kLocked, std::memory_order_acquire);
+    waiters_ = reverse(reinterpret_cast<AsyncWaiter*>(state));
+  }
+  AsyncWaiter* next = waiters_;
+  waiters_ = next->next_;
+  next->wake();
+}
+
+bool AsyncSemaphore::AcquireAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+  handle_ = handle;
+  loop_ = EventLoop::current();
+  AsyncSemaphore& semaphore = semaphore_;
+  AsyncWaiter* head = semaphore.incoming_.load(std::memory_order_relaxed);
+  do {
+    next_ = head;
+  } while (!semaphore.incoming_.compare_exchange_weak(head, this, std::memory_order_release,
+                                                      std::memory_order_relaxed));
+  // from here on this awaiter may be woken and gone: only use locals
+  if (semaphore.count_.fetch_sub(1, std::memory_order_acq_rel) > 0) {
+    // a permit came after try_acquire failed; it goes to the oldest waiter
+    semaphore.dispatch(1);
+  }
+  return true;
+}
+
+void AsyncSemaphore::release(int64_t permits) {
+  int64_t count = count_.fetch_add(permits, std::memory_order_acq_rel);
+  if (count < 0) {
+    dispatch(std::min(permits, -count));
+  }
+}
+
+void AsyncSemaphore::dispatch(int64_t wakeups) {
+  if (wakeups_.fetch_add(wakeups, std::memory_order_acq_rel) != 0) {
+    // the dispatcher will see them
+    return;
+  }
+  while (true) {
+    int64_t todo = wakeups_.load(std::memory_order_acquire);
+    for (int64_t i = 0; i < todo; i++) {
+      pop()->wake();
+    }
+    if (wakeups_.fetch_sub(todo, std::memory_order_acq_rel) == todo) {
+      return;
+    }
+  }
+}
+
+AsyncWaiter* AsyncSemaphore::pop() {
+  if (!head_) {
+    // every counted wakeup has a waiter that pushed itself before counting
+    head_ = reverse(incoming_.exchange(nullptr, std::memory_order_acquire));
+  }
+  AsyncWaiter* waiter = head_;
+  head_ = waiter->next_;
+  return waiter;
+}
+
+bool AsyncLatch::WaitAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+  handle_ = handle;
+  loop_ = EventLoop::current();
+  uintptr_t state = latch_.waiters_.load(std::memory_order_acquire);
+  while (true) {
+    if (state == kDone) {
+      return false;
+    }
+    next_ = reinterpret_cast<AsyncWaiter*>(state);
+    if (latch_.waiters_.compare_exchange_weak(state, reinterpret_cast<uintptr_t>(this),
+                                              std::memory_order_release,
+                                              std::memory_order_acquire)) {
+      return true;
+    }
+  }
+}
+
+void AsyncLatch::count_down(int64_t n) {
+  int64_t count = count_.fetch_sub(n, std::memory_order_acq_rel);
+  if (count <= 0 || count > n) {
+    return;
+  }
+  uintptr_t state = waiters_.exchange(kDone, std::memory_order_acq_rel);
+  AsyncWaiter* waiter = reverse(reinterpret_cast<AsyncWaiter*>(state));
+  while (waiter) {
+    // wake() may free the waiter
+    AsyncWaiter* next = waiter->next_;
+    waiter->wake();
+    waiter = next;
+  }
+}
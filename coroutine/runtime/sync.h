@@ -0,0 +1,324 @@
+#ifndef __SYNC_H
+#define __SYNC_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include "event_loop.h"
+#include "task.h"
+
+// Synchronization for coroutines running on an EventLoop: waiting suspends
+// the coroutine, never the worker thread. Nothing here takes a lock. The
+// waiters are the awaiters themselves, linked into intrusive lists inside
+// the coroutine frames, so waiting does not allocate. A woken coroutine is
+// posted back to the loop it waited on.
+
+// one waiting coroutine, an element of an intrusive list
+struct AsyncWaiter {
+  void wake() {
+    loop_->post_task(handle_);
+  }
+
+  AsyncWaiter* next_ = nullptr;
+  std::coroutine_handle<> handle_;
+  EventLoop* loop_ = nullptr;
+};
+
+class AsyncMutex;
+
+// unlocks on destruction, see AsyncMutex::scoped_lock()
+class AsyncLockGuard {
+public:
+  explicit AsyncLockGuard(AsyncMutex& mutex): mutex_(&mutex) {}
+  AsyncLockGuard(AsyncLockGuard&& other) noexcept: mutex_(std::exchange(other.mutex_, nullptr)) {}
+  AsyncLockGuard(const AsyncLockGuard&) = delete;
+  AsyncLockGuard& operator=(const AsyncLockGuard&) = delete;
+  ~AsyncLockGuard();
+
+private:
+  AsyncMutex* mutex_;
+};
+
+// Mutual exclusion across suspension points.
+//
+//   AsyncLockGuard lock = co_await mutex.scoped_lock();
+//
+// The state is one word: unlocked, locked, or locked with a stack of
+// waiters pushed by CAS. unlock() hands the mutex straight to the longest
+// waiting coroutine (the holder moves new arrivals into a FIFO of its own),
+// so waiters are served in order and nobody can barge in between.
+class AsyncMutex {
+public:
+  AsyncMutex() = default;
+  AsyncMutex(const AsyncMutex&) = delete;
+  AsyncMutex& operator=(const AsyncMutex&) = delete;
+
+  struct LockAwaiter : AsyncWaiter {
+    bool await_ready() noexcept {
+      return mutex_.try_lock();
+    }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept;
+    void await_resume() const noexcept {}
+    AsyncMutex& mutex_;
+  };
+  struct ScopedLockAwaiter : LockAwaiter {
+    AsyncLockGuard await_resume() const noexcept {
+      return AsyncLockGuard(mutex_);
+    }
+  };
+
+  bool try_lock() noexcept {
+    uintptr_t expected = kUnlocked;
+    return state_.compare_exchange_strong(expected, kLocked, std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+  LockAwaiter lock() noexcept {
+    return LockAwaiter{{}, *this};
+  }
+  ScopedLockAwaiter scoped_lock() noexcept {
+    return ScopedLockAwaiter{{{}, *this}};
+  }
+  void unlock();
+
+private:
+  static constexpr uintptr_t kUnlocked = 1;
+  static constexpr uintptr_t kLocked = 0;
+
+  // kUnlocked, kLocked, or the newest waiter of a locked mutex
+  std::atomic<uintptr_t> state_{kUnlocked};
+  // the holder's FIFO of waiters taken off state_
+  AsyncWaiter* waiters_ = nullptr;
+};
+
+inline AsyncLockGuard::~AsyncLockGuard() {
+  if (mutex_) {
+    mutex_->unlock();
+  }
+}
+
+// Counting semaphore.
+//
+// count_ is the number of permits minus the waiters registered for one, so
+// acquire and release are one atomic operation each when nobody has to
+// wait. A waiter pushes itself onto a stack and only then takes its count,
+// so whoever sees a waiter in the count also finds it on the stack. When a
+// permit meets a waiter, a wakeup is counted; the first one to count a
+// wakeup becomes the dispatcher and wakes waiters in arrival order until no
+// wakeups are left, the others just leave theirs behind.
+class AsyncSemaphore {
+public:
+  explicit AsyncSemaphore(int64_t permits): count_(permits) {}
+  AsyncSemaphore(const AsyncSemaphore&) = delete;
+  AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+  struct AcquireAwaiter : AsyncWaiter {
+    bool await_ready() noexcept {
+      return semaphore_.try_acquire();
+    }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept;
+    void await_resume() const noexcept {}
+    AsyncSemaphore& semaphore_;
+  };
+
+  bool try_acquire() noexcept {
+    int64_t count = count_.load(std::memory_order_relaxed);
+    while (count > 0) {
+      if (count_.compare_exchange_weak(count, count - 1, std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  AcquireAwaiter acquire() noexcept {
+    return AcquireAwaiter{{}, *this};
+  }
+  void release(int64_t permits = 1);
+  // permits left, negative while coroutines wait
+  int64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+private:
+  void dispatch(int64_t wakeups);
+  AsyncWaiter* pop();
+
+  std::atomic<int64_t> count_;
+  // waiters, newest first
+  std::atomic<AsyncWaiter*> incoming_{nullptr};
+  std::atomic<int64_t> wakeups_{0};
+  // the dispatcher's FIFO of waiters taken off incoming_
+  AsyncWaiter* head_ = nullptr;
+};
+
+// Single-use countdown: wait() suspends until count_down() has been called
+// count times.
+class AsyncLatch {
+public:
+  explicit AsyncLatch(int64_t count): count_(count) {
+    if (count <= 0) {
+      waiters_.store(kDone, std::memory_order_relaxed);
+    }
+  }
+  AsyncLatch(const AsyncLatch&) = delete;
+  AsyncLatch& operator=(const AsyncLatch&) = delete;
+
+  struct WaitAwaiter : AsyncWaiter {
+    bool await_ready() const noexcept {
+      return latch_.try_wait();
+    }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept;
+    void await_resume() const noexcept {}
+    AsyncLatch& latch_;
+  };
+
+  void count_down(int64_t n = 1);
+  bool try_wait() const noexcept {
+    return waiters_.load(std::memory_order_acquire) == kDone;
+  }
+  WaitAwaiter wait() noexcept {
+    return WaitAwaiter{{}, *this};
+  }
+
+private:
+  static constexpr uintptr_t kDone = 1;
+
+  std::atomic<int64_t> count_;
+  // kDone, or the waiters (newest first) while the count is above zero
+  std::atomic<uintptr_t> waiters_{0};
+};
+
+// Bounded multi-producer multi-consumer queue of T.
+//
+//   co_await channel.send(std::move(item));
+//   while (std::optional<T> item = co_await channel.receive()) { ... }
+//
+// Two AsyncSemaphores count free slots and items, so a full channel
+// suspends senders and an empty one receivers. The items sit in Vyukov's
+// bounded MPMC ring: a slot is claimed by CAS on its position and handed
+// over through a per-slot sequence number. A permit guarantees a slot, but
+// one still being written or read by a descheduled thread is retried
+// briefly. close() lets the receivers drain what is left and then get
+// std::nullopt; call it once every send has completed. Sends after close
+// return false.
+template <typename T>
+class Channel {
+public:
+  explicit Channel(size_t capacity)
+    : capacity_(capacity ? capacity : 1), free_(capacity_), items_(0) {
+    size_t size = 1;
+    while (size < capacity_) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_ = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i < size; i++) {
+      cells_[i].seq_.store(i, std::memory_order_relaxed);
+    }
+  }
+  Channel(const Channel&) = delete;
+  Channel& operator=(const Channel&) = delete;
+
+  // false if the channel was closed
+  Task<bool> send(T value) {
+    co_await free_.acquire();
+    if (closed_.load(std::memory_order_acquire)) {
+      co_return false;
+    }
+    while (!try_push(value)) {
+      std::this_thread::yield();
+    }
+    items_.release();
+    co_return true;
+  }
+
+  // std::nullopt once the channel is closed and empty
+  Task<std::optional<T>> receive() {
+    co_await items_.acquire();
+    std::optional<T> item;
+    while (!try_pop(item)) {
+      if (closed_.load(std::memory_order_acquire)) {
+        co_return std::nullopt;
+      }
+      std::this_thread::yield();
+    }
+    free_.release();
+    co_return item;
+  }
+
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    // enough permits to let every present and future waiter through
+    items_.release(kClosed);
+    free_.release(kClosed);
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+private:
+  static constexpr int64_t kClosed = int64_t(1) << 40;
+
+  struct Cell {
+    std::atomic<size_t> seq_;
+    std::optional<T> value_;
+  };
+
+  bool try_push(T& value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      size_t seq = cell.seq_.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value_.emplace(std::move(value));
+          cell.seq_.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(std::optional<T>& item) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      size_t seq = cell.seq_.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          item.emplace(std::move(*cell.value_));
+          cell.value_.reset();
+          cell.seq_.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  size_t capacity_;
+  AsyncSemaphore free_;
+  AsyncSemaphore items_;
+  std::atomic<bool> closed_{false};
+  size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) std::atomic<size_t> head_{0};
+};
+
+#endif
@@ -0,0 +1,601 @@
+#ifndef __TASK_H
+#define __TASK_H
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "cancellation.h"
+#include "event_loop.h"
+#include "frame_pool.h"
+
+// Lazy coroutine producing a T (or nothing).
+//
+//   Task<int> answer() { co_return 42; }
+//   Task<> caller() { int value = co_await answer(); }
+//
+// A Task does not start until it is awaited. The awaiting coroutine is
+// stored as the continuation and the task's final_suspend transfers control
+// straight back to it (symmetric transfer), so awaiting and finishing are
+// tail calls: an await chain of any depth runs in constant stack. GCC
+// emits those tail calls only in optimized builds, the default here; at -O0
+// every await nests on the stack and deep chains can overflow it. An
+// exception escaping the task is rethrown from the co_await. The Task owns
+// its frame and destroys it with itself; frames come from the FramePool. A
+// task without a stop token of its own takes the awaiting task's, see
+// cancellation.h.
+template <typename T = void>
+class Task;
+
+class TaskPromiseBase : public PooledFrame {
+public:
+  struct FinalAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      std::coroutine_handle<> continuation = handle.promise().continuation_;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept {
+    return {};
+  }
+  FinalAwaiter final_suspend() const noexcept {
+    return {};
+  }
+  void unhandled_exception() noexcept {
+    exception_ = std::current_exception();
+  }
+  void set_continuation(std::coroutine_handle<> continuation) {
+    continuation_ = continuation;
+  }
+  const std::stop_token& stop_token() const noexcept {
+    return stop_token_;
+  }
+  void set_stop_token(std::stop_token token) noexcept {
+    stop_token_ = std::move(token);
+  }
+
+protected:
+  void rethrow_if_failed() const {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+private:
+  std::coroutine_handle<> continuation_;
+  std::exception_ptr exception_;
+  std::stop_token stop_token_;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object() noexcept;
+  template <typename U>
+  void return_value(U&& value) {
+    value_.emplace(std::forward<U>(value));
+  }
+  T result() {
+    rethrow_if_failed();
+    return std::move(*value_);
+  }
+
+private:
+  std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object() noexcept;
+  void return_void() const noexcept {}
+  void result() const {
+    rethrow_if_failed();
+  }
+};
+
+template <typename T>
+class Task {
+public:
+  using promise_type = TaskPromise<T>;
+  using value_type = T;
+
+  Task() = default;
+  explicit Task(std::coroutine_handle<promise_type> handle): handle_(handle) {}
+  Task(Task&& other) noexcept: handle_(std::exchange(other.handle_, nullptr)) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool valid() const {
+    return bool(handle_);
+  }
+  bool done() const {
+    return handle_ && handle_.done();
+  }
+  // before the task starts; otherwise it inherits the awaiting task's token
+  void set_stop_token(std::stop_token token) {
+    handle_.promise().set_stop_token(std::move(token));
+  }
+  bool has_stop_token() const {
+    return handle_ && handle_.promise().stop_token().stop_possible();
+  }
+
+  struct Awaiter {
+    bool await_ready() const noexcept {
+      return !handle_ || handle_.done();
+    }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiting) noexcept {
+      promise_type& promise = handle_.promise();
+      if (const std::stop_token* token = stop_token_of(awaiting)) {
+        if (!promise.stop_token().stop_possible()) {
+          promise.set_stop_token(*token);
+        }
+      }
+      promise.set_continuation(awaiting);
+      return handle_;
+    }
+    T await_resume() {
+      return handle_.promise().result();
+    }
+    std::coroutine_handle<promise_type> handle_;
+  };
+  Awaiter operator co_await() const& noexcept {
+    return Awaiter{handle_};
+  }
+  Awaiter operator co_await() const&& noexcept {
+    return Awaiter{handle_};
+  }
+
+private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// result type of one when_all child: void becomes std::monostate
+template <typename T>
+using WhenAllValue = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+// Root coroutine handed to an EventLoop: its final_suspend hands the frame
+// to EventLoop::finish_task(), see EventLoop::add_task().
+class SpawnedTask {
+public:
+  struct promise_type : PooledFrame {
+    SpawnedTask get_return_object() noexcept {
+      return SpawnedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+    struct FinalAwaiter {
+      bool await_ready() const noexcept {
+        return false;
+      }
+      void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept {
+        handle.promise().loop_->finish_task(handle);
+      }
+      void await_resume() const noexcept {}
+    };
+    FinalAwaiter final_suspend() const noexcept {
+      return {};
+    }
+    void return_void() const noexcept {}
+    // nobody is left to rethrow to
+    void unhandled_exception() const noexcept {
+      std::terminate();
+    }
+    EventLoop* loop_ = nullptr;
+  };
+
+  // false if the loop is shutting down; the frame is gone then
+  bool start(EventLoop& loop) {
+    handle_.promise().loop_ = &loop;
+    return loop.add_task(handle_);
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+SpawnedTask spawned(Task<T> task) {
+  co_await task;
+}
+
+// Runs task on loop, detached; the loop keeps run()ning until it is done.
+// A stop request on token cancels the task (and what it awaits). False if
+// the loop is shutting down and the task was dropped.
+template <typename T>
+bool spawn(EventLoop& loop, Task<T> task, std::stop_token token = {}) {
+  if (token.stop_possible()) {
+    task.set_stop_token(std::move(token));
+  }
+  return spawned(std::move(task)).start(loop);
+}
+
+// where a sync_wait()ed task leaves its result; shared with the task, which
+// may outlive the sync_wait() after a shutdown(false)
+template <typename T>
+struct SyncWaitState {
+  std::optional<WhenAllValue<T>> result_;
+  std::exception_ptr error_;
+};
+
+template <typename T>
+SpawnedTask sync_waited(Task<T> task, std::shared_ptr<SyncWaitState<T>> state) {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      state->result_.emplace();
+    } else {
+      state->result_.emplace(co_await task);
+    }
+  } catch (...) {
+    state->error_ = std::current_exception();
+  }
+}
+
+// Runs loop until task and everything else added to it has finished, and
+// returns the task's result. Call from outside the loop's workers. Throws
+// OperationCancelled if a shutdown kept the task from running or from
+// finishing.
+template <typename T>
+T sync_wait(EventLoop& loop, Task<T> task) {
+  auto state = std::make_shared<SyncWaitState<T>>();
+  if (!sync_waited(std::move(task), state).start(loop)) {
+    throw OperationCancelled();
+  }
+  loop.run();
+  if (state->error_) {
+    std::rethrow_exception(state->error_);
+  }
+  if (!state->result_) {
+    throw OperationCancelled();
+  }
+  if constexpr (!std::is_void_v<T>) {
+    return std::move(*state->result_);
+  }
+}
+
+// children of when_all/when_any share the combinator's stop token
+template <typename T>
+void inherit_stop_token(Task<T>& task, const std::stop_token& token) {
+  if (token.stop_possible() && !task.has_stop_token()) {
+    task.set_stop_token(token);
+  }
+}
+
+// Counts down the children of a when_all; the parent counts as one more so
+// that children finishing while it is still starting the others cannot
+// resume it early.
+class WhenAllLatch {
+public:
+  explicit WhenAllLatch(size_t children): count_(children + 1) {}
+
+  // the child that finishes last continues with the parent
+  std::coroutine_handle<> arrive() noexcept {
+    if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      return parent_;
+    }
+    return std::noop_coroutine();
+  }
+
+  struct StartAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+    bool await_suspend(std::coroutine_handle<> parent) {
+      latch_.parent_ = parent;
+      for (auto child : children_) {
+        child.resume();
+      }
+      return latch_.count_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+    void await_resume() const noexcept {}
+    WhenAllLatch& latch_;
+    // a view: awaiters with non-trivial members are destroyed twice by
+    // some GCC versions
+    const std::vector<std::coroutine_handle<>>& children_;
+  };
+  // children must stay alive until the co_await completes
+  StartAwaiter start(const std::vector<std::coroutine_handle<>>& children) {
+    return StartAwaiter{*this, children};
+  }
+
+private:
+  std::atomic<size_t> count_;
+  std::coroutine_handle<> parent_;
+};
+
+// frame of one when_all child; arrives at its latch when finished
+class WhenAllChild {
+public:
+  struct promise_type : PooledFrame {
+    WhenAllChild get_return_object() noexcept {
+      return WhenAllChild(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+    struct FinalAwaiter {
+      bool await_ready() const noexcept {
+        return false;
+      }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        return handle.promise().latch_->arrive();
+      }
+      void await_resume() const noexcept {}
+    };
+    FinalAwaiter final_suspend() const noexcept {
+      return {};
+    }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept {
+      std::terminate();
+    }
+    WhenAllLatch* latch_ = nullptr;
+  };
+
+  explicit WhenAllChild(std::coroutine_handle<promise_type> handle): handle_(handle) {}
+  WhenAllChild(WhenAllChild&& other) noexcept: handle_(std::exchange(other.handle_, nullptr)) {}
+  WhenAllChild(const WhenAllChild&) = delete;
+  ~WhenAllChild() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+  std::coroutine_handle<> handle(WhenAllLatch& latch) {
+    handle_.promise().latch_ = &latch;
+    return handle_;
+  }
+
+private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// awaits task, keeping its result or exception
+template <typename T>
+WhenAllChild when_all_child(Task<T>& task, std::optional<WhenAllValue<T>>& result,
+                            std::exception_ptr& error) {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      result.emplace();
+    } else {
+      result.emplace(co_await task);
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+}
+
+// Awaits every task and returns their results in order. The children start
+// one after another on the awaiting thread and each runs until its first
+// suspension, so tasks that wait (sleeps, sockets) overlap; a child meant
+// to run in parallel on other workers starts with co_await loop.schedule().
+// If any task throws, the first exception (in task order) is rethrown once
+// all have finished.
+template <typename T>
+Task<std::vector<WhenAllValue<T>>> when_all(std::vector<Task<T>> tasks) {
+  std::vector<std::optional<WhenAllValue<T>>> results(tasks.size());
+  std::vector<std::exception_ptr> errors(tasks.size());
+  WhenAllLatch latch(tasks.size());
+  std::vector<WhenAllChild> children;
+  std::vector<std::coroutine_handle<>> handles;
+  children.reserve(tasks.size());
+  std::stop_token token = co_await get_stop_token();
+  for (size_t i = 0; i < tasks.size(); i++) {
+    inherit_stop_token(tasks[i], token);
+    children.push_back(when_all_child(tasks[i], results[i], errors[i]));
+    handles.push_back(children.back().handle(latch));
+  }
+  co_await latch.start(handles);
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  std::vector<WhenAllValue<T>> values;
+  values.reserve(results.size());
+  for (auto& result : results) {
+    values.push_back(std::move(*result));
+  }
+  co_return values;
+}
+
+template <typename... Ts, size_t... I>
+Task<std::tuple<WhenAllValue<Ts>...>> when_all_tuple(std::index_sequence<I...>,
+                                                     Task<Ts>... tasks) {
+  std::tuple<std::optional<WhenAllValue<Ts>>...> results;
+  std::array<std::exception_ptr, sizeof...(Ts)> errors;
+  WhenAllLatch latch(sizeof...(Ts));
+  std::stop_token token = co_await get_stop_token();
+  (inherit_stop_token(tasks, token), ...);
+  std::array<WhenAllChild, sizeof...(Ts)> children{
+      when_all_child(tasks, std::get<I>(results), errors[I])...};
+  std::vector<std::coroutine_handle<>> handles{children[I].handle(latch)...};
+  co_await latch.start(handles);
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  co_return std::tuple<WhenAllValue<Ts>...>(std::move(*std::get<I>(results))...);
+}
+
+// the same for tasks of different types; void results are std::monostate
+template <typename... Ts>
+Task<std::tuple<WhenAllValue<Ts>...>> when_all(Task<Ts>... tasks) {
+  return when_all_tuple(std::index_sequence_for<Ts...>(), std::move(tasks)...);
+}
+
+// Shared by a when_any and its children. The children own it together, so
+// the losers can run on after the parent has continued.
+template <typename T>
+struct WhenAnyState {
+  // the children's stop token, stopped when the winner is known
+  std::stop_source stop_;
+  std::atomic<bool> decided_{false};
+  // the winner and the parent's start both count it down, see WhenAllLatch
+  std::atomic<int> gate_{2};
+  std::coroutine_handle<> parent_;
+  size_t index_ = 0;
+  std::optional<WhenAllValue<T>> value_;
+  std::exception_ptr error_;
+};
+
+// Frame of one when_any child. The child frees its own frame when it is
+// done, passing control to the parent if it won and the parent waits.
+class WhenAnyChild {
+public:
+  struct promise_type : PooledFrame {
+    WhenAnyChild get_return_object() noexcept {
+      return WhenAnyChild{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+    std::suspend_always final_suspend() const noexcept {
+      return {};
+    }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept {
+      std::terminate();
+    }
+  };
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// destroys the awaiting frame and continues with next_
+struct WhenAnyFinish {
+  bool await_ready() const noexcept {
+    return false;
+  }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept {
+    // this awaiter lives in the frame: copy first
+    std::coroutine_handle<> next = next_;
+    handle.destroy();
+    return next;
+  }
+  void await_resume() const noexcept {}
+  std::coroutine_handle<> next_;
+};
+
+template <typename T>
+WhenAnyChild when_any_child(std::shared_ptr<WhenAnyState<T>> state, Task<T> task, size_t index) {
+  std::optional<WhenAllValue<T>> value;
+  std::exception_ptr error;
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      value.emplace();
+    } else {
+      value.emplace(co_await task);
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  std::coroutine_handle<> next = std::noop_coroutine();
+  if (!state->decided_.exchange(true, std::memory_order_acq_rel)) {
+    state->index_ = index;
+    state->value_ = std::move(value);
+    state->error_ = error;
+    state->stop_.request_stop();
+    if (state->gate_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      next = state->parent_;
+    }
+  }
+  co_await WhenAnyFinish{next};
+}
+
+template <typename T>
+struct WhenAnyStart {
+  bool await_ready() const noexcept {
+    return false;
+  }
+  bool await_suspend(std::coroutine_handle<> parent) {
+    state_.parent_ = parent;
+    for (auto child : children_) {
+      child.resume();
+    }
+    return state_.gate_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+  }
+  void await_resume() const noexcept {}
+  WhenAnyState<T>& state_;
+  // see WhenAllLatch::StartAwaiter
+  const std::vector<std::coroutine_handle<>>& children_;
+};
+
+template <typename T>
+struct WhenAnyResult {
+  size_t index;
+  WhenAllValue<T> value;
+};
+
+// Returns the index and result of the first task to finish (or rethrows its
+// exception). Then the others are asked to stop through their stop token,
+// which is also stopped with the awaiting task's; they finish in the
+// background and their results are dropped. Children start as in when_all.
+// Without tasks nothing could ever finish, so that throws
+// std::invalid_argument instead of waiting forever.
+template <typename T>
+Task<WhenAnyResult<T>> when_any(std::vector<Task<T>> tasks) {
+  if (tasks.empty()) {
+    throw std::invalid_argument("when_any of no tasks");
+  }
+  auto state = std::make_shared<WhenAnyState<T>>();
+  std::stop_token parent = co_await get_stop_token();
+  auto forward = [&state]() {
+    state->stop_.request_stop();
+  };
+  std::stop_callback<decltype(forward)> forward_stop(parent, forward);
+  std::vector<std::coroutine_handle<>> children;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    inherit_stop_token(tasks[i], state->stop_.get_token());
+    children.push_back(when_any_child(state, std::move(tasks[i]), i).handle_);
+  }
+  co_await WhenAnyStart<T>{*state, children};
+  if (state->error_) {
+    std::rethrow_exception(state->error_);
+  }
+  co_return WhenAnyResult<T>{state->index_, std::move(*state->value_)};
+}
+
+#endif
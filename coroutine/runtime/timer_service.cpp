@@ -0,0 +1,133 @@
+#include "timer_service.h"
+
+TimerService::~TimerService() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+    for (TimerNode* node : heap_) {
+      node->heap_index_ = TimerNode::kNotQueued;
+    }
+    heap_.clear();
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void TimerService::add(TimerNode& node) {
+  bool earliest;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (node.expired_) {
+      node.fire_(&node);
+      return;
+    }
+    if (!thread_.joinable()) {
+      thread_ = std::thread([this]() {
+        run();
+      });
+    }
+    node.seq_ = seq_++;
+    heap_.push_back(&node);
+    node.heap_index_ = heap_.size() - 1;
+    sift_up(node.heap_index_);
+    earliest = node.heap_index_ == 0;
+  }
+  // only a new earliest deadline changes how long the thread sleeps
+  if (earliest) {
+    cv_.notify_one();
+  }
+}
+
+bool TimerService::cancel(TimerNode& node) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (node.heap_index_ == TimerNode::kNotQueued) {
+    return false;
+  }
+  remove_at(node.heap_index_);
+  return true;
+}
+
+void TimerService::expire(TimerNode& node) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (node.heap_index_ == TimerNode::kNotQueued) {
+    node.expired_ = true;
+    return;
+  }
+  remove_at(node.heap_index_);
+  node.fire_(&node);
+}
+
+size_t TimerService::size() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return heap_.size();
+}
+
+void TimerService::run() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!stop_) {
+    if (heap_.empty()) {
+      cv_.wait(lock);
+      continue;
+    }
+    TimerNode* node = heap_.front();
+    if (node->deadline_ > TimerNode::Clock::now()) {
+      // a copy: wait_until reads the deadline while unlocked, when the node
+      // may already be cancelled and freed
+      TimerNode::Clock::time_point deadline = node->deadline_;
+      cv_.wait_until(lock, deadline);
+      continue;
+    }
+    remove_at(0);
+    // under the lock: once cancel() has returned false, fire_ is done with
+    // the node and its owner may free it
+    node->fire_(node);
+  }
+}
+
+void TimerService::sift_up(size_t index) {
+  TimerNode* node = heap_[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (!earlier(node, heap_[parent])) {
+      break;
+    }
+    place(index, heap_[parent]);
+    index = parent;
+  }
+  place(index, node);
+}
+
+void TimerService::sift_down(size_t index) {
+  TimerNode* node = heap_[index];
+  size_t size = heap_.size();
+  while (true) {
+    size_t child = 2 * index + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && earlier(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!earlier(heap_[child], node)) {
+      break;
+    }
+    place(index, heap_[child]);
+    index = child;
+  }
+  place(index, node);
+}
+
+void TimerService::remove_at(size_t index) {
+  heap_[index]->heap_index_ = TimerNode::kNotQueued;
+  TimerNode* last = heap_.back();
+  heap_.pop_back();
+  if (index == heap_.size()) {
+    return;
+  }
+  place(index, last);
+  // the moved node may belong above or below its new place
+  sift_up(index);
+  sift_down(last->heap_index_);
+}
@@ -0,0 +1,102 @@
+#ifndef __TIMER_SERVICE_H
+#define __TIMER_SERVICE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// One pending timer. The node lives in whoever armed it, usually an awaiter
+// in a coroutine frame, and the heap only points at it, so arming a timer
+// does not allocate. fire_ runs on the timer thread with the service lock
+// held: it must be short and must not call back into the service, nor
+// request a stop (stop callbacks may expire timers).
+struct TimerNode {
+  using Clock = std::chrono::steady_clock;
+  static constexpr size_t kNotQueued = SIZE_MAX;
+
+  Clock::time_point deadline_;
+  void (*fire_)(TimerNode* node) = nullptr;
+  size_t heap_index_ = kNotQueued;
+  // keeps timers with equal deadlines in arming order
+  uint64_t seq_ = 0;
+  // expire() came before add()
+  bool expired_ = false;
+};
+
+// A binary min-heap of TimerNodes driven by one thread, shared by every
+// coroutine of an EventLoop. The thread is started by the first timer and
+// sleeps on a condition variable until the earliest deadline, so any number
+// of sleeping coroutines costs one thread and a heap slot each.
+class TimerService {
+public:
+  TimerService() = default;
+  TimerService(const TimerService&) = delete;
+  TimerService& operator=(const TimerService&) = delete;
+  // timers still pending never fire
+  ~TimerService();
+
+  void add(TimerNode& node);
+  // true if the timer was removed before firing; false means it already
+  // fired (and fire_ has returned) or was never added
+  bool cancel(TimerNode& node);
+  // fires a pending timer now, on the calling thread; a node not added yet
+  // fires as soon as it is added
+  void expire(TimerNode& node);
+  size_t size();
+
+private:
+  void run();
+  bool earlier(const TimerNode* a, const TimerNode* b) const {
+    return a->deadline_ < b->deadline_ ||
+           (a->deadline_ == b->deadline_ && a->seq_ < b->seq_);
+  }
+  void place(size_t index, TimerNode* node) {
+    heap_[index] = node;
+    node->heap_index_ = index;
+  }
+  void sift_up(size_t index);
+  void sift_down(size_t index);
+  void remove_at(size_t index);
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<TimerNode*> heap_;
+  uint64_t seq_ = 0;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+// Calls fn on the timer thread at the deadline unless destroyed or
+// cancelled first; the destructor cancels, so fn never runs after it.
+// fn follows the rules of TimerNode::fire_.
+template <typename F>
+class Timeout : private TimerNode {
+public:
+  Timeout(TimerService& service, Clock::time_point deadline, F fn)
+    : service_(service), fn_(std::move(fn)) {
+    deadline_ = deadline;
+    fire_ = [](TimerNode* node) {
+      static_cast<Timeout*>(node)->fn_();
+    };
+    service_.add(*this);
+  }
+  Timeout(const Timeout&) = delete;
+  Timeout& operator=(const Timeout&) = delete;
+  ~Timeout() {
+    cancel();
+  }
+  // true if fn will not run any more and had not run
+  bool cancel() {
+    return service_.cancel(*this);
+  }
+
+private:
+  TimerService& service_;
+  F fn_;
+};
+
+#endif
@@ -0,0 +1,940 @@
+#include "lexer.h"
+#include "parser.h"
+#include "ndjson.h"
+#include "query.h"
+#include "writer.h"
+#include "cbor.h"
+#include "ondemand.h"
+#include "bind.h"
+#include "document.h"
+#include "sax.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <malloc.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    std::cerr << "check failed: " << what << std::endl;
+    exit(1);
+  }
+}
+
+// every heap allocation made by the benchmark, see benchParseCopies
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  if (void* ptr = malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+static double seconds(std::chrono::steady_clock::time_point t1,
+                      std::chrono::steady_clock::time_point t2) {
+  return std::chrono::duration<double>(t2 - t1).count();
+}
+
+static void report(const char* name, size_t bytes, double sec) {
+  std::cout << name << ": " << bytes / sec / (1 << 20) << " MB/s" << std::endl;
+}
+
+// GeoJSON-like coordinate arrays: [[lon, lat], ...] with six decimals,
+// plus some integer ids and exponents so every number path is hit.
+static std::string makeCoordinates(size_t num) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> lon(-180, 180);
+  std::uniform_real_distribution<double> lat(-90, 90);
+  std::string doc = "[\n";
+  char buf[96];
+  for (size_t i = 0; i < num; i++) {
+    int len = snprintf(buf, sizeof(buf), "  [%.6f, %.6f, %zu, %.3e]%s\n",
+                       lon(gen), lat(gen), i, lat(gen), i + 1 == num ? "" : ",");
+    doc.append(buf, len);
+  }
+  doc += "]\n";
+  return doc;
+}
+
+static void checkNumbers() {
+  const char* cases[] = {"0", "-0", "12345", "-9223372036854775808",
+                         "9223372036854775807", "18446744073709551615",
+                         "18446744073709551616", "3.14159", "-2.5e-3",
+                         "1E22", "1e23", "0.1", "123456789012345678901234567890",
+                         "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308"};
+  for (const char* text : cases) {
+    Lexer lexer(text, strlen(text));
+    Token tok = lexer.getCurrentToken();
+    if (tok == tok_int) {
+      check(lexer.getInt() == strtoll(text, nullptr, 10), "int round trip");
+    } else if (tok == tok_uint) {
+      check(lexer.getUint() == strtoull(text, nullptr, 10), "uint round trip");
+    } else {
+      check(tok == tok_number, "number token");
+      check(lexer.getNumber() == strtod(text, nullptr), "number round trip");
+    }
+  }
+  std::mt19937_64 gen(7);
+  for (int i = 0; i < 100000; i++) {
+    uint64_t bits = gen();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value)) {
+      continue;
+    }
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%.17g", value);
+    Lexer lexer(buf, len);
+    double parsed = lexer.getCurrentToken() == tok_int ? double(lexer.getInt()) : lexer.getNumber();
+    check(parsed == value, "random double round trip");
+  }
+  std::cout << "number round trip: ok" << std::endl;
+}
+
+static void benchNumbers() {
+  std::string doc = makeCoordinates(200000);
+  int loops = 5;
+
+  auto t1 = std::chrono::steady_clock::now();
+  size_t tokens = 0;
+  for (int loop = 0; loop < loops; loop++) {
+    Lexer lexer(doc.data(), doc.size());
+    while (lexer.getCurrentToken() != tok_eof) {
+      tokens++;
+      lexer.consumerCurrnetToken();
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  report("lex coordinates", doc.size() * loops, seconds(t1, t2));
+
+  // the previous scheme: gather the characters, then std::stod
+  t1 = std::chrono::steady_clock::now();
+  double sum = 0;
+  for (int loop = 0; loop < loops; loop++) {
+    std::string str;
+    for (size_t i = 0; i < doc.size(); i++) {
+      char c = doc[i];
+      if (isDigit(c) || c == '.' || c == '-' || c == 'e' || c == '+') {
+        str += c;
+      } else if (!str.empty()) {
+        sum += std::stod(str);
+        str.clear();
+      }
+    }
+  }
+  t2 = std::chrono::steady_clock::now();
+  report("baseline accumulate + stod", doc.size() * loops, seconds(t1, t2));
+  std::cout << "tokens: " << tokens << " checksum: " << sum << std::endl;
+}
+
+// an array of flat records: strings, ints, doubles, bools and a nested array
+static std::string makeRecords(size_t num) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> score(0, 100);
+  std::string doc = "[\n";
+  char buf[256];
+  for (size_t i = 0; i < num; i++) {
+    int len = snprintf(buf, sizeof(buf),
+                       "  {\"id\": %zu, \"name\": \"user name number %zu\", \"score\": %.4f, "
+                       "\"active\": %s, \"tags\": [\"alpha\", \"beta\", \"gamma\"], \"parent\": null}%s\n",
+                       i, i, score(gen), i % 2 ? "true" : "false", i + 1 == num ? "" : ",");
+    doc.append(buf, len);
+  }
+  doc += "]\n";
+  return doc;
+}
+
+static Json parseText(const std::string& doc) {
+  Parser parser(doc.data(), doc.size());
+  return parser.parser_all();
+}
+
+class CountingSink : public JsonSink {
+public:
+  void write(const char* data, size_t size) override {
+    bytes += size;
+  }
+  size_t bytes = 0;
+};
+
+static void checkWriter() {
+  Json str;
+  str.setString("plain text that is longer than 16 \"quoted\" \\ \n\t\x01 end");
+  check(str.dump() == "\"plain text that is longer than 16 \\\"quoted\\\" \\\\ \\n\\t\\u0001 end\"",
+        "string escapes");
+
+  std::string doc = makeRecords(100);
+  Json json = parseText(doc);
+  std::string compact = json.dump();
+  check(parseText(compact).dump() == compact, "compact dump");
+  std::string pretty = json.dump(true);
+  check(parseText(pretty).dump() == compact, "pretty dump");
+  std::cout << "writer round trip: ok" << std::endl;
+}
+
+static void checkValues() {
+  // a moved-from inline string is a plain null, ready to hold anything
+  Json inline_str;
+  inline_str.setString(std::string_view("short"));
+  Json moved(std::move(inline_str));
+  Json assigned;
+  assigned = std::move(moved);
+  check(assigned.getString() == "short", "moved inline string");
+  for (Json* from : {&inline_str, &moved}) {
+    check(from->value.type == Json::Type::null_type && from->value.small_size == 0,
+          "moved-from value is null");
+    Json::Data data;
+    data.str = new JsonString(std::string_view("a heap string, longer than the inline limit"));
+    from->setType(Json::Type::str_type);
+    from->setData(data);
+    check(from->getString() == "a heap string, longer than the inline limit",
+          "moved-from value reused");
+  }
+  // only numbers have a numeric value
+  check(parseText("3.5").getNumber() == 3.5 && parseText("-7").getNumber() == -7.0, "numbers");
+  for (const char* text : {"null", "true", "\"text\"", "\"a string longer than inline\"", "[1]",
+                           "{\"a\": 1}"}) {
+    check(parseText(text).getNumber() == 0.0 && parseText(text).getInt() == 0, "non-numbers");
+  }
+  std::cout << "values: ok" << std::endl;
+}
+
+static void benchWriter() {
+  Json json = parseText(makeRecords(100000));
+  int loops = 10;
+  std::string out;
+  size_t bytes = 0;
+
+  auto t1 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    out.clear();
+    json.dump(out);
+    bytes += out.size();
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  report("dump compact", bytes, seconds(t1, t2));
+
+  bytes = 0;
+  t1 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    out.clear();
+    json.dump(out, true);
+    bytes += out.size();
+  }
+  t2 = std::chrono::steady_clock::now();
+  report("dump pretty", bytes, seconds(t1, t2));
+
+  CountingSink sink;
+  t1 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    JsonWriter writer(sink);
+    writer.write(json);
+  }
+  t2 = std::chrono::steady_clock::now();
+  report("dump compact to sink", sink.bytes, seconds(t1, t2));
+}
+
+static void benchObjectLookup(size_t width) {
+  std::string doc = "{";
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < width; i++) {
+    keys.push_back("field_name_" + std::to_string(i * 7919));
+    doc += (i ? ", \"" : "\"") + keys.back() + "\": " + std::to_string(i);
+  }
+  doc += "}";
+  Json json = parseText(doc);
+  const JsonObject& object = *json.value.data.map;
+  // the previous layout, for comparison
+  std::map<std::string, const Json*> tree;
+  for (const auto& elem : object) {
+    tree.emplace(elem.first, &elem.second);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+  size_t lookups = std::max<size_t>(1000000, width);
+
+  int64_t sum = 0;
+  auto t1 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lookups; i++) {
+    sum += object.find(keys[i % width])->value.data.integer;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lookups; i++) {
+    sum -= tree.find(keys[i % width])->second->value.data.integer;
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  std::cout << "lookup width " << width << ": JsonObject "
+            << seconds(t1, t2) * 1e9 / lookups << " ns, std::map "
+            << seconds(t2, t3) * 1e9 / lookups << " ns, checksum " << sum << std::endl;
+}
+
+static size_t countNodes(const Json& json) {
+  size_t num = 1;
+  if (json.value.type == Json::Type::array_type && json.value.data.array) {
+    for (const Json& elem : *json.value.data.array) {
+      num += countNodes(elem);
+    }
+  } else if (json.value.type == Json::Type::map_type && json.value.data.map) {
+    for (const auto& elem : *json.value.data.map) {
+      num += countNodes(elem.second);
+    }
+  }
+  return num;
+}
+
+// parsing must not copy Json nodes, and copying a parsed tree is O(1)
+static void benchParseCopies() {
+  std::string doc = makeRecords(100000);
+  uint64_t allocs = allocations;
+  uint64_t copies = Json::copies();
+  auto t1 = std::chrono::steady_clock::now();
+  Json json = parseText(doc);
+  auto t2 = std::chrono::steady_clock::now();
+  size_t nodes = countNodes(json);
+  std::cout << "parse records: " << doc.size() / seconds(t1, t2) / (1 << 20) << " MB/s, "
+            << nodes << " nodes, "
+            << double(allocations - allocs) / nodes << " allocations/node, "
+            << double(Json::copies() - copies) / nodes << " copies/node" << std::endl;
+
+  allocs = allocations;
+  t1 = std::chrono::steady_clock::now();
+  Json copy = json;
+  t2 = std::chrono::steady_clock::now();
+  std::cout << "copy parsed tree: " << seconds(t1, t2) * 1e9 << " ns, "
+            << allocations - allocs << " allocations" << std::endl;
+
+  // writing through a shared copy clones only the path that is written
+  allocs = allocations;
+  copy.mutableArray()[0].mutableObject()["id"] = Json();
+  check(json.value.data.array->front().value.data.map->find("id")->value.type == Json::Type::int_type,
+        "shared copy unchanged");
+  std::cout << "unshare one record: " << allocations - allocs << " allocations, "
+            << Json::clones() << " clones" << std::endl;
+}
+
+static size_t residentBytes() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  size_t pages = 0;
+  size_t resident = 0;
+  if (statm) {
+    if (fscanf(statm, "%zu %zu", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// memory held by a parsed array of records; runs first so the heap has not
+// been grown by other benchmarks yet
+static void benchMemory() {
+  std::string doc = makeRecords(200000);
+  malloc_trim(0);
+  size_t heap = mallinfo2().uordblks;
+  size_t rss = residentBytes();
+  uint64_t allocs = allocations;
+  auto t1 = std::chrono::steady_clock::now();
+  Json json = parseText(doc);
+  auto t2 = std::chrono::steady_clock::now();
+  size_t nodes = countNodes(json);
+  std::cout << "records memory: " << doc.size() / seconds(t1, t2) / (1 << 20) << " MB/s, "
+            << double(allocations - allocs) / nodes << " allocations/node, heap "
+            << (mallinfo2().uordblks - heap) / double(1 << 20) << " MB, rss +"
+            << (residentBytes() - rss) / double(1 << 20) << " MB for "
+            << doc.size() / double(1 << 20) << " MB of text" << std::endl;
+}
+
+// test.json shaped: a squad object holding members with nested power lists
+static std::string makeSquads(size_t num) {
+  std::string doc = "[\n";
+  for (size_t i = 0; i < num; i++) {
+    doc += "{\"squadName\": \"Super hero squad " + std::to_string(i) + "\", "
+           "\"homeTown\": \"Metro City\", \"formed\": " + std::to_string(2016 - i % 50) + ", "
+           "\"secretBase\": \"Super tower\", \"active\": true, \"rating\": " +
+           std::to_string(i % 100) + ".25, \"members\": [";
+    for (size_t j = 0; j < 3; j++) {
+      doc += std::string(j ? ", " : "") + "{\"name\": \"Member " + std::to_string(j) + "\", "
+             "\"age\": " + std::to_string(20 + (i + j) % 60) + ", \"secretIdentity\": null, "
+             "\"powers\": [\"Radiation resistance\", \"Turning tiny\", \"Radiation blast\"]}";
+    }
+    doc += std::string("]}") + (i + 1 == num ? "" : ",") + "\n";
+  }
+  doc += "]\n";
+  return doc;
+}
+
+static void checkCbor() {
+  const char* cases[] = {"0", "-1", "23", "24", "-25", "65536", "-9223372036854775808",
+                         "18446744073709551615", "1.5", "0.1", "-1e300", "\"\"",
+                         "\"text\"", "[]", "{}", "[null, true, false]", "{\"a\": {\"b\": [1, 2]}}"};
+  for (const char* text : cases) {
+    Json json = parseText(text);
+    std::string encoded;
+    cborEncode(json, encoded);
+    Json decoded;
+    bool ok = cborDecode(encoded.data(), encoded.size(), decoded);
+    check(ok && decoded.dump() == json.dump(), "cbor scalar round trip");
+  }
+  std::string doc = makeSquads(100);
+  Json json = parseText(doc);
+  std::string encoded;
+  cborEncode(json, encoded);
+  Json decoded;
+  bool ok = cborDecode(encoded.data(), encoded.size(), decoded);
+  check(ok && decoded.dump() == json.dump(), "cbor document round trip");
+  // whatever nesting the parser accepts, the decoder accepts too
+  for (int64_t depth : {int64_t(600), int64_t(1000), Parser::kMaxDepth}) {
+    std::string nested = std::string(depth, '[') + std::string(depth, ']');
+    Json deep = parseText(nested);
+    std::string deep_encoded;
+    cborEncode(deep, deep_encoded);
+    check(cborDecode(deep_encoded.data(), deep_encoded.size(), decoded) && decoded.dump() == nested,
+          "cbor deep round trip");
+  }
+  // truncated input must fail cleanly
+  for (size_t len = 0; len < encoded.size(); len += 97) {
+    check(!cborDecode(encoded.data(), len, decoded), "truncated cbor rejected");
+  }
+  CborView view(encoded.data(), encoded.size());
+  check(view.size() == 100, "cbor view size");
+  check(view[size_t(42)]["members"][size_t(1)]["age"].getInt() == 20 + 43 % 60, "cbor view path");
+  check(view[size_t(7)]["homeTown"].getString() == "Metro City", "cbor view string");
+  check(!view[size_t(7)]["missing"].valid(), "cbor view missing key");
+  std::cout << "cbor round trip: ok" << std::endl;
+}
+
+static void benchCbor() {
+  std::string doc = makeSquads(20000);
+  Json json = parseText(doc);
+  std::string encoded;
+  cborEncode(json, encoded);
+  std::string compact = json.dump();
+  std::cout << "cbor size: " << encoded.size() << " bytes, json " << doc.size()
+            << " bytes (" << compact.size() << " compact)" << std::endl;
+  int loops = 5;
+
+  auto t1 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    Json parsed = parseText(compact);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    Json decoded;
+    cborDecode(encoded.data(), encoded.size(), decoded);
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    std::string out;
+    cborEncode(json, out);
+  }
+  auto t4 = std::chrono::steady_clock::now();
+  std::cout << "parse json text: " << seconds(t1, t2) / loops * 1e3 << " ms, cbor decode: "
+            << seconds(t2, t3) / loops * 1e3 << " ms, cbor encode: "
+            << seconds(t3, t4) / loops * 1e3 << " ms" << std::endl;
+
+  // one field out of the last record, without decoding anything else
+  t1 = std::chrono::steady_clock::now();
+  int64_t age = 0;
+  for (int loop = 0; loop < loops; loop++) {
+    CborView view(encoded.data(), encoded.size());
+    age += view[size_t(19999)]["members"][size_t(2)]["age"].getInt();
+  }
+  t2 = std::chrono::steady_clock::now();
+  std::cout << "cbor view lookup: " << seconds(t1, t2) / loops * 1e3 << " ms (" << age << ")" << std::endl;
+}
+
+static void checkOnDemand() {
+  std::string doc = makeSquads(10);
+  OnDemandDocument lazy(doc.data(), doc.size());
+  Json json = parseText(doc);
+  check(lazy.root().size() == 10, "ondemand size");
+  check(lazy[size_t(3)]["members"][size_t(2)]["age"].getInt() == 20 + 5 % 60, "ondemand path");
+  check(lazy[size_t(3)]["rating"].getNumber() == 3.25, "ondemand number");
+  check(lazy[size_t(3)]["homeTown"].getString() == "Metro City", "ondemand string");
+  check(lazy[size_t(3)]["active"].getBool(), "ondemand bool");
+  check(lazy[size_t(3)]["secretBase"].type() == Json::Type::str_type, "ondemand type");
+  check(!lazy[size_t(3)]["missing"].valid(), "ondemand missing key");
+  check(!lazy[size_t(10)].valid(), "ondemand out of range");
+  check(lazy[size_t(9)].toJson().dump() == json.value.data.array->back().dump(), "ondemand toJson");
+  size_t fields = 0;
+  for (auto iter = lazy[size_t(0)].begin(); iter != lazy[size_t(0)].end(); ++iter) {
+    check(json.value.data.array->front().value.data.map->find(iter.key()), "ondemand key exists");
+    fields++;
+  }
+  check(fields == 7, "ondemand field count");
+  std::cout << "ondemand: ok" << std::endl;
+}
+
+// time to first byte of a field grows with its offset, not the document size
+static void benchOnDemand() {
+  std::string doc = makeRecords(200000);
+  OnDemandDocument lazy(doc.data(), doc.size());
+  for (size_t index : {size_t(0), size_t(1000), size_t(100000), size_t(199999)}) {
+    int loops = index < 1000 ? 10000 : 10;
+    int64_t sum = 0;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+      sum += lazy[index]["id"].getInt();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    std::cout << "ondemand record " << index << ": " << seconds(t1, t2) / loops * 1e6
+              << " us (" << sum / loops << ")" << std::endl;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  Json json = parseText(doc);
+  auto t2 = std::chrono::steady_clock::now();
+  std::cout << "full parse: " << seconds(t1, t2) * 1e6 << " us" << std::endl;
+}
+
+struct Member {
+  std::string name;
+  int age = 0;
+  std::optional<std::string> secretIdentity;
+  std::vector<std::string> powers;
+};
+JSON_FIELDS(Member, name, age, secretIdentity, powers);
+
+struct Squad {
+  std::string squadName;
+  std::string homeTown;
+  int formed = 0;
+  std::string secretBase;
+  bool active = false;
+  double rating = 0;
+  std::vector<Member> members;
+};
+JSON_FIELDS(Squad, squadName, homeTown, formed, secretBase, active, rating, members);
+
+// what consumers write by hand today: walk the tree and switch on types
+static Squad squadFromJson(const Json& json) {
+  Squad squad;
+  const JsonMap& map = *json.value.data.map;
+  squad.squadName = map.find("squadName")->getString();
+  squad.homeTown = map.find("homeTown")->getString();
+  squad.formed = int(map.find("formed")->getNumber());
+  squad.secretBase = map.find("secretBase")->getString();
+  squad.active = map.find("active")->value.data.flag;
+  squad.rating = map.find("rating")->getNumber();
+  for (const Json& item : *map.find("members")->value.data.array) {
+    const JsonMap& fields = *item.value.data.map;
+    Member& member = squad.members.emplace_back();
+    member.name = fields.find("name")->getString();
+    member.age = int(fields.find("age")->getNumber());
+    const Json* secret = fields.find("secretIdentity");
+    if (secret->value.type == Json::Type::str_type) {
+      member.secretIdentity = secret->getString();
+    }
+    for (const Json& power : *fields.find("powers")->value.data.array) {
+      member.powers.emplace_back(power.getString());
+    }
+  }
+  return squad;
+}
+
+static void checkBind() {
+  std::string doc = makeSquads(50);
+  std::vector<Squad> squads;
+  bool ok = jsonBind(doc, squads);
+  check(ok && squads.size() == 50, "bind squads");
+  Json json = parseText(doc);
+  for (size_t i = 0; i < squads.size(); i++) {
+    Squad expect = squadFromJson((*json.value.data.array)[i]);
+    check(squads[i].squadName == expect.squadName && squads[i].formed == expect.formed,
+          "bind names");
+    check(squads[i].rating == expect.rating && squads[i].active == expect.active, "bind scalars");
+    check(squads[i].members.size() == 3 && squads[i].members[2].age == expect.members[2].age,
+          "bind members");
+    check(!squads[i].members[0].secretIdentity && squads[i].members[1].powers == expect.members[1].powers,
+          "bind optional and vector");
+  }
+  // unknown keys are skipped, mismatches and out of range values fail
+  Member member;
+  check(jsonBind("{\"extra\": {\"a\": [1, {}]}, \"age\": 7}", member) && member.age == 7,
+        "bind skips unknown keys");
+  check(!jsonBind("{\"age\": \"7\"}", member), "bind type mismatch");
+  check(!jsonBind("{\"age\": 4294967296}", member), "bind out of range");
+  check(!jsonBind("{\"age\": 7} 8", member), "bind trailing content");
+  Json any;
+  check(jsonBind("{\"a\": [1, 2.5]}", any) && any.dump() == "{\"a\":[1,2.5]}", "bind into Json");
+  std::cout << "bind: ok" << std::endl;
+}
+
+static void benchBind() {
+  std::string doc = makeSquads(20000);
+  int loops = 5;
+  size_t members = 0;
+  auto t1 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    Json json = parseText(doc);
+    std::vector<Squad> squads;
+    for (const Json& item : *json.value.data.array) {
+      squads.push_back(squadFromJson(item));
+    }
+    members += squads.back().members.size();
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; loop++) {
+    std::vector<Squad> squads;
+    jsonBind(doc, squads);
+    members += squads.back().members.size();
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  report("dom + hand walk", doc.size(), seconds(t1, t2) / loops);
+  report("jsonBind", doc.size(), seconds(t2, t3) / loops);
+  std::cout << "(" << members << ")" << std::endl;
+}
+
+static void checkErrors() {
+  struct Case {
+    const char* text;
+    JsonErrc code;
+    int64_t row;
+    int64_t col;
+  };
+  const Case cases[] = {
+    {"", JsonErrc::unexpected_eof, 1, 1},
+    {"{\"a\": 1,}", JsonErrc::unexpected_token, 1, 9},
+    {"[1, 2", JsonErrc::unexpected_eof, 1, 6},
+    {"{\"a\" 1}", JsonErrc::unexpected_token, 1, 6},
+    {"[1]\n  x", JsonErrc::unexpected_char, 2, 3},
+    {"[1] 2", JsonErrc::trailing_content, 1, 5},
+    {"[01]", JsonErrc::bad_number, 1, 2},
+    {"[-]", JsonErrc::bad_number, 1, 2},
+    {"[-\xb5]", JsonErrc::bad_number, 1, 2},
+    {"[1.\xb5]", JsonErrc::bad_number, 1, 2},
+    {"[1.]", JsonErrc::bad_number, 1, 2},
+    {"[1e+]", JsonErrc::bad_number, 1, 2},
+    {"[tru]", JsonErrc::bad_literal, 1, 2},
+    {"\"abc", JsonErrc::unterminated_string, 1, 1},
+    {"\"a\tb\"", JsonErrc::control_char, 1, 3},
+    {"\"\\x\"", JsonErrc::bad_escape, 1, 2},
+    {"\"\\u12g4\"", JsonErrc::bad_unicode, 1, 2},
+    {"\"\\udc00\"", JsonErrc::bad_unicode, 1, 2},
+    {"\"\\ud800x\"", JsonErrc::bad_unicode, 1, 2},
+    {"\"\xc0\xaf\"", JsonErrc::bad_utf8, 1, 2},
+    {"\"\xed\xa0\x80\"", JsonErrc::bad_utf8, 1, 2},
+    {"\"\xf4\x90\x80\x80\"", JsonErrc::bad_utf8, 1, 2},
+    {"\"\xe2\x82\"", JsonErrc::bad_utf8, 1, 2},
+  };
+  for (const Case& c : cases) {
+    Parser parser(c.text, strlen(c.text));
+    JsonResult result = parser.parse();
+    check(result.error.code == c.code && result.error.row == c.row && result.error.col == c.col,
+          "error position");
+    check(result.value.value.type == Json::Type::null_type, "error value is null");
+  }
+  std::string deep(Parser::kMaxDepth + 1, '[');
+  check(Parser(deep.data(), deep.size()).parse().error.code == JsonErrc::too_deep, "too deep");
+  std::string deeper(100000, '[');
+  Lexer deeper_lexer(deeper.data(), deeper.size());
+  JsonQuery("$..x").stream(deeper_lexer, [](const Json&) {});
+  check(deeper_lexer.getError().code == JsonErrc::too_deep, "query stream too deep");
+
+  const char* escaped = "\"q\\\" b\\\\ s\\/ \\b\\f\\n\\r\\t \\u00e9 \\u20AC \\ud83d\\ude00 \xe4\xb8\xad\"";
+  JsonResult result = Parser(escaped, strlen(escaped)).parse();
+  check(result.ok() && result.value.getString() ==
+        "q\" b\\ s/ \b\f\n\r\t \xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xe4\xb8\xad",
+        "escapes decoded");
+  check(Parser(result.value.dump().data(), result.value.dump().size()).parse().value.dump() ==
+        result.value.dump(), "escapes round trip");
+
+  // random damage to a valid document: every outcome must be a clean result
+  std::string doc = makeSquads(20);
+  std::mt19937 gen(7);
+  size_t failures = 0;
+  for (int round = 0; round < 20000; round++) {
+    std::string text = doc;
+    int edits = 1 + gen() % 4;
+    for (int edit = 0; edit < edits; edit++) {
+      size_t pos = gen() % text.size();
+      switch (gen() % 4) {
+        case 0:
+          text[pos] = char(gen());
+          break;
+        case 1:
+          text.erase(pos, 1 + gen() % 8);
+          break;
+        case 2:
+          text.insert(pos, 1, "{}[]\",:\\"[gen() % 8]);
+          break;
+        default:
+          text.resize(pos);
+      }
+      if (text.empty()) {
+        break;
+      }
+    }
+    JsonResult damaged = Parser(text.data(), text.size()).parse();
+    if (damaged.ok()) {
+      std::string dumped = damaged.value.dump();
+      check(Parser(dumped.data(), dumped.size()).parse().value.dump() == dumped,
+            "damaged document round trip");
+    } else {
+      failures++;
+    }
+  }
+  std::cout << "errors: ok (" << failures << " of 20000 damaged documents rejected)" << std::endl;
+}
+
+// parses text as an NDJSON file cut into chunks of chunk_size bytes
+static size_t parseNdjsonText(const std::string& text, size_t chunk_size,
+                              std::vector<JsonError>& errors) {
+  char path[] = "/tmp/json_parser_benchXXXXXX";
+  int fd = mkstemp(path);
+  check(fd >= 0 && write(fd, text.data(), text.size()) == ssize_t(text.size()), "temp file");
+  close(fd);
+  std::string filepath = path;
+  size_t docs;
+  {
+    NdjsonParser bulk(filepath, chunk_size);
+    docs = bulk.size();
+    errors = bulk.errors();
+  }
+  unlink(path);
+  return docs;
+}
+
+static void checkNdjson() {
+  // a broken line costs only itself, wherever the chunks are cut
+  std::string text = "{\"a\":1}\n{\"a\":\n{\"b\":2}\n\n  {\"c\":3}\n[1,\n2]\n{\"d\":4} 5\n\"e\"";
+  for (size_t chunk_size = 1; chunk_size <= text.size(); chunk_size++) {
+    std::vector<JsonError> errors;
+    size_t docs = parseNdjsonText(text, chunk_size, errors);
+    check(docs == 4, "ndjson documents");
+    check(errors.size() == 4, "ndjson errors");
+    check(errors[0].row == 2 && errors[0].code == JsonErrc::unexpected_eof, "ndjson truncated line");
+    check(errors[1].row == 6 && errors[2].row == 7, "ndjson value split over lines");
+    check(errors[3].row == 8 && errors[3].code == JsonErrc::trailing_content,
+          "ndjson two values on a line");
+  }
+  std::vector<JsonError> errors;
+  std::string missing = "/nonexistent/json_parser_bench.ndjson";
+  NdjsonParser bulk(missing);
+  check(bulk.size() == 0 && bulk.begin() == bulk.end(), "ndjson missing file has no documents");
+  errors = bulk.errors();
+  check(errors.size() == 1 && errors[0].code == JsonErrc::io_error, "ndjson missing file");
+  std::cout << "ndjson: ok" << std::endl;
+}
+
+// rebuilds compact text from the events, to compare with Json::dump
+class EchoHandler : public JsonHandler {
+public:
+  void onNull() override { value("null"); }
+  void onBool(bool b) override { value(b ? "true" : "false"); }
+  void onInt(int64_t v) override { value(std::to_string(v)); }
+  void onUint(uint64_t v) override { value(std::to_string(v)); }
+  void onNumber(double v) override {
+    Json::Data data;
+    data.value = v;
+    Json json;
+    json.setType(Json::Type::num_type);
+    json.setData(data);
+    value(json.dump());
+  }
+  void onString(std::string_view s) override {
+    Json json;
+    json.setString(s);
+    value(json.dump());
+  }
+  void onKey(std::string_view key) override {
+    onString(key);
+    out += ':';
+    first = true;
+  }
+  void onStartObject() override { value("{"); first = true; }
+  void onEndObject() override { out += '}'; first = false; }
+  void onStartArray() override { value("["); first = true; }
+  void onEndArray() override { out += ']'; first = false; }
+
+  std::string out;
+
+private:
+  void value(const std::string& text) {
+    if (!first) {
+      out += ',';
+    }
+    out += text;
+    first = false;
+  }
+  bool first = true;
+};
+
+static void checkSax() {
+  for (const std::string& doc : {makeSquads(50), makeRecords(50), makeCoordinates(50)}) {
+    EchoHandler echo;
+    JsonError error = jsonSax(doc.data(), doc.size(), echo);
+    check(!error && echo.out == parseText(doc).dump(), "sax events");
+  }
+  for (const char* text : {"", "{\"a\": 1,}", "[1, 2", "{\"a\" 1}", "[1] 2", "[tru]", "{1: 2}"}) {
+    JsonHandler ignore;
+    JsonError error = jsonSax(text, strlen(text), ignore);
+    JsonError expected = Parser(text, strlen(text)).parse().error;
+    check(error.code == expected.code && error.row == expected.row && error.col == expected.col,
+          "sax error position");
+  }
+  std::cout << "sax: ok" << std::endl;
+}
+
+// string-heavy documents: plain ASCII, multi-byte UTF-8 and escapes
+static std::string makeTexts(size_t num, const std::string& sentence) {
+  std::string doc = "[\n";
+  for (size_t i = 0; i < num; i++) {
+    doc += "  {\"id\": " + std::to_string(i) + ", \"text\": \"" + sentence + "\", \"lang\": \"xx\"}";
+    doc += i + 1 == num ? "\n" : ",\n";
+  }
+  doc += "]\n";
+  return doc;
+}
+
+static void benchValidation() {
+  const std::pair<const char*, std::string> corpora[] = {
+    {"ascii", makeTexts(50000, "The quick brown fox jumps over the lazy dog, again and again.")},
+    {"utf-8", makeTexts(50000, "\xe6\x95\x8f\xe6\x8d\xb7\xe7\x9a\x84\xe6\xa3\x95\xe8\x89\xb2"
+                               "\xe7\x8b\x90\xe7\x8b\xb8 caf\xc3\xa9 \xf0\x9f\xa6\x8a na\xc3\xafve")},
+    {"escapes", makeTexts(50000, "line\\none\\ttab \\\"quoted\\\" \\u00e9\\u4e2d \\ud83e\\udd8a")},
+  };
+  int loops = 5;
+  for (const auto& corpus : corpora) {
+    const std::string& doc = corpus.second;
+    size_t tokens = 0;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+      Lexer lexer(doc.data(), doc.size());
+      while (lexer.getCurrentToken() != tok_eof && lexer.getCurrentToken() != tok_error) {
+        tokens++;
+        lexer.consumerCurrnetToken();
+      }
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+      JsonResult result = Parser(doc.data(), doc.size()).parse();
+      tokens += result.ok();
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    std::cout << corpus.first << ": lex + validate " << doc.size() / (seconds(t1, t2) / loops) / (1 << 20)
+              << " MB/s, parse " << doc.size() / (seconds(t2, t3) / loops) / (1 << 20)
+              << " MB/s (" << tokens << ")" << std::endl;
+  }
+}
+
+static JsonDocument makeConfig(int64_t version) {
+  std::string text = "{\"version\": " + std::to_string(version) + ", \"check\": " +
+                     std::to_string(version * 7) + ", \"server\": {\"host\": \"example.org\", "
+                     "\"port\": 8080, \"workers\": [1, 2, 3, 4]}}";
+  return JsonDocument(parseText(text));
+}
+
+// readers on several threads while the config is swapped underneath them:
+// every snapshot must be one complete version, and versions never go back
+static void checkDocument() {
+  AtomicJsonDocument config(makeConfig(0));
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> loads{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; i++) {
+    readers.emplace_back([&]() {
+      int64_t last = 0;
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        JsonDocument doc = config.load();
+        int64_t version = doc["version"].getInt();
+        check(doc["check"].getInt() == version * 7 && version >= last, "snapshot consistent");
+        check(doc["server"]["workers"][3].getInt() == 4 && doc["missing"]["x"].isNull(),
+              "snapshot paths");
+        last = version;
+        count++;
+      }
+      loads += count;
+    });
+  }
+  JsonDocument kept = config.load();
+  for (int64_t version = 1; version <= 2000; version++) {
+    config.store(makeConfig(version));
+  }
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  // an old snapshot stays valid after any number of swaps
+  check(kept["version"].getInt() == 0 && kept.useCount() == 1, "old snapshot kept");
+  check(config.load()["version"].getInt() == 2000 && config.version() == 2000, "latest snapshot");
+  std::cout << "document: ok (" << loads << " loads during 2000 swaps)" << std::endl;
+}
+
+// cost of taking a snapshot and reading one field, against
+// std::atomic_load on a std::shared_ptr (a lock inside libstdc++)
+static void benchDocument() {
+  AtomicJsonDocument config(makeConfig(1));
+  auto shared = std::make_shared<const Json>(parseText("{\"server\": {\"port\": 8080}}"));
+  const int loops = 2000000;
+  int64_t sum = 0;
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loops; i++) {
+    sum += config.load()["server"]["port"].getInt();
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loops; i++) {
+    sum += (*std::atomic_load(&shared))["server"]["port"].getInt();
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  std::atomic<bool> stop{false};
+  std::thread writer([&]() {
+    int64_t version = 2;
+    while (!stop.load(std::memory_order_relaxed)) {
+      config.store(makeConfig(version++));
+    }
+  });
+  auto t4 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loops; i++) {
+    sum += config.load()["server"]["port"].getInt();
+  }
+  auto t5 = std::chrono::steady_clock::now();
+  stop = true;
+  writer.join();
+  std::cout << "snapshot + lookup: " << seconds(t1, t2) / loops * 1e9
+            << " ns, shared_ptr atomic_load: " << seconds(t2, t3) / loops * 1e9
+            << " ns, while swapping: " << seconds(t4, t5) / loops * 1e9 << " ns ("
+            << config.version() << " versions, " << sum << ")" << std::endl;
+}
+
+int main() {
+  benchMemory();
+  checkNumbers();
+  benchNumbers();
+  checkWriter();
+  checkValues();
+  benchWriter();
+  benchParseCopies();
+  checkCbor();
+  benchCbor();
+  checkOnDemand();
+  benchOnDemand();
+  checkBind();
+  benchBind();
+  checkErrors();
+  checkNdjson();
+  benchValidation();
+  checkDocument();
+  benchDocument();
+  checkSax();
+  for (size_t width : {8, 64, 1024, 8192}) {
+    benchObjectLookup(width);
+  }
+  return 0;
+}
@@ -0,0 +1,377 @@
+#ifndef __BIND_H
+#define __BIND_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lexer.h"
+#include "parser.h"
+
+// Typed deserialization: reads JSON text straight from Lexer tokens into C++
+// structs, without building a Json tree first.
+//
+// A struct is made readable by listing its fields, either with the macro
+//
+//   struct Member { std::string name; int age; std::vector<std::string> powers; };
+//   JSON_FIELDS(Member, name, age, powers)
+//
+// (at namespace scope) or by specializing JsonFields by hand when the JSON
+// key differs from the member name:
+//
+//   template <> struct JsonFields<Member> {
+//     static constexpr auto fields = std::make_tuple(
+//         jsonField("name", &Member::name), jsonField("age", &Member::age));
+//   };
+//
+// Supported members are bool, integers, floating point, std::string, Json
+// (any value, parsed into a tree), std::optional<T> (null reads as nullopt),
+// std::vector<T> and other registered structs. Keys of an object are matched
+// through a perfect hash computed at compile time from the field names, so a
+// key costs one hash, one table probe and one compare. Unknown keys are
+// skipped, missing keys leave the member untouched.
+//
+// jsonBind returns false when the text does not fit the type, e.g. a string
+// where an int is expected or an integer out of range, and on malformed text
+// (the Lexer's getError() then has the position).
+
+template <typename C, typename M>
+struct JsonField {
+  std::string_view name;
+  M C::*member;
+};
+
+template <typename C, typename M>
+constexpr JsonField<C, M> jsonField(std::string_view name, M C::*member) {
+  return JsonField<C, M>{name, member};
+}
+
+// specialized for every readable struct, see JSON_FIELDS
+template <typename T>
+struct JsonFields;
+
+constexpr uint32_t jsonKeyHash(std::string_view key, uint32_t seed) {
+  uint32_t hash = seed ^ uint32_t(key.size());
+  for (char c : key) {
+    hash = (hash ^ uint8_t(c)) * 16777619u;
+  }
+  return hash ^ (hash >> 15);
+}
+
+// open table of at least four slots per key; slot holds field index + 1
+template <size_t N>
+struct JsonKeyTable {
+  static constexpr size_t capacity() {
+    size_t size = 4;
+    while (size < 4 * N) {
+      size *= 2;
+    }
+    return size;
+  }
+  uint32_t seed = 0;
+  std::array<uint8_t, capacity()> slots{};
+
+  constexpr int find(std::string_view key) const {
+    return int(slots[jsonKeyHash(key, seed) & (capacity() - 1)]) - 1;
+  }
+};
+
+// tries seeds until every name lands in its own slot; a duplicate name makes
+// this fail to evaluate, which turns into a compile error
+template <size_t N>
+constexpr JsonKeyTable<N> makeKeyTable(const std::array<std::string_view, N>& names) {
+  static_assert(N < 255, "too many fields for one struct");
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = i + 1; j < N; j++) {
+      if (names[i] == names[j]) {
+        throw "duplicate json field name";
+      }
+    }
+  }
+  JsonKeyTable<N> table;
+  for (uint32_t seed = 2166136261u; ; seed++) {
+    table.seed = seed;
+    table.slots = {};
+    bool perfect = true;
+    for (size_t i = 0; i < N && perfect; i++) {
+      uint8_t& slot = table.slots[jsonKeyHash(names[i], seed) & (table.capacity() - 1)];
+      perfect = slot == 0;
+      slot = uint8_t(i + 1);
+    }
+    if (perfect) {
+      return table;
+    }
+  }
+}
+
+template <typename T>
+bool jsonBind(Lexer& lexer, T& out);
+
+template <typename T>
+struct JsonBinding;
+
+template <typename T, size_t I>
+bool jsonBindMember(Lexer& lexer, T& out) {
+  return jsonBind(lexer, out.*(std::get<I>(JsonBinding<T>::fields).member));
+}
+
+template <typename T>
+struct JsonBinding {
+  static constexpr auto& fields = JsonFields<T>::fields;
+  static constexpr size_t count = std::tuple_size_v<std::decay_t<decltype(fields)>>;
+
+  template <size_t... I>
+  static constexpr std::array<std::string_view, count> makeNames(std::index_sequence<I...>) {
+    return {std::get<I>(fields).name...};
+  }
+  static constexpr std::array<std::string_view, count> names =
+      makeNames(std::make_index_sequence<count>());
+  static constexpr JsonKeyTable<count> table = makeKeyTable(names);
+
+  // the switch over field indexes, as a jump table
+  using Reader = bool (*)(Lexer&, T&);
+  template <size_t... I>
+  static constexpr std::array<Reader, count> makeReaders(std::index_sequence<I...>) {
+    return {&jsonBindMember<T, I>...};
+  }
+  static constexpr std::array<Reader, count> readers =
+      makeReaders(std::make_index_sequence<count>());
+};
+
+// steps over one value; the lexer is left on its last token
+inline bool jsonSkip(Lexer& lexer) {
+  int64_t depth = 0;
+  do {
+    Token tok = lexer.getCurrentToken();
+    if (tok == tok_eof || tok == tok_error) {
+      return false;
+    } else if (tok == tok_bracket_open || tok == tok_sbracket_open) {
+      depth++;
+    } else if (tok == tok_bracket_close || tok == tok_sbracket_close) {
+      depth--;
+    }
+    if (depth < 0) {
+      return false;
+    } else if (depth > 0) {
+      lexer.consumerCurrnetToken();
+    }
+  } while (depth > 0);
+  return true;
+}
+
+template <typename T>
+struct JsonIsVector : std::false_type {};
+template <typename T, typename A>
+struct JsonIsVector<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+struct JsonIsOptional : std::false_type {};
+template <typename T>
+struct JsonIsOptional<std::optional<T>> : std::true_type {};
+
+template <typename T>
+bool jsonBindInteger(Lexer& lexer, T& out) {
+  if (lexer.getCurrentToken() == tok_int) {
+    int64_t value = lexer.getInt();
+    if constexpr (std::is_signed_v<T>) {
+      if (value < int64_t(std::numeric_limits<T>::min()) ||
+          value > int64_t(std::numeric_limits<T>::max())) {
+        return false;
+      }
+    } else if (value < 0 || uint64_t(value) > uint64_t(std::numeric_limits<T>::max())) {
+      return false;
+    }
+    out = T(value);
+    return true;
+  } else if (lexer.getCurrentToken() == tok_uint) {
+    uint64_t value = lexer.getUint();
+    if (value > uint64_t(std::numeric_limits<T>::max())) {
+      return false;
+    }
+    out = T(value);
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool jsonBindObject(Lexer& lexer, T& out) {
+  using Binding = JsonBinding<T>;
+  if (lexer.getCurrentToken() != tok_bracket_open) {
+    return false;
+  }
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() == tok_bracket_close) {
+    return true;
+  }
+  while (true) {
+    if (lexer.getCurrentToken() != tok_string) {
+      return false;
+    }
+    std::string_view key = lexer.viewString();
+    int index = Binding::table.find(key);
+    if (index >= 0 && Binding::names[index] != key) {
+      index = -1;
+    }
+    lexer.consumerCurrnetToken();
+    if (lexer.getCurrentToken() != tok_colon) {
+      return false;
+    }
+    lexer.consumerCurrnetToken();
+    bool ok = index >= 0 ? Binding::readers[index](lexer, out) : jsonSkip(lexer);
+    if (!ok) {
+      return false;
+    }
+    lexer.consumerCurrnetToken();
+    if (lexer.getCurrentToken() == tok_bracket_close) {
+      return true;
+    } else if (lexer.getCurrentToken() != tok_comma) {
+      return false;
+    }
+    lexer.consumerCurrnetToken();
+  }
+}
+
+// reads the value starting at the current token and leaves the lexer on its
+// last token, like Parser::parser_value
+template <typename T>
+bool jsonBind(Lexer& lexer, T& out) {
+  Token tok = lexer.getCurrentToken();
+  if constexpr (std::is_same_v<T, bool>) {
+    if (tok != tok_true && tok != tok_false) {
+      return false;
+    }
+    out = tok == tok_true;
+    return true;
+  } else if constexpr (std::is_integral_v<T>) {
+    return jsonBindInteger(lexer, out);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    if (tok == tok_number) {
+      out = T(lexer.getNumber());
+    } else if (tok == tok_int) {
+      out = T(lexer.getInt());
+    } else if (tok == tok_uint) {
+      out = T(lexer.getUint());
+    } else {
+      return false;
+    }
+    return true;
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    if (tok != tok_string) {
+      return false;
+    }
+    out = lexer.takeString();
+    return true;
+  } else if constexpr (std::is_same_v<T, Json>) {
+    Parser parser(lexer);
+    out = parser.parser_value();
+    return !parser.error();
+  } else if constexpr (JsonIsOptional<T>::value) {
+    if (tok == tok_null) {
+      out.reset();
+      return true;
+    }
+    return jsonBind(lexer, out.emplace());
+  } else if constexpr (JsonIsVector<T>::value) {
+    if (tok != tok_sbracket_open) {
+      return false;
+    }
+    out.clear();
+    lexer.consumerCurrnetToken();
+    if (lexer.getCurrentToken() == tok_sbracket_close) {
+      return true;
+    }
+    while (true) {
+      if (!jsonBind(lexer, out.emplace_back())) {
+        return false;
+      }
+      lexer.consumerCurrnetToken();
+      if (lexer.getCurrentToken() == tok_sbracket_close) {
+        return true;
+      } else if (lexer.getCurrentToken() != tok_comma) {
+        return false;
+      }
+      lexer.consumerCurrnetToken();
+    }
+  } else {
+    return jsonBindObject(lexer, out);
+  }
+}
+
+// reads one whole document
+template <typename T>
+bool jsonBind(const char* data, size_t size, T& out) {
+  Lexer lexer(data, size);
+  if (!jsonBind(lexer, out)) {
+    return false;
+  }
+  lexer.consumerCurrnetToken();
+  return lexer.getCurrentToken() == tok_eof;
+}
+
+template <typename T>
+bool jsonBind(std::string_view text, T& out) {
+  return jsonBind(text.data(), text.size(), out);
+}
+
+// JSON_FIELDS(Type, a, b, c) registers Type::a, Type::b and Type::c under
+// their own names. Plain C++17 preprocessor: the fields are counted and the
+// matching JSON_FOR_EACH_<n> unrolls them, so a struct may list up to 32.
+#define JSON_FIELD_OF(type, name) jsonField(#name, &type::name)
+#define JSON_CONCAT(a, b) JSON_CONCAT_(a, b)
+#define JSON_CONCAT_(a, b) a##b
+// the trailing 0 keeps the variadic part of JSON_COUNT_ non-empty
+#define JSON_COUNT(...) \
+  JSON_COUNT_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, \
+              16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define JSON_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+                    _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30,  \
+                    _31, _32, n, ...) n
+#define JSON_FOR_EACH(type, ...) \
+  JSON_CONCAT(JSON_FOR_EACH_, JSON_COUNT(__VA_ARGS__))(type, __VA_ARGS__)
+#define JSON_FOR_EACH_1(type, name) JSON_FIELD_OF(type, name)
+#define JSON_FOR_EACH_2(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_1(type, __VA_ARGS__)
+#define JSON_FOR_EACH_3(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_2(type, __VA_ARGS__)
+#define JSON_FOR_EACH_4(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_3(type, __VA_ARGS__)
+#define JSON_FOR_EACH_5(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_4(type, __VA_ARGS__)
+#define JSON_FOR_EACH_6(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_5(type, __VA_ARGS__)
+#define JSON_FOR_EACH_7(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_6(type, __VA_ARGS__)
+#define JSON_FOR_EACH_8(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_7(type, __VA_ARGS__)
+#define JSON_FOR_EACH_9(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_8(type, __VA_ARGS__)
+#define JSON_FOR_EACH_10(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_9(type, __VA_ARGS__)
+#define JSON_FOR_EACH_11(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_10(type, __VA_ARGS__)
+#define JSON_FOR_EACH_12(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_11(type, __VA_ARGS__)
+#define JSON_FOR_EACH_13(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_12(type, __VA_ARGS__)
+#define JSON_FOR_EACH_14(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_13(type, __VA_ARGS__)
+#define JSON_FOR_EACH_15(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_14(type, __VA_ARGS__)
+#define JSON_FOR_EACH_16(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_15(type, __VA_ARGS__)
+#define JSON_FOR_EACH_17(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_16(type, __VA_ARGS__)
+#define JSON_FOR_EACH_18(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_17(type, __VA_ARGS__)
+#define JSON_FOR_EACH_19(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_18(type, __VA_ARGS__)
+#define JSON_FOR_EACH_20(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_19(type, __VA_ARGS__)
+#define JSON_FOR_EACH_21(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_20(type, __VA_ARGS__)
+#define JSON_FOR_EACH_22(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_21(type, __VA_ARGS__)
+#define JSON_FOR_EACH_23(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_22(type, __VA_ARGS__)
+#define JSON_FOR_EACH_24(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_23(type, __VA_ARGS__)
+#define JSON_FOR_EACH_25(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_24(type, __VA_ARGS__)
+#define JSON_FOR_EACH_26(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_25(type, __VA_ARGS__)
+#define JSON_FOR_EACH_27(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_26(type, __VA_ARGS__)
+#define JSON_FOR_EACH_28(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_27(type, __VA_ARGS__)
+#define JSON_FOR_EACH_29(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_28(type, __VA_ARGS__)
+#define JSON_FOR_EACH_30(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_29(type, __VA_ARGS__)
+#define JSON_FOR_EACH_31(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_30(type, __VA_ARGS__)
+#define JSON_FOR_EACH_32(type, name, ...) JSON_FIELD_OF(type, name), JSON_FOR_EACH_31(type, __VA_ARGS__)
+
+#define JSON_FIELDS(type, ...)                                                  \
+  template <>                                                                   \
+  struct JsonFields<type> {                                                     \
+    static constexpr auto fields = std::make_tuple(JSON_FOR_EACH(type, __VA_ARGS__)); \
+  }
+
+#endif
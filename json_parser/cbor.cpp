@@ -0,0 +1,497 @@
+#include "cbor.h"
+#include <cmath>
+#include "parser.h"
+
+namespace {
+
+enum Major : uint8_t {
+  kUnsigned = 0,
+  kNegative = 1,
+  kBytes = 2,
+  kText = 3,
+  kArray = 4,
+  kMap = 5,
+  kTag = 6,
+  kSimple = 7,
+};
+
+constexpr uint8_t kBreak = 0xff;
+// nesting limit for the recursive decoder, at least the parser's so that
+// every document it accepts also survives a CBOR round trip
+constexpr int64_t kMaxDepth = Parser::kMaxDepth;
+
+struct Head {
+  uint8_t major;
+  uint8_t info;
+  uint64_t arg;
+  bool indefinite;
+};
+
+}  // namespace
+
+static bool readHead(const uint8_t*& p, const uint8_t* end, Head& head) {
+  if (p == end) {
+    return false;
+  }
+  uint8_t byte = *p++;
+  head.major = byte >> 5;
+  head.info = byte & 0x1f;
+  head.indefinite = false;
+  head.arg = 0;
+  if (head.info < 24) {
+    head.arg = head.info;
+  } else if (head.info <= 27) {
+    size_t len = size_t(1) << (head.info - 24);
+    if (size_t(end - p) < len) {
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      head.arg = (head.arg << 8) | *p++;
+    }
+  } else if (head.info == 31 && head.major >= kBytes && head.major <= kMap) {
+    head.indefinite = true;
+  } else {
+    // reserved, or a break outside of an indefinite item
+    return false;
+  }
+  return true;
+}
+
+static double halfToDouble(uint16_t half) {
+  int exp = (half >> 10) & 0x1f;
+  int mant = half & 0x3ff;
+  double value;
+  if (exp == 0) {
+    value = std::ldexp(mant, -24);
+  } else if (exp != 31) {
+    value = std::ldexp(mant + 1024, exp - 25);
+  } else {
+    value = mant == 0 ? INFINITY : NAN;
+  }
+  return half & 0x8000 ? -value : value;
+}
+
+static double simpleToDouble(const Head& head) {
+  if (head.info == 25) {
+    return halfToDouble(uint16_t(head.arg));
+  } else if (head.info == 26) {
+    uint32_t bits = uint32_t(head.arg);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  double value;
+  memcpy(&value, &head.arg, sizeof(value));
+  return value;
+}
+
+static bool isBreak(const uint8_t* p, const uint8_t* end) {
+  return p != end && *p == kBreak;
+}
+
+// reads a text or byte string, following the chunks of an indefinite one
+static bool readString(const uint8_t*& p, const uint8_t* end, const Head& head, std::string& out) {
+  if (!head.indefinite) {
+    if (uint64_t(end - p) < head.arg) {
+      return false;
+    }
+    out.append(reinterpret_cast<const char*>(p), head.arg);
+    p += head.arg;
+    return true;
+  }
+  while (!isBreak(p, end)) {
+    Head chunk;
+    if (!readHead(p, end, chunk) || chunk.major != head.major || chunk.indefinite ||
+        !readString(p, end, chunk, out)) {
+      return false;
+    }
+  }
+  return ++p <= end;
+}
+
+static bool skipItem(const uint8_t*& p, const uint8_t* end, int depth) {
+  Head head;
+  if (depth > kMaxDepth || !readHead(p, end, head)) {
+    return false;
+  }
+  switch (head.major) {
+    case kBytes:
+    case kText:
+      if (head.indefinite) {
+        std::string ignore;
+        return readString(p, end, head, ignore);
+      }
+      if (uint64_t(end - p) < head.arg) {
+        return false;
+      }
+      p += head.arg;
+      return true;
+    case kArray:
+    case kMap: {
+      uint64_t items = head.major == kMap ? head.arg * 2 : head.arg;
+      if (head.indefinite) {
+        while (!isBreak(p, end)) {
+          if (!skipItem(p, end, depth + 1)) {
+            return false;
+          }
+        }
+        return ++p <= end;
+      }
+      for (uint64_t i = 0; i < items; i++) {
+        if (!skipItem(p, end, depth + 1)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case kTag:
+      return skipItem(p, end, depth + 1);
+    default:
+      return true;
+  }
+}
+
+// steps over any tags in front of the item
+static const uint8_t* peelTags(const uint8_t* p, const uint8_t* end) {
+  Head head;
+  const uint8_t* item = p;
+  while (item && readHead(p, end, head) && head.major == kTag) {
+    item = p;
+  }
+  return item;
+}
+
+static bool decodeItem(const uint8_t*& p, const uint8_t* end, Json& out, int depth) {
+  Head head;
+  if (depth > kMaxDepth || !readHead(p, end, head)) {
+    return false;
+  }
+  Json json;
+  Json::Data data;
+  data.value = 0;
+  switch (head.major) {
+    case kUnsigned:
+      if (head.arg <= uint64_t(INT64_MAX)) {
+        json.setType(Json::Type::int_type);
+        data.integer = int64_t(head.arg);
+      } else {
+        json.setType(Json::Type::uint_type);
+        data.uinteger = head.arg;
+      }
+      break;
+    case kNegative:
+      if (head.arg <= uint64_t(INT64_MAX)) {
+        json.setType(Json::Type::int_type);
+        data.integer = -1 - int64_t(head.arg);
+      } else {
+        json.setType(Json::Type::num_type);
+        data.value = -1.0 - double(head.arg);
+      }
+      break;
+    case kBytes:
+    case kText: {
+      std::string str;
+      if (!readString(p, end, head, str)) {
+        return false;
+      }
+      // setData would overwrite an inline string, so it is stored directly
+      out.setString(std::move(str));
+      return true;
+    }
+    case kArray: {
+      JsonArray* array = new JsonArray;
+      json.setType(Json::Type::array_type);
+      data.array = array;
+      json.setData(data);
+      if (!head.indefinite) {
+        // every item takes at least one byte, don't trust larger counts
+        array->reserve(std::min<uint64_t>(head.arg, end - p));
+      }
+      for (uint64_t i = 0; head.indefinite ? !isBreak(p, end) : i < head.arg; i++) {
+        array->emplace_back();
+        if (!decodeItem(p, end, array->back(), depth + 1)) {
+          return false;
+        }
+      }
+      if (head.indefinite && ++p > end) {
+        return false;
+      }
+      break;
+    }
+    case kMap: {
+      JsonMap* map = new JsonMap;
+      json.setType(Json::Type::map_type);
+      data.map = map;
+      json.setData(data);
+      for (uint64_t i = 0; head.indefinite ? !isBreak(p, end) : i < head.arg; i++) {
+        Head key_head;
+        std::string key;
+        if (!readHead(p, end, key_head) ||
+            (key_head.major != kText && key_head.major != kBytes) ||
+            !readString(p, end, key_head, key) ||
+            !decodeItem(p, end, (*map)[std::move(key)], depth + 1)) {
+          return false;
+        }
+      }
+      if (head.indefinite && ++p > end) {
+        return false;
+      }
+      break;
+    }
+    case kTag:
+      return decodeItem(p, end, out, depth + 1);
+    default:
+      if (head.info == 20 || head.info == 21) {
+        json.setType(Json::Type::bool_type);
+        data.flag = head.info == 21;
+      } else if (head.info == 22 || head.info == 23) {
+        json.setType(Json::Type::null_type);
+      } else if (head.info >= 25 && head.info <= 27) {
+        json.setType(Json::Type::num_type);
+        data.value = simpleToDouble(head);
+      } else {
+        return false;
+      }
+  }
+  json.setData(data);
+  out = std::move(json);
+  return true;
+}
+
+static void writeHead(std::string& out, uint8_t major, uint64_t arg) {
+  char buf[9];
+  size_t len;
+  if (arg < 24) {
+    buf[0] = char((major << 5) | arg);
+    len = 1;
+  } else {
+    int info = arg <= 0xff ? 24 : arg <= 0xffff ? 25 : arg <= 0xffffffff ? 26 : 27;
+    len = size_t(1) << (info - 24);
+    buf[0] = char((major << 5) | info);
+    for (size_t i = 0; i < len; i++) {
+      buf[len - i] = char(arg >> (8 * i));
+    }
+    len++;
+  }
+  out.append(buf, len);
+}
+
+void cborEncode(const Json& json, std::string& out) {
+  const Json::Value& value = json.value;
+  if (value.type == Json::Type::null_type) {
+    out += char(0xf6);
+  } else if (value.type == Json::Type::bool_type) {
+    out += char(value.data.flag ? 0xf5 : 0xf4);
+  } else if (value.type == Json::Type::int_type) {
+    if (value.data.integer >= 0) {
+      writeHead(out, kUnsigned, value.data.integer);
+    } else {
+      writeHead(out, kNegative, uint64_t(-1 - value.data.integer));
+    }
+  } else if (value.type == Json::Type::uint_type) {
+    writeHead(out, kUnsigned, value.data.uinteger);
+  } else if (value.type == Json::Type::num_type) {
+    double number = value.data.value;
+    float single = float(number);
+    if (double(single) == number || std::isnan(number)) {
+      uint32_t bits;
+      memcpy(&bits, &single, sizeof(bits));
+      out += char((kSimple << 5) | 26);
+      for (int i = 3; i >= 0; i--) {
+        out += char(bits >> (8 * i));
+      }
+    } else {
+      uint64_t bits;
+      memcpy(&bits, &number, sizeof(bits));
+      out += char((kSimple << 5) | 27);
+      for (int i = 7; i >= 0; i--) {
+        out += char(bits >> (8 * i));
+      }
+    }
+  } else if (value.type == Json::Type::str_type) {
+    std::string_view str = json.getString();
+    writeHead(out, kText, str.size());
+    out.append(str);
+  } else if (value.type == Json::Type::array_type) {
+    size_t size = value.data.array ? value.data.array->size() : 0;
+    writeHead(out, kArray, size);
+    for (size_t i = 0; i < size; i++) {
+      cborEncode((*value.data.array)[i], out);
+    }
+  } else {
+    size_t size = value.data.map ? value.data.map->size() : 0;
+    writeHead(out, kMap, size);
+    if (size) {
+      for (const auto& elem : *value.data.map) {
+        writeHead(out, kText, elem.first.size());
+        out.append(elem.first);
+        cborEncode(elem.second, out);
+      }
+    }
+  }
+}
+
+bool cborDecode(const char* data, size_t size, Json& out) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  return decodeItem(p, p + size, out, 0);
+}
+
+bool CborView::valid() const {
+  const uint8_t* item = peelTags(begin, end);
+  Head head;
+  return item && readHead(item, end, head);
+}
+
+Json::Type CborView::type() const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head)) {
+    return Json::Type::null_type;
+  }
+  switch (head.major) {
+    case kUnsigned:
+      return head.arg <= uint64_t(INT64_MAX) ? Json::Type::int_type : Json::Type::uint_type;
+    case kNegative:
+      return head.arg <= uint64_t(INT64_MAX) ? Json::Type::int_type : Json::Type::num_type;
+    case kBytes:
+    case kText:
+      return Json::Type::str_type;
+    case kArray:
+      return Json::Type::array_type;
+    case kMap:
+      return Json::Type::map_type;
+    default:
+      if (head.info == 20 || head.info == 21) {
+        return Json::Type::bool_type;
+      } else if (head.info >= 25 && head.info <= 27) {
+        return Json::Type::num_type;
+      }
+      return Json::Type::null_type;
+  }
+}
+
+size_t CborView::size() const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head) || (head.major != kArray && head.major != kMap)) {
+    return 0;
+  }
+  if (!head.indefinite) {
+    return head.arg;
+  }
+  size_t items = 0;
+  while (!isBreak(p, end) && skipItem(p, end, 0)) {
+    items++;
+  }
+  return head.major == kMap ? items / 2 : items;
+}
+
+CborView CborView::operator[](std::string_view key) const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head) || head.major != kMap) {
+    return CborView();
+  }
+  for (uint64_t i = 0; head.indefinite ? !isBreak(p, end) : i < head.arg; i++) {
+    Head key_head;
+    const uint8_t* key_begin = p;
+    if (!readHead(p, end, key_head)) {
+      return CborView();
+    }
+    if (key_head.major == kText && !key_head.indefinite && uint64_t(end - p) >= key_head.arg) {
+      std::string_view name(reinterpret_cast<const char*>(p), key_head.arg);
+      p += key_head.arg;
+      if (name == key) {
+        return CborView(p, end);
+      }
+    } else {
+      p = key_begin;
+      if (!skipItem(p, end, 0)) {
+        return CborView();
+      }
+    }
+    if (!skipItem(p, end, 0)) {
+      return CborView();
+    }
+  }
+  return CborView();
+}
+
+CborView CborView::operator[](size_t index) const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head) || head.major != kArray ||
+      (!head.indefinite && index >= head.arg)) {
+    return CborView();
+  }
+  for (size_t i = 0; i < index; i++) {
+    if (isBreak(p, end) || !skipItem(p, end, 0)) {
+      return CborView();
+    }
+  }
+  return isBreak(p, end) ? CborView() : CborView(p, end);
+}
+
+bool CborView::getBool() const {
+  const uint8_t* p = peelTags(begin, end);
+  return p && p != end && *p == 0xf5;
+}
+
+int64_t CborView::getInt() const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head)) {
+    return 0;
+  }
+  if (head.major == kUnsigned) {
+    return int64_t(head.arg);
+  } else if (head.major == kNegative) {
+    return -1 - int64_t(head.arg);
+  } else if (head.major == kSimple && head.info >= 25 && head.info <= 27) {
+    return int64_t(simpleToDouble(head));
+  }
+  return 0;
+}
+
+uint64_t CborView::getUint() const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head)) {
+    return 0;
+  }
+  if (head.major == kUnsigned) {
+    return head.arg;
+  }
+  return uint64_t(getInt());
+}
+
+double CborView::getNumber() const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head)) {
+    return 0;
+  }
+  if (head.major == kUnsigned) {
+    return double(head.arg);
+  } else if (head.major == kNegative) {
+    return -1.0 - double(head.arg);
+  } else if (head.major == kSimple && head.info >= 25 && head.info <= 27) {
+    return simpleToDouble(head);
+  }
+  return 0;
+}
+
+std::string_view CborView::getString() const {
+  const uint8_t* p = peelTags(begin, end);
+  Head head;
+  if (!p || !readHead(p, end, head) || (head.major != kText && head.major != kBytes) ||
+      head.indefinite || uint64_t(end - p) < head.arg) {
+    return std::string_view();
+  }
+  return std::string_view(reinterpret_cast<const char*>(p), head.arg);
+}
+
+bool CborView::toJson(Json& out) const {
+  const uint8_t* p = begin;
+  return begin && decodeItem(p, end, out, 0);
+}
@@ -0,0 +1,57 @@
+#ifndef __CBOR_H
+#define __CBOR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "json.h"
+
+// CBOR (RFC 8949) binary encoding of Json documents.
+//
+// Integers use the shortest head, doubles are stored as float32 when that is
+// lossless and as float64 otherwise. The decoder also accepts what other
+// encoders commonly emit: byte strings, tags (skipped), half floats and
+// indefinite length strings, arrays and maps.
+
+// appends the encoding of json to out
+void cborEncode(const Json& json, std::string& out);
+// decodes one item; false on truncated or malformed input
+bool cborDecode(const char* data, size_t size, Json& out);
+
+// Zero-copy cursor over an encoded buffer. Nothing is decoded up front:
+// lookups walk the buffer and skip over items that are not asked for, so a
+// read touches only the bytes in front of the requested value. The buffer
+// must outlive every view taken from it.
+class CborView {
+public:
+  CborView(): begin(nullptr), end(nullptr) {}
+  CborView(const char* data, size_t size)
+    : begin(reinterpret_cast<const uint8_t*>(data)),
+      end(reinterpret_cast<const uint8_t*>(data) + size) {}
+
+  // false for a missing key/index or malformed data
+  bool valid() const;
+  Json::Type type() const;
+  // element count of an array or map
+  size_t size() const;
+  CborView operator[](std::string_view key) const;
+  CborView operator[](size_t index) const;
+
+  bool getBool() const;
+  int64_t getInt() const;
+  uint64_t getUint() const;
+  // any number widened to double
+  double getNumber() const;
+  // definite length text without copying; empty for anything else
+  std::string_view getString() const;
+  // decodes the item under the cursor
+  bool toJson(Json& out) const;
+
+private:
+  CborView(const uint8_t* begin, const uint8_t* end): begin(begin), end(end) {}
+
+  const uint8_t* begin;
+  const uint8_t* end;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include "corpus.h"
+#include <cstdarg>
+#include <cstdio>
+#include <random>
+
+// std::uniform_*_distribution differ between standard libraries, so values
+// are derived from the raw mt19937 output to keep corpora identical anywhere
+class CorpusRandom {
+public:
+  explicit CorpusRandom(uint32_t seed): gen(seed) {}
+  uint32_t below(uint32_t n) {
+    return gen() % n;
+  }
+  double between(double lo, double hi) {
+    return lo + (hi - lo) * (gen() / 4294967296.0);
+  }
+  uint64_t id() {
+    return (uint64_t(gen()) << 32 | gen()) >> 5;
+  }
+  template <typename T, size_t N>
+  const T& pick(const T (&items)[N]) {
+    return items[below(N)];
+  }
+
+private:
+  std::mt19937 gen;
+};
+
+static void appendf(std::string& out, const char* format, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  out.append(buf, len < int(sizeof(buf)) ? len : sizeof(buf) - 1);
+}
+
+static const char* const kWords[] = {
+  "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+  "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+};
+
+// pieces of string values: plain, escaped and multi-byte
+static const char* const kPieces[] = {
+  "the quick brown fox ", "jumps over ", "the lazy dog ", "line\\nbreak ",
+  "tab\\tstop ", "\\\"quoted\\\" ", "back\\\\slash ", "caf\xc3\xa9 ", "na\xc3\xafve ",
+  "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e ", "\xf0\x9f\x98\x80 ", "\\u00e9\\u4e2d ",
+  "\\ud83d\\ude80 ", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 ",
+};
+
+static void appendText(std::string& out, CorpusRandom& random, size_t pieces) {
+  for (size_t i = 0; i < pieces; i++) {
+    out += random.pick(kPieces);
+  }
+}
+
+static std::string makeDeep(size_t target_size, CorpusRandom& random) {
+  const int pairs = 250;
+  std::string doc = "[\n";
+  for (size_t record = 0; doc.size() < target_size; record++) {
+    if (record) {
+      doc += ",\n";
+    }
+    for (int level = 0; level < pairs; level++) {
+      appendf(doc, "{\"%s\":[", random.pick(kWords));
+    }
+    appendf(doc, "%u", random.below(1000));
+    for (int level = 0; level < pairs; level++) {
+      doc += "]}";
+    }
+  }
+  doc += "\n]\n";
+  return doc;
+}
+
+static std::string makeWide(size_t target_size, CorpusRandom& random) {
+  std::string doc = "[\n";
+  for (size_t record = 0; doc.size() < target_size; record++) {
+    doc += record ? ",\n{" : "{";
+    for (int field = 0; field < 256; field++) {
+      appendf(doc, "%s\"field_%03d\": ", field ? ", " : "", field);
+      switch (field % 5) {
+        case 0:
+          appendf(doc, "%u", random.below(1000000));
+          break;
+        case 1:
+          appendf(doc, "%.6f", random.between(-1000, 1000));
+          break;
+        case 2:
+          appendf(doc, "\"%s\"", random.pick(kWords));
+          break;
+        case 3:
+          doc += random.below(2) ? "true" : "false";
+          break;
+        default:
+          doc += "null";
+      }
+    }
+    doc += "}";
+  }
+  doc += "\n]\n";
+  return doc;
+}
+
+static std::string makeNumeric(size_t target_size, CorpusRandom& random) {
+  std::string doc = "{\"type\": \"FeatureCollection\", \"features\": [\n";
+  for (size_t feature = 0; doc.size() < target_size; feature++) {
+    appendf(doc, "%s{\"type\": \"Feature\", \"id\": %zu, \"properties\": {\"counts\": [",
+            feature ? ",\n" : "", feature);
+    for (int i = 0; i < 16; i++) {
+      appendf(doc, "%s%u", i ? ", " : "", random.below(100000));
+    }
+    doc += "]}, \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [[";
+    double lon = random.between(-180, 180);
+    double lat = random.between(-80, 80);
+    for (int i = 0; i < 64; i++) {
+      lon += random.between(-0.01, 0.01);
+      lat += random.between(-0.01, 0.01);
+      appendf(doc, "%s[%.15g, %.15g]", i ? ", " : "", lon, lat);
+    }
+    doc += "]]}}";
+  }
+  doc += "\n]}\n";
+  return doc;
+}
+
+static std::string makeStrings(size_t target_size, CorpusRandom& random) {
+  std::string doc = "[\n";
+  for (size_t record = 0; doc.size() < target_size; record++) {
+    appendf(doc, "%s{\"title\": \"", record ? ",\n" : "");
+    appendText(doc, random, 1 + random.below(3));
+    doc += "\", \"body\": \"";
+    appendText(doc, random, 4 + random.below(24));
+    doc += "\", \"tags\": [";
+    for (uint32_t i = 0, num = random.below(5); i < num; i++) {
+      appendf(doc, "%s\"%s\"", i ? ", " : "", random.pick(kWords));
+    }
+    doc += "]}";
+  }
+  doc += "\n]\n";
+  return doc;
+}
+
+static void appendUser(std::string& doc, CorpusRandom& random) {
+  uint64_t id = random.id();
+  const char* word = random.pick(kWords);
+  appendf(doc, "{\"id\": %llu, \"id_str\": \"%llu\", \"name\": \"%s %s\", \"screen_name\": \"%s_%u\", "
+          "\"location\": \"%s\", \"description\": \"", (unsigned long long)id,
+          (unsigned long long)id, word, random.pick(kWords), word, random.below(10000),
+          random.below(4) ? "" : "\xe6\x9d\xb1\xe4\xba\xac");
+  appendText(doc, random, random.below(6));
+  appendf(doc, "\", \"url\": null, \"entities\": {\"description\": {\"urls\": []}}, "
+          "\"protected\": false, \"followers_count\": %u, \"friends_count\": %u, "
+          "\"listed_count\": %u, \"created_at\": \"Mon Jul 16 12:%02u:%02u +0000 2012\", "
+          "\"favourites_count\": %u, \"utc_offset\": null, \"time_zone\": null, "
+          "\"geo_enabled\": %s, \"verified\": false, \"statuses_count\": %u, \"lang\": \"ja\", "
+          "\"profile_image_url\": \"http://pbs.twimg.com/profile_images/%u/%s_normal.jpeg\", "
+          "\"following\": false, \"notifications\": false}",
+          random.below(100000), random.below(5000), random.below(100), random.below(60),
+          random.below(60), random.below(20000), random.below(2) ? "true" : "false",
+          random.below(100000), random.below(1000000000), word);
+}
+
+static std::string makeTwitter(size_t target_size, CorpusRandom& random) {
+  std::string doc = "{\"statuses\": [\n";
+  for (size_t status = 0; doc.size() < target_size; status++) {
+    uint64_t id = random.id();
+    appendf(doc, "%s{\"metadata\": {\"result_type\": \"recent\", \"iso_language_code\": \"ja\"}, "
+            "\"created_at\": \"Sun Aug 31 00:%02u:%02u +0000 2014\", \"id\": %llu, "
+            "\"id_str\": \"%llu\", \"text\": \"", status ? ",\n" : "", random.below(60),
+            random.below(60), (unsigned long long)id, (unsigned long long)id);
+    appendText(doc, random, 2 + random.below(8));
+    doc += "\", \"source\": \"<a href=\\\"http://twitter.com/download/iphone\\\" "
+           "rel=\\\"nofollow\\\">Twitter for iPhone</a>\", \"truncated\": false, "
+           "\"in_reply_to_status_id\": null, \"in_reply_to_user_id\": null, \"user\": ";
+    appendUser(doc, random);
+    appendf(doc, ", \"geo\": null, \"coordinates\": null, \"place\": null, \"contributors\": null, "
+            "\"retweet_count\": %u, \"favorite_count\": %u, \"entities\": {\"hashtags\": [], "
+            "\"symbols\": [], \"urls\": [], \"user_mentions\": [", random.below(1000),
+            random.below(1000));
+    for (uint32_t i = 0, num = random.below(3); i < num; i++) {
+      uint64_t mention = random.id();
+      appendf(doc, "%s{\"screen_name\": \"%s\", \"name\": \"%s\", \"id\": %llu, \"id_str\": \"%llu\", "
+              "\"indices\": [%u, %u]}", i ? ", " : "", random.pick(kWords), random.pick(kWords),
+              (unsigned long long)mention, (unsigned long long)mention, 3 * i, 3 * i + 12);
+    }
+    doc += "]}, \"favorited\": false, \"retweeted\": false, \"lang\": \"ja\"}";
+  }
+  doc += "\n], \"search_metadata\": {\"completed_in\": 0.087, \"max_id\": 505874924095815681, "
+         "\"query\": \"%E4%B8%80\", \"count\": 100, \"since_id\": 0}}\n";
+  return doc;
+}
+
+static std::string makeCitm(size_t target_size, CorpusRandom& random) {
+  std::string events = "{\n";
+  std::string performances = "[\n";
+  for (size_t event = 0; events.size() + performances.size() < target_size; event++) {
+    uint32_t event_id = 138586341 + event * 4;
+    appendf(events, "%s\"%u\": {\"description\": null, \"id\": %u, \"logo\": %s, "
+            "\"name\": \"%s %s\", \"subTopicIds\": [", event ? ",\n" : "", event_id, event_id,
+            random.below(3) ? "null" : "\"/images/UE0AAAAACEKo6QAAAAVDSVRN\"",
+            random.pick(kWords), random.pick(kWords));
+    for (uint32_t i = 0, num = 1 + random.below(4); i < num; i++) {
+      appendf(events, "%s%u", i ? ", " : "", 337184262 + random.below(100));
+    }
+    events += "], \"subjectCode\": null, \"subtitle\": null, \"topicIds\": [";
+    for (uint32_t i = 0, num = 1 + random.below(3); i < num; i++) {
+      appendf(events, "%s%u", i ? ", " : "", 324846098 + random.below(100));
+    }
+    events += "]}";
+
+    appendf(performances, "%s{\"eventId\": %u, \"id\": %u, \"logo\": null, \"name\": null, "
+            "\"prices\": [", event ? ",\n" : "", event_id, 339887544 + random.below(100000));
+    uint32_t categories = 1 + random.below(4);
+    for (uint32_t i = 0; i < categories; i++) {
+      appendf(performances, "%s{\"amount\": %u, \"audienceSubCategoryId\": 337100890, "
+              "\"seatCategoryId\": %u}", i ? ", " : "", 10000 + random.below(90000) * 10,
+              338937290 + i);
+    }
+    performances += "], \"seatCategories\": [";
+    for (uint32_t i = 0; i < categories; i++) {
+      appendf(performances, "%s{\"areas\": [{\"areaId\": %u, \"blockIds\": []}, "
+              "{\"areaId\": %u, \"blockIds\": []}], \"seatCategoryId\": %u}", i ? ", " : "",
+              205705993 + random.below(20), 205705993 + random.below(20), 338937290 + i);
+    }
+    appendf(performances, "], \"seatMapImage\": null, \"start\": %llu, "
+            "\"venueCode\": \"PLEYEL_PLEYEL\"}",
+            (unsigned long long)(1372701600000ull + random.below(100000) * 1000ull));
+  }
+  return "{\"events\": " + events + "\n}, \"performances\": " + performances +
+         "\n], \"venueNames\": {\"PLEYEL_PLEYEL\": \"Salle Pleyel\"}}\n";
+}
+
+std::string makeCorpus(const std::string& kind, size_t target_size, uint32_t seed) {
+  CorpusRandom random(seed);
+  if (kind == "deep") {
+    return makeDeep(target_size, random);
+  } else if (kind == "wide") {
+    return makeWide(target_size, random);
+  } else if (kind == "numeric") {
+    return makeNumeric(target_size, random);
+  } else if (kind == "strings") {
+    return makeStrings(target_size, random);
+  } else if (kind == "twitter") {
+    return makeTwitter(target_size, random);
+  } else if (kind == "citm") {
+    return makeCitm(target_size, random);
+  }
+  return std::string();
+}
+
+std::vector<Corpus> makeCorpora(size_t target_size, uint32_t seed) {
+  std::vector<Corpus> corpora;
+  for (const char* kind : {"deep", "wide", "numeric", "strings", "twitter", "citm"}) {
+    corpora.push_back({kind, makeCorpus(kind, target_size, seed)});
+  }
+  return corpora;
+}
@@ -0,0 +1,28 @@
+#ifndef __CORPUS_H
+#define __CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reproducible benchmark inputs. A corpus is generated from a fixed seed, so
+// the same kind and size always give byte-identical text and results from
+// different builds can be compared.
+//
+//   deep     arrays and objects nested ~500 levels, repeated
+//   wide     objects with 256 members each
+//   numeric  coordinate pairs and integer arrays, canada.json like
+//   strings  string values with escapes and multi-byte UTF-8
+//   twitter  status objects with users, entities and 64-bit ids
+//   citm     citm_catalog like: maps keyed by ids, small ints everywhere
+struct Corpus {
+  std::string name;
+  std::string text;
+};
+
+// target_size is approximate, generation stops at the first record past it
+std::string makeCorpus(const std::string& kind, size_t target_size, uint32_t seed = 42);
+// every kind above, in that order
+std::vector<Corpus> makeCorpora(size_t target_size, uint32_t seed = 42);
+
+#endif
@@ -0,0 +1,53 @@
+#include "document.h"
+#include <thread>
+
+JsonDocument::JsonDocument(Json&& root): block(new Block) {
+  block->root = std::move(root);
+}
+
+const Json& JsonDocument::root() const {
+  static const Json null;
+  return block ? block->root : null;
+}
+
+AtomicJsonDocument::AtomicJsonDocument(JsonDocument initial) {
+  current.store(initial.block);
+  initial.block = nullptr;
+}
+
+AtomicJsonDocument::~AtomicJsonDocument() {
+  // nobody may load() any more, the last reference can go
+  JsonDocument last(current.load());
+}
+
+JsonDocument AtomicJsonDocument::load() const {
+  uint64_t seen;
+  while (true) {
+    seen = epoch.load();
+    readers[seen & 1].count.fetch_add(1);
+    // still the same epoch: a store() flipping it after this point waits
+    // for us before it drops the block we are about to read
+    if (epoch.load() == seen) {
+      break;
+    }
+    readers[seen & 1].count.fetch_sub(1);
+  }
+  JsonDocument::Block* block = current.load();
+  if (block) {
+    block->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  readers[seen & 1].count.fetch_sub(1, std::memory_order_release);
+  return JsonDocument(block);
+}
+
+void AtomicJsonDocument::store(JsonDocument next) {
+  std::lock_guard<std::mutex> lock(writer);
+  JsonDocument::Block* old = current.exchange(next.block);
+  next.block = nullptr;
+  uint64_t previous = epoch.fetch_add(1);
+  // readers registered under the previous epoch may still be reading old
+  while (readers[previous & 1].count.load(std::memory_order_acquire) != 0) {
+    std::this_thread::yield();
+  }
+  JsonDocument released(old);
+}
@@ -0,0 +1,109 @@
+#ifndef __DOCUMENT_H
+#define __DOCUMENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include "json.h"
+
+// A frozen, immutable Json tree behind one reference counted handle, for
+// data parsed once and read from many threads (configuration and the like).
+// Copying a handle is one atomic increment, the tree itself is never copied,
+// and only const access is offered, so any number of threads may read one
+// document at the same time.
+class JsonDocument {
+public:
+  JsonDocument(): block(nullptr) {}
+  // takes the tree over; the caller keeps no handle that could write to it
+  explicit JsonDocument(Json&& root);
+  JsonDocument(const JsonDocument& other): block(other.block) {
+    if (block) {
+      block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  JsonDocument(JsonDocument&& other) noexcept: block(other.block) {
+    other.block = nullptr;
+  }
+  JsonDocument& operator=(JsonDocument other) noexcept {
+    std::swap(block, other.block);
+    return *this;
+  }
+  ~JsonDocument() {
+    release();
+  }
+
+  explicit operator bool() const {
+    return block != nullptr;
+  }
+  // the null value for an empty handle
+  const Json& root() const;
+  const Json& operator[](std::string_view key) const {
+    return root()[key];
+  }
+  const Json& operator[](size_t index) const {
+    return root()[index];
+  }
+  const Json& operator[](const char* key) const {
+    return root()[std::string_view(key)];
+  }
+  // handles sharing this document
+  uint32_t useCount() const {
+    return block ? block->refs.load(std::memory_order_relaxed) : 0;
+  }
+
+private:
+  friend class AtomicJsonDocument;
+  struct Block {
+    std::atomic<uint32_t> refs{1};
+    Json root;
+  };
+  explicit JsonDocument(Block* block): block(block) {}
+  void release() {
+    // acq_rel: the last owner must see every reader's accesses before delete
+    if (block && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete block;
+    }
+  }
+
+  Block* block;
+};
+
+// The current version of a document, replaced atomically (RCU style).
+//
+// load() hands out a snapshot handle without taking a lock: a reader marks
+// itself in the reader count of the current epoch, reads the pointer, takes
+// a reference and leaves. store() publishes the new pointer, flips the
+// epoch and waits until the readers of the old epoch have left; only then
+// is the old version's reference dropped, so a reader can never take a
+// reference on a freed block. Readers that already hold a snapshot keep it
+// for as long as they like and are never blocked by a swap. Writers are
+// serialized by a mutex and are the only side that ever waits.
+class AtomicJsonDocument {
+public:
+  AtomicJsonDocument() = default;
+  explicit AtomicJsonDocument(JsonDocument initial);
+  AtomicJsonDocument(const AtomicJsonDocument&) = delete;
+  AtomicJsonDocument& operator=(const AtomicJsonDocument&) = delete;
+  ~AtomicJsonDocument();
+
+  JsonDocument load() const;
+  void store(JsonDocument next);
+  // bumped by every store(); a reader holding a snapshot can compare it to
+  // decide whether load() would return something new
+  uint64_t version() const {
+    return epoch.load(std::memory_order_acquire);
+  }
+
+private:
+  // on their own cache lines, every load() writes to one of them
+  struct alignas(64) ReaderCount {
+    std::atomic<int64_t> count{0};
+  };
+  std::atomic<JsonDocument::Block*> current{nullptr};
+  std::atomic<uint64_t> epoch{0};
+  mutable ReaderCount readers[2];
+  std::mutex writer;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "parser.h"
+#include "writer.h"
+#include "cbor.h"
+#include "ondemand.h"
+#include <cstdlib>
+
+// libFuzzer entry point, built by -DJSON_PARSER_FUZZ=ON with clang:
+//   ./json_parser_fuzz -max_len=4096 corpus/
+// Any input must parse or fail cleanly; whatever parses must survive a
+// dump/parse round trip and a CBOR round trip unchanged. Inputs that once
+// broke that are kept in fuzz_regressions/, replay them with
+//   ./json_parser_fuzz fuzz_regressions/*
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  const char* text = reinterpret_cast<const char*>(data);
+  Parser parser(text, size);
+  JsonResult result = parser.parse();
+
+  // the lazy readers must stay inside the buffer whatever it holds
+  OnDemandDocument lazy(text, size);
+  for (auto iter = lazy.root().begin(); iter != lazy.root().end(); ++iter) {
+    (*iter).raw();
+  }
+  if (!result.ok()) {
+    return 0;
+  }
+
+  std::string dumped = result.value.dump();
+  Parser again(dumped.data(), dumped.size());
+  JsonResult reparsed = again.parse();
+  if (!reparsed.ok() || reparsed.value.dump() != dumped) {
+    abort();
+  }
+  std::string encoded;
+  cborEncode(result.value, encoded);
+  Json decoded;
+  if (!cborDecode(encoded.data(), encoded.size(), decoded) || decoded.dump() != dumped) {
+    abort();
+  }
+  return 0;
+}
@@ -1,185 +1,244 @@
 #include "json.h"
 #include <cassert>
+#include "writer.h"
+
+static thread_local uint64_t copy_count = 0;
+static thread_local uint64_t clone_count = 0;
+
+// payload pointer of str/array/map values, nullptr for scalars
+static std::atomic<uint32_t>* payloadRefs(const Json::Value& value) {
+  if (value.type == Json::Type::str_type && !value.small_size && value.data.str) {
+    return &value.data.str->refs;
+  } else if (value.type == Json::Type::array_type && value.data.array) {
+    return &value.data.array->refs;
+  } else if (value.type == Json::Type::map_type && value.data.map) {
+    return &value.data.map->refs;
+  }
+  return nullptr;
+}
+
+// hands back a payload this Json owns alone, cloning a shared one
+template <typename T>
+static T* unshare(T*& payload) {
+  if (payload == nullptr) {
+    payload = new T;
+  } else if (payload->refs.load(std::memory_order_acquire) != 1) {
+    T* copy = new T(*payload);
+    clone_count++;
+    if (payload->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete payload;
+    }
+    payload = copy;
+  }
+  return payload;
+}
+
+static_assert(sizeof(Json::Value) == 16 && offsetof(Json::Value, data) == 8,
+              "inline strings overlay small_text and data");
 
 Json::Json() {
   value.type = Type::null_type;
+  value.small_size = 0;
   value.data.value = 0;
 }
 
 Json::Json(const Json& other) {
-  std::cout << "construct copy" << std::endl;
-  Data data;
-  value.type = other.value.type;
-  if (value.type == Type::bool_type ||
-      value.type == Type::null_type ||
-      value.type == Type::num_type) {
-    value.data = other.value.data;
-  } else if (value.type == Type::str_type) {
-    if (other.value.data.str) {
-      data.str = new std::string;
-      *(data.str) = *(other.value.data.str);
-    } else {
-      data.str = nullptr;
-    }
-    value.data = data;
-  } else if (value.type == Type::array_type) {
-    if (other.value.data.array) {
-      data.array = new std::vector<Json>;
-      for (size_t i = 0; i < other.value.data.array->size(); i++) {
-        Json json = (*(other.value.data.array))[i];
-        data.array->emplace_back(json);
-      }
-    } else {
-      data.array = nullptr;
-    }
-    value.data = data;
-  } else {
-    if (other.value.data.map) {
-      data.map = new std::map<std::string, Json>;
-      for (auto iter = other.value.data.map->begin();
-                iter != other.value.data.map->end(); ++iter) {
-        std::string key = iter->first;
-        Json value = iter->second;
-        assert(data.map->insert({key, value}).second);
-      }
-    } else {
-      data.map = nullptr;
-    }
-    value.data = data;
+  copy_count++;
+  value = other.value;
+  if (auto* refs = payloadRefs(value)) {
+    refs->fetch_add(1, std::memory_order_relaxed);
   }
 }
 
-Json::Json(Json&& other) {
-  std::cout << "construct move" << std::endl;
-  value.type = other.value.type;
-  if (value.type == Type::bool_type ||
-      value.type == Type::null_type ||
-      value.type == Type::num_type) {
-    value.data = other.value.data;
-  } else if (value.type == Type::str_type) {
-    value.data.str = other.value.data.str;
-    other.value.data.str = nullptr;
-  } else if (value.type == Type::array_type) {
-    value.data.array = other.value.data.array;
-    other.value.data.array = nullptr;
-  } else {
-    value.data.map = other.value.data.map;
-    other.value.data.map = nullptr;
-  }
+Json::Json(Json&& other) noexcept {
+  value = other.value;
+  other.value.type = Type::null_type;
+  other.value.small_size = 0;
+  other.value.data.value = 0;
 }
 
 Json& Json::operator=(const Json& other) {
-  std::cout << "operator = copy assign" << std::endl;
   if (this != &other) {
-    clear();
-    Data data;
-    value.type = other.value.type;
-    if (value.type == Type::bool_type ||
-        value.type == Type::null_type ||
-        value.type == Type::num_type) {
-      value.data = other.value.data;
-    } else if (value.type == Type::str_type) {
-      if (other.value.data.str) {
-        data.str = new std::string;
-        *(data.str) = *(other.value.data.str);
-      } else {
-        data.str = nullptr;
-      }
-      value.data = data;
-    } else if (value.type == Type::array_type) {
-      if (other.value.data.array) {
-        data.array = new std::vector<Json>;
-        for (size_t i = 0; i < other.value.data.array->size(); i++) {
-          Json json = (*(other.value.data.array))[i];
-          data.array->emplace_back(json);
-        }
-      } else {
-        data.array = nullptr;
-      }
-      value.data = data;
-    } else {
-      if (other.value.data.map) {
-        data.map = new std::map<std::string, Json>;
-        for (auto iter = other.value.data.map->begin();
-                  iter != other.value.data.map->end(); ++iter) {
-          std::string key = iter->first;
-          Json value = iter->second;
-          assert(data.map->insert({key, value}).second);
-        }
-      } else {
-        data.map = nullptr;
-      }
-      value.data = data;
+    copy_count++;
+    if (auto* refs = payloadRefs(other.value)) {
+      refs->fetch_add(1, std::memory_order_relaxed);
     }
+    clear();
+    value = other.value;
   }
   return *this;
 }
 
-Json& Json::operator=(Json&& other) {
-  std::cout << "operator = move assign" << std::endl;
+Json& Json::operator=(Json&& other) noexcept {
   if (this != &other) {
     clear();
-    value.type = other.value.type;
-    if (value.type == Type::bool_type ||
-        value.type == Type::null_type ||
-        value.type == Type::num_type) {
-      value.data = other.value.data;
-    } else if (value.type == Type::str_type) {
-      value.data.str = other.value.data.str;
-      other.value.data.str = nullptr;
-    } else if (value.type == Type::array_type) {
-      value.data.array = other.value.data.array;
-      other.value.data.array = nullptr;
-    } else {
-      value.data.map = other.value.data.map;
-      other.value.data.map = nullptr;
-    }
+    value = other.value;
+    other.value.type = Type::null_type;
+    other.value.small_size = 0;
+    other.value.data.value = 0;
   }
   return *this;
 }
 
+double Json::getNumber() const {
+  if (value.type == Type::int_type) {
+    return double(value.data.integer);
+  } else if (value.type == Type::uint_type) {
+    return double(value.data.uinteger);
+  } else if (value.type == Type::num_type) {
+    return value.data.value;
+  }
+  return 0.0;
+}
+
+void Json::setString(std::string_view str) {
+  clear();
+  value.type = Type::str_type;
+  if (str.size() <= kSmallString) {
+    memcpy(smallText(), str.data(), str.size());
+    value.small_size = uint8_t(str.size() + 1);
+  } else {
+    value.data.str = new JsonString(str);
+  }
+}
+
+void Json::setString(std::string&& str) {
+  if (str.size() <= kSmallString) {
+    setString(std::string_view(str));
+    return;
+  }
+  clear();
+  value.type = Type::str_type;
+  value.data.str = new JsonString(std::move(str));
+}
+
+int64_t Json::getInt() const {
+  if (value.type == Type::int_type) {
+    return value.data.integer;
+  } else if (value.type == Type::uint_type) {
+    return int64_t(value.data.uinteger);
+  } else if (value.type == Type::num_type) {
+    return int64_t(value.data.value);
+  }
+  return 0;
+}
+
+size_t Json::size() const {
+  if (value.type == Type::array_type && value.data.array) {
+    return value.data.array->size();
+  } else if (value.type == Type::map_type && value.data.map) {
+    return value.data.map->size();
+  }
+  return 0;
+}
+
+const Json* Json::find(std::string_view key) const {
+  if (value.type != Type::map_type || !value.data.map) {
+    return nullptr;
+  }
+  return static_cast<const JsonObject*>(value.data.map)->find(key);
+}
+
+const Json* Json::at(size_t index) const {
+  if (value.type != Type::array_type || !value.data.array || index >= value.data.array->size()) {
+    return nullptr;
+  }
+  return &(*value.data.array)[index];
+}
+
+// what a missing member reads as; built once, never written
+static const Json& nullJson() {
+  static const Json null;
+  return null;
+}
+
+const Json& Json::operator[](std::string_view key) const {
+  const Json* found = find(key);
+  return found ? *found : nullJson();
+}
+
+const Json& Json::operator[](size_t index) const {
+  const Json* found = at(index);
+  return found ? *found : nullJson();
+}
+
+std::string Json::dump(bool pretty) const {
+  std::string out;
+  dump(out, pretty);
+  return out;
+}
+
+void Json::dump(std::string& out, bool pretty) const {
+  JsonWriter writer(out, pretty);
+  writer.write(*this);
+}
+
+std::string& Json::mutableString() {
+  assert(value.type == Type::str_type);
+  if (value.small_size) {
+    // mutable text needs a std::string, move it out of line
+    JsonString* heap = new JsonString(getString());
+    value.small_size = 0;
+    value.data.str = heap;
+    return *heap;
+  }
+  return *unshare(value.data.str);
+}
+
+std::vector<Json>& Json::mutableArray() {
+  assert(value.type == Type::array_type);
+  return *unshare(value.data.array);
+}
+
+JsonObject& Json::mutableObject() {
+  assert(value.type == Type::map_type);
+  return *unshare(value.data.map);
+}
+
+uint64_t Json::copies() {
+  return copy_count;
+}
+
+uint64_t Json::clones() {
+  return clone_count;
+}
+
 void Json::clear() {
-  if (value.type == Type::str_type) {
-    if (value.data.str != nullptr) {
+  std::atomic<uint32_t>* refs = payloadRefs(value);
+  if (refs && refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    if (value.type == Type::str_type) {
       delete value.data.str;
-      value.data.str = nullptr;
-    }
-  } else if (value.type == Type::array_type) {
-    if (value.data.array != nullptr) {
-      for (auto& elem: *(value.data.array)) {
-        elem.~Json();
-      }
+    } else if (value.type == Type::array_type) {
       delete value.data.array;
-      value.data.array = nullptr;
-    }
-  } else if (value.type == Type::map_type) {
-    if (value.data.map != nullptr) {
-      for (auto& elem: *(value.data.map)) {
-        elem.second.~Json();
-      }
+    } else {
       delete value.data.map;
-      value.data.map = nullptr;
     }
   }
+  value.type = Type::null_type;
+  value.small_size = 0;
+  value.data.value = 0;
 }
-std::ostream& Json::printWithIndent(int64_t& indent) {
+
+std::ostream& Json::printWithIndent(int64_t indent) const {
   for (int64_t i = 0; i < indent; i++) {
     std::cerr << " ";
   }
   return std::cerr;
 }
 
-void Json::printImpl(int64_t& indent) {
+void Json::printImpl(int64_t indent) const {
   if (value.type == Type::bool_type) {
     std::cerr << value.data.flag;
   } else if (value.type == Type::null_type) {
     std::cerr << "null";
   } else if (value.type == Type::num_type) {
     std::cerr << value.data.value;
+  } else if (value.type == Type::int_type) {
+    std::cerr << value.data.integer;
+  } else if (value.type == Type::uint_type) {
+    std::cerr << value.data.uinteger;
   } else if (value.type == Type::str_type) {
-    if (value.data.str) {
-      std::cerr << *(value.data.str);
-    }
+    std::cerr << getString();
   } else if (value.type == Type::array_type) {
     if (value.data.array) {
       std::cerr<< "[" << "\n";
@@ -217,8 +276,105 @@ void Json::printImpl(int64_t& indent) {
   }
 }
 
-void Json::print() {
-  int64_t indent = 0;
-  printImpl(indent);
+void Json::print() const {
+  printImpl(0);
   std::cerr << std::endl;
+}
+
+int64_t JsonObject::lookup(std::string_view key, uint32_t hash) const {
+  if (index.empty()) {
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (hashes[i] == hash && entries[i].first == key) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  size_t mask = index.size() - 1;
+  for (size_t slot = hash & mask; index[slot] != 0; slot = (slot + 1) & mask) {
+    uint32_t pos = index[slot] - 1;
+    if (hashes[pos] == hash && entries[pos].first == key) {
+      return pos;
+    }
+  }
+  return -1;
+}
+
+void JsonObject::addToIndex(uint32_t hash, uint32_t pos) {
+  size_t mask = index.size() - 1;
+  size_t slot = hash & mask;
+  while (index[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  index[slot] = pos + 1;
+}
+
+void JsonObject::rebuildIndex(size_t slots) {
+  index.assign(slots, 0);
+  for (size_t i = 0; i < entries.size(); i++) {
+    addToIndex(hashes[i], i);
+  }
+}
+
+JsonKey JsonStringTable::intern(std::string_view text) {
+  uint32_t hash = JsonKey::hashOf(text);
+  if ((count + 1) * 2 > slots.size() && count < kMaxKeys) {
+    std::vector<JsonKey> old = std::move(slots);
+    slots.assign(old.empty() ? 64 : old.size() * 2, JsonKey());
+    size_t mask = slots.size() - 1;
+    for (JsonKey& key : old) {
+      if (key.rep) {
+        size_t slot = key.hash() & mask;
+        while (slots[slot].rep) {
+          slot = (slot + 1) & mask;
+        }
+        slots[slot] = std::move(key);
+      }
+    }
+  }
+  size_t mask = slots.size() - 1;
+  size_t slot = hash & mask;
+  for (; slots[slot].rep; slot = (slot + 1) & mask) {
+    if (slots[slot].hash() == hash && slots[slot] == text) {
+      return slots[slot];
+    }
+  }
+  if (count >= kMaxKeys) {
+    return JsonKey(text, hash);
+  }
+  slots[slot] = JsonKey(text, hash);
+  count++;
+  return slots[slot];
+}
+
+Json* JsonObject::find(std::string_view key) {
+  int64_t pos = lookup(key, JsonKey::hashOf(key));
+  return pos < 0 ? nullptr : &entries[pos].second;
+}
+
+const Json* JsonObject::find(std::string_view key) const {
+  int64_t pos = lookup(key, JsonKey::hashOf(key));
+  return pos < 0 ? nullptr : &entries[pos].second;
+}
+
+std::pair<Json*, bool> JsonObject::insert(JsonKey key, Json&& value) {
+  uint32_t hash = key.hash();
+  int64_t pos = lookup(key, hash);
+  if (pos >= 0) {
+    return {&entries[pos].second, false};
+  }
+  entries.emplace_back(std::move(key), std::move(value));
+  hashes.push_back(hash);
+  if (!index.empty() && entries.size() * 2 <= index.size()) {
+    addToIndex(hash, entries.size() - 1);
+  } else if (entries.size() >= kIndexThreshold) {
+    // keep the load factor at or below one half
+    size_t slots = index.empty() ? kIndexThreshold * 4 : index.size() * 2;
+    rebuildIndex(slots);
+  }
+  return {&entries.back().second, true};
+}
+
+Json& JsonObject::operator[](JsonKey key) {
+  return *insert(std::move(key), Json()).first;
 }
\ No newline at end of file
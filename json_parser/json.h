@@ -1,35 +1,69 @@
 #ifndef __JSON_H
 #define __JSON_H
 
+#include <atomic>
+#include <cstddef>
+#include <new>
 #include <string>
 #include <vector>
 #include <cstring>
-#include <map>
+#include <string_view>
 #include <iostream>
 
+class Json;
+class JsonObject;
+
+// Heap payload of string, array and object values. Copying a Json shares the
+// payload and bumps refs; the mutable accessors on Json clone a payload that
+// is still shared before handing it out (copy on write). The count is atomic
+// so frozen documents can be copied from several threads.
+template <typename T>
+struct JsonShared : public T {
+  using T::T;
+  JsonShared() = default;
+  JsonShared(const JsonShared& other): T(other) {}
+  explicit JsonShared(const T& other): T(other) {}
+  explicit JsonShared(T&& other): T(std::move(other)) {}
+  std::atomic<uint32_t> refs{1};
+};
+
+using JsonString = JsonShared<std::string>;
+using JsonArray = JsonShared<std::vector<Json>>;
+using JsonMap = JsonShared<JsonObject>;
+
 class Json {
 public:
-  enum class Type
+  enum class Type : uint8_t
   {
     num_type,
     str_type,
     bool_type,
     array_type,
     map_type,
-    null_type
+    null_type,
+    int_type,
+    uint_type
   };
   union Data
   {
     bool flag;
     double value;
-    std::string* str;
-    std::vector<Json>* array;
-    std::map<std::string, Json>* map;
+    int64_t integer;
+    uint64_t uinteger;
+    JsonString* str;
+    JsonArray* array;
+    JsonMap* map;
   };
+  // A string of up to kSmallString bytes is stored inline: its text starts
+  // at small_text and runs on over data, small_size holds its length + 1.
+  // small_size is 0 for every other value, including heap strings.
   struct Value{
     Type type;
+    uint8_t small_size;
+    char small_text[6];
     Data data;
   };
+  static constexpr size_t kSmallString = sizeof(Value) - offsetof(Value, small_text);
   void setType(Type type) {
     value.type = type;
   }
@@ -37,22 +71,237 @@ public:
     value.data = data;
   }
   Json();
+  // copies share the payload, see JsonShared
   Json(const Json& other);
 
   Json& operator=(const Json& other);
 
-  Json(Json&& other);
+  Json(Json&& other) noexcept;
 
-  Json& operator=(Json&& other);
+  Json& operator=(Json&& other) noexcept;
+  Type getType() const {
+    return value.type;
+  }
+  bool isNull() const {
+    return value.type == Type::null_type;
+  }
+  bool isNumber() const {
+    return value.type == Type::num_type || value.type == Type::int_type ||
+           value.type == Type::uint_type;
+  }
+  // any of the three number representations widened to double
+  double getNumber() const;
+  // integer value, doubles truncated; 0 for anything that is not a number
+  int64_t getInt() const;
+  bool getBool() const {
+    return value.type == Type::bool_type && value.data.flag;
+  }
+  // text of a str_type value, wherever it is stored
+  std::string_view getString() const {
+    if (value.small_size) {
+      return std::string_view(smallText(), value.small_size - 1);
+    }
+    return value.data.str ? std::string_view(*value.data.str) : std::string_view();
+  }
+  // turns this into a string value; short text goes inline, without a heap
+  // payload, longer text is moved into one
+  void setString(std::string_view str);
+  void setString(std::string&& str);
+  void setString(const char* str) {
+    setString(std::string_view(str));
+  }
+  // write access to the payload, unshared first if another Json refers to it
+  std::string& mutableString();
+  std::vector<Json>& mutableArray();
+  JsonObject& mutableObject();
+  // Json copies and payload clones made by the calling thread so far
+  static uint64_t copies();
+  static uint64_t clones();
   void clear();
-  void print();
-  void printImpl(int64_t& indent);
-  std::ostream& printWithIndent(int64_t& indent);
+  // serialize as JSON text; the second form appends to out, so a reused
+  // string keeps its capacity between documents.
+  std::string dump(bool pretty = false) const;
+  void dump(std::string& out, bool pretty = false) const;
+  // Read-only navigation. These never allocate or touch reference counts,
+  // so any number of threads may call them on a tree nobody writes to.
+  // element count of an array or object, 0 otherwise
+  size_t size() const;
+  // member of an object, nullptr if missing or not an object
+  const Json* find(std::string_view key) const;
+  // element of an array, nullptr if out of range or not an array
+  const Json* at(size_t index) const;
+  // like find/at but a missing value reads as null, so lookups chain:
+  // config["server"]["port"].getInt()
+  const Json& operator[](std::string_view key) const;
+  const Json& operator[](size_t index) const;
+  const Json& operator[](const char* key) const {
+    return (*this)[std::string_view(key)];
+  }
+  void print() const;
+  void printImpl(int64_t indent) const;
+  std::ostream& printWithIndent(int64_t indent) const;
   ~Json() {
     clear();
   }
 // private:
   Value value; 
+
+private:
+  // the inline bytes are read and written through the object representation
+  // of value, which is trivially copyable
+  const char* smallText() const {
+    return reinterpret_cast<const char*>(&value) + offsetof(Value, small_text);
+  }
+  char* smallText() {
+    return reinterpret_cast<char*>(&value) + offsetof(Value, small_text);
+  }
+};
+
+// Object key: immutable text and its hash behind one refcounted pointer.
+// Copies share the text; the parser hands out keys through a JsonStringTable,
+// so the "id" of every record in an array is one allocation.
+class JsonKey {
+public:
+  JsonKey(): rep(nullptr) {}
+  JsonKey(std::string_view text): JsonKey(text, hashOf(text)) {}
+  JsonKey(const std::string& text): JsonKey(std::string_view(text)) {}
+  JsonKey(const char* text): JsonKey(std::string_view(text)) {}
+  JsonKey(const JsonKey& other): rep(other.rep) {
+    if (rep) {
+      rep->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  JsonKey(JsonKey&& other) noexcept: rep(other.rep) {
+    other.rep = nullptr;
+  }
+  JsonKey& operator=(JsonKey other) noexcept {
+    std::swap(rep, other.rep);
+    return *this;
+  }
+  ~JsonKey() {
+    if (rep && rep->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      rep->~Rep();
+      ::operator delete(rep);
+    }
+  }
+
+  const char* data() const {
+    return rep ? rep->text() : "";
+  }
+  size_t size() const {
+    return rep ? rep->size : 0;
+  }
+  std::string_view view() const {
+    return std::string_view(data(), size());
+  }
+  operator std::string_view() const {
+    return view();
+  }
+  uint32_t hash() const {
+    return rep ? rep->hash : hashOf(std::string_view());
+  }
+  bool operator==(std::string_view other) const {
+    return view() == other;
+  }
+  bool operator!=(std::string_view other) const {
+    return view() != other;
+  }
+  static uint32_t hashOf(std::string_view text) {
+    return static_cast<uint32_t>(std::hash<std::string_view>{}(text));
+  }
+
+private:
+  friend class JsonStringTable;
+  struct Rep {
+    std::atomic<uint32_t> refs{1};
+    uint32_t hash;
+    size_t size;
+    // the text follows the header in the same allocation
+    char* text() {
+      return reinterpret_cast<char*>(this + 1);
+    }
+  };
+  JsonKey(std::string_view text, uint32_t hash) {
+    rep = new (::operator new(sizeof(Rep) + text.size())) Rep;
+    rep->hash = hash;
+    rep->size = text.size();
+    memcpy(rep->text(), text.data(), text.size());
+  }
+  Rep* rep;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const JsonKey& key) {
+  return os << key.view();
+}
+
+// Dedups object keys while documents are parsed: intern() returns the key
+// already handed out for the same text. Every Parser owns one, so keys are
+// shared within a document or a whole NDJSON chunk. The table stops taking
+// new keys at kMaxKeys so documents keyed by ids cannot grow it unbounded.
+class JsonStringTable {
+public:
+  static constexpr size_t kMaxKeys = 1 << 16;
+  JsonKey intern(std::string_view text);
+  size_t size() const {
+    return count;
+  }
+
+private:
+  // power of two sized, a null JsonKey marks a free slot
+  std::vector<JsonKey> slots;
+  size_t count = 0;
+};
+
+// Object storage. Entries keep insertion order in one vector, so iteration
+// matches the source document. Small objects are searched linearly (hashes
+// are compared before keys); once an object reaches kIndexThreshold entries
+// an open-addressing table with linear probing maps hashes to positions.
+class JsonObject {
+public:
+  using Entry = std::pair<JsonKey, Json>;
+  using iterator = std::vector<Entry>::iterator;
+  using const_iterator = std::vector<Entry>::const_iterator;
+  static constexpr size_t kIndexThreshold = 16;
+
+  size_t size() const {
+    return entries.size();
+  }
+  bool empty() const {
+    return entries.empty();
+  }
+  iterator begin() {
+    return entries.begin();
+  }
+  iterator end() {
+    return entries.end();
+  }
+  const_iterator begin() const {
+    return entries.begin();
+  }
+  const_iterator end() const {
+    return entries.end();
+  }
+  void reserve(size_t size) {
+    entries.reserve(size);
+    hashes.reserve(size);
+  }
+
+  Json* find(std::string_view key);
+  const Json* find(std::string_view key) const;
+  // inserts key unless it exists; the flag tells whether it was inserted
+  std::pair<Json*, bool> insert(JsonKey key, Json&& value);
+  // default constructs a null value for a missing key, like std::map
+  Json& operator[](JsonKey key);
+
+private:
+  int64_t lookup(std::string_view key, uint32_t hash) const;
+  void addToIndex(uint32_t hash, uint32_t pos);
+  void rebuildIndex(size_t slots);
+
+  std::vector<Entry> entries;
+  std::vector<uint32_t> hashes;
+  // slot holds entry position + 1, 0 marks an empty slot
+  std::vector<uint32_t> index;
 };
 
 
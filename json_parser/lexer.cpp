@@ -1,20 +1,85 @@
 #include "lexer.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const char* JsonError::message() const {
+  switch (code) {
+    case JsonErrc::ok:
+      return "ok";
+    case JsonErrc::io_error:
+      return "cannot read input";
+    case JsonErrc::unexpected_char:
+      return "unexpected character";
+    case JsonErrc::unterminated_string:
+      return "unterminated string";
+    case JsonErrc::control_char:
+      return "control character in string";
+    case JsonErrc::bad_escape:
+      return "invalid escape sequence";
+    case JsonErrc::bad_unicode:
+      return "invalid \\u escape or unpaired surrogate";
+    case JsonErrc::bad_utf8:
+      return "invalid UTF-8";
+    case JsonErrc::bad_number:
+      return "invalid number";
+    case JsonErrc::bad_literal:
+      return "invalid literal";
+    case JsonErrc::unexpected_token:
+      return "unexpected token";
+    case JsonErrc::unexpected_eof:
+      return "unexpected end of input";
+    case JsonErrc::too_deep:
+      return "nesting too deep";
+    case JsonErrc::trailing_content:
+      return "trailing content after the document";
+  }
+  return "unknown error";
+}
+
+std::string JsonError::toString() const {
+  return std::to_string(row) + ":" + std::to_string(col) + ": " + message();
+}
 
 Lexer::Lexer(std::string &filepath) : fr(filepath, std::ios::in | std::ios::binary) {
-  assert(fr.is_open());
+  row = 0;
+  buffer = nullptr;
+  start = nullptr;
+  begin = nullptr;
+  end = nullptr;
+  limit = nullptr;
+  line_begin = nullptr;
+  token_begin = nullptr;
+  if (!fr.is_open()) {
+    curr_tok = failAt(JsonErrc::io_error, nullptr);
+    return;
+  }
   fr.seekg(0, std::ios::end);
   int64_t file_size = fr.tellg();
   fr.seekg(0, std::ios::beg);
-  std::cout << "file size: " << file_size << std::endl;
   buffer = (char *)malloc(file_size);
-  fr.read(buffer, file_size + 2);
+  fr.read(buffer, file_size);
   fr.close();
-  buffer[file_size] = '\n';
-  buffer[file_size + 1] = EOF;
-  std::cout << "buffer : " << buffer << std::endl;
   start = buffer;
+  limit = buffer + file_size;
+  curr_tok = getNextToken();
+}
+
+Lexer::Lexer(const char* data, size_t size) {
+  buffer = nullptr;
+  reset(data, size);
+}
+
+void Lexer::reset(const char* data, size_t size) {
+  assert(buffer == nullptr);
+  row = 0;
+  start = data;
   begin = nullptr;
   end = nullptr;
+  limit = data + size;
+  line_begin = nullptr;
+  token_begin = nullptr;
+  error = JsonError();
   curr_tok = getNextToken();
 }
 
@@ -24,94 +89,364 @@ Lexer::~Lexer() {
   }
 }
 
+void Lexer::fail(JsonErrc code) {
+  if (curr_tok != tok_error) {
+    curr_tok = failAt(code, token_begin);
+  }
+}
+
+void Lexer::unexpected() {
+  fail(curr_tok == tok_eof ? JsonErrc::unexpected_eof : JsonErrc::unexpected_token);
+}
+
+void Lexer::recover() {
+  error = JsonError();
+  begin = end;
+  curr_tok = getNextToken();
+}
+
+Token Lexer::failAt(JsonErrc code, const char* at) {
+  error.code = code;
+  error.row = row;
+  error.col = at && line_begin ? at - line_begin + 1 : 0;
+  return tok_error;
+}
+
 Token Lexer::getNextToken() {
-  while(begin == nullptr || *begin == '\n' || (*begin == '\t' || *begin == ' ')) {
-    if (begin == nullptr || *begin == '\n') {
+  while(begin == nullptr || begin == end || *begin == '\t' || *begin == ' ' || *begin == '\r') {
+    if (begin == nullptr || begin == end) {
+      if (end == limit) {
+        token_begin = begin;
+        return tok_eof;
+      }
       getNextLine();
       row++;
-      col = 0;
+      continue;
     }
-    while(*begin == '\t' || *begin == ' ') {
-      begin++;
-      col++;
-      assert(begin <= end);
+    begin++;
+  }
+  token_begin = begin;
+  switch (*begin) {
+    case tok_double_quotation:
+      return getStringToken();
+    case tok_bracket_open:
+    case tok_bracket_close:
+    case tok_sbracket_open:
+    case tok_sbracket_close:
+    case tok_comma:
+    case tok_colon:
+      return Token(*begin++);
+    case 't':
+      return getLiteralToken("true", tok_true);
+    case 'f':
+      return getLiteralToken("false", tok_false);
+    case 'n':
+      return getLiteralToken("null", tok_null);
+  }
+  if (*begin == '-' || isDigit(*begin)) {
+    return getNumberToken();
+  }
+  return failAt(JsonErrc::unexpected_char, begin);
+}
+
+Token Lexer::getLiteralToken(const char* word, Token tok) {
+  size_t len = strlen(word);
+  if (size_t(end - begin) < len || memcmp(begin, word, len) != 0) {
+    return failAt(JsonErrc::bad_literal, begin);
+  }
+  begin += len;
+  return tok;
+}
+
+// first byte in [p, end) that is a quote, a backslash, a control character or
+// not ASCII; bytes below 0x20 and above 0x7f are both negative or small when
+// compared as signed, so one compare catches the last two.
+static const char* scanPlain(const char* p, const char* end) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmplt_epi8(chunk, space));
+    int mask = _mm_movemask_epi8(special);
+    if (mask) {
+      return p + __builtin_ctz(mask);
     }
+    p += 16;
   }
-  if (*end == EOF) {
-    return tok_eof;
+#endif
+  while (p != end && *p != '"' && *p != '\\' && int8_t(*p) >= 0x20) {
+    p++;
   }
-  assert(begin != nullptr);
-  if(*begin == Token::tok_double_quotation) {
-    str.clear();
-    begin++;
-    col++;
-    while(*begin != tok_double_quotation && begin != end ) {
-      str += *begin;
-      begin++;
-      col++;
+  return p;
+}
+
+// length of the well formed UTF-8 sequence at p (RFC 3629: no overlong
+// forms, no surrogates, nothing above U+10FFFF), 0 if there is none
+static size_t utf8Sequence(const char* p, const char* end) {
+  const uint8_t* s = reinterpret_cast<const uint8_t*>(p);
+  uint8_t lo = 0x80;
+  uint8_t hi = 0xbf;
+  size_t len;
+  if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+    len = 2;
+  } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+    len = 3;
+    lo = s[0] == 0xe0 ? 0xa0 : 0x80;
+    hi = s[0] == 0xed ? 0x9f : 0xbf;
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    len = 4;
+    lo = s[0] == 0xf0 ? 0x90 : 0x80;
+    hi = s[0] == 0xf4 ? 0x8f : 0xbf;
+  } else {
+    return 0;
+  }
+  if (size_t(end - p) < len || s[1] < lo || s[1] > hi) {
+    return 0;
+  }
+  for (size_t i = 2; i < len; i++) {
+    if ((s[i] & 0xc0) != 0x80) {
+      return 0;
     }
-    assert(*begin == tok_double_quotation);
-    begin++;
-    col++;
-    return tok_string;
-  } else if (*begin == tok_bracket_open) {
-    begin++;
-    col++;
-    return tok_bracket_open;
-  } else if (*begin == tok_bracket_close) {
-    begin++;
-    col++;
-    return tok_bracket_close;
-  } else if (*begin == tok_sbracket_open) {
-    begin++;
-    return tok_sbracket_open;
-  } else if (*begin == tok_sbracket_close) {
-    begin++;
-    col++;
-    return tok_sbracket_close;
-  } else if (*begin == tok_comma) {
-    begin++;
-    col++;
-    return tok_comma;
-  } else if (*begin == tok_colon) {
-    begin++;
-    col++;
-    return tok_colon;
-  } else if (isalnum(*begin)) {
-    str.clear();
-    str += *begin;
-    begin++;
-    col++;
-    while(isalnum(*begin) || *begin == '.') {
-      str += *begin;
-      begin++;
-      col++;
+  }
+  return len;
+}
+
+static void appendUtf8(std::string& str, uint32_t code) {
+  if (code < 0x80) {
+    str += char(code);
+  } else if (code < 0x800) {
+    str += char(0xc0 | (code >> 6));
+    str += char(0x80 | (code & 0x3f));
+  } else if (code < 0x10000) {
+    str += char(0xe0 | (code >> 12));
+    str += char(0x80 | ((code >> 6) & 0x3f));
+    str += char(0x80 | (code & 0x3f));
+  } else {
+    str += char(0xf0 | (code >> 18));
+    str += char(0x80 | ((code >> 12) & 0x3f));
+    str += char(0x80 | ((code >> 6) & 0x3f));
+    str += char(0x80 | (code & 0x3f));
+  }
+}
+
+// four hex digits after "\u", -1 if malformed
+static int64_t hex4(const char* p, const char* end) {
+  if (end - p < 4) {
+    return -1;
+  }
+  int64_t code = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = p[i];
+    int digit = c >= '0' && c <= '9' ? c - '0'
+              : c >= 'a' && c <= 'f' ? c - 'a' + 10
+              : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (digit < 0) {
+      return -1;
     }
-    if (str == "false") {
-      return tok_false;
+    code = code * 16 + digit;
+  }
+  return code;
+}
+
+// Strings are copied in runs: the SIMD scan finds the next byte that needs a
+// look, everything in front of it is plain ASCII and appended at once. Escapes
+// are decoded (\u surrogate pairs included) and non-ASCII bytes must form
+// valid UTF-8, so the validation rides on the scan the copy needs anyway.
+Token Lexer::getStringToken() {
+  str.clear();
+  const char* p = begin + 1;
+  while (true) {
+    const char* run = p;
+    p = scanPlain(p, end);
+    str.append(run, p - run);
+    if (p == end) {
+      return failAt(JsonErrc::unterminated_string, token_begin);
     }
-    if (str == "true") {
-      return tok_true;
+    if (*p == '"') {
+      break;
     }
-    if (str == "null") {
-      return tok_null;
+    if (*p == '\\') {
+      if (end - p < 2) {
+        return failAt(JsonErrc::unterminated_string, token_begin);
+      }
+      char c = p[1];
+      p += 2;
+      switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+          str += c;
+          break;
+        case 'b':
+          str += '\b';
+          break;
+        case 'f':
+          str += '\f';
+          break;
+        case 'n':
+          str += '\n';
+          break;
+        case 'r':
+          str += '\r';
+          break;
+        case 't':
+          str += '\t';
+          break;
+        case 'u': {
+          int64_t code = hex4(p, end);
+          if (code < 0 || (code >= 0xdc00 && code <= 0xdfff)) {
+            return failAt(JsonErrc::bad_unicode, p - 2);
+          }
+          p += 4;
+          if (code >= 0xd800 && code <= 0xdbff) {
+            int64_t low = end - p >= 2 && p[0] == '\\' && p[1] == 'u' ? hex4(p + 2, end) : -1;
+            if (low < 0xdc00 || low > 0xdfff) {
+              return failAt(JsonErrc::bad_unicode, p - 6);
+            }
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            p += 6;
+          }
+          appendUtf8(str, uint32_t(code));
+          break;
+        }
+        default:
+          return failAt(JsonErrc::bad_escape, p - 2);
+      }
+    } else if (uint8_t(*p) < 0x20) {
+      return failAt(JsonErrc::control_char, p);
+    } else {
+      // validate the whole non-ASCII run before copying it
+      run = p;
+      do {
+        size_t len = utf8Sequence(p, end);
+        if (len == 0) {
+          return failAt(JsonErrc::bad_utf8, p);
+        }
+        p += len;
+      } while (p != end && int8_t(*p) < 0);
+      str.append(run, p - run);
     }
-    assert(isdigit(str[0]));
-    for (size_t i = 1; i < str.size(); i++) {
-      assert(isdigit(str[i]) || str[i] == '.');
+  }
+  begin = p + 1;
+  return tok_string;
+}
+
+// Numbers are decoded straight from the input bytes. Integers that fit are
+// kept exact as int64/uint64. Everything else becomes a double: through the
+// Clinger fast path when the decimal mantissa fits in 53 bits and the power
+// of ten is exact, through std::from_chars otherwise. Neither depends on the
+// locale and both round correctly.
+Token Lexer::getNumberToken() {
+  static constexpr double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* p = begin;
+  bool negative = *p == '-';
+  if (negative) {
+    p++;
+  }
+  if (p == end || !isDigit(*p)) {
+    return failAt(JsonErrc::bad_number, begin);
+  }
+  uint64_t mantissa = 0;
+  int64_t exp10 = 0;
+  // set once a digit no longer fits into mantissa
+  bool truncated = false;
+  if (*p == '0') {
+    p++;
+    if (p != end && isDigit(*p)) {
+      return failAt(JsonErrc::bad_number, begin);
     }
-    number = std::stod(str);
-    return tok_number;
   } else {
-    assert(false);
-    return tok_eof;
+    while (p != end && isDigit(*p)) {
+      uint64_t next;
+      if (truncated || __builtin_mul_overflow(mantissa, 10, &next) ||
+          __builtin_add_overflow(next, uint64_t(*p - '0'), &next)) {
+        truncated = true;
+        exp10++;
+      } else {
+        mantissa = next;
+      }
+      p++;
+    }
+  }
+  bool integral = true;
+  if (p != end && *p == '.') {
+    integral = false;
+    p++;
+    if (p == end || !isDigit(*p)) {
+      return failAt(JsonErrc::bad_number, begin);
+    }
+    while (p != end && isDigit(*p)) {
+      if (!truncated && mantissa < (UINT64_MAX - 9) / 10) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exp10--;
+      } else {
+        truncated = true;
+      }
+      p++;
+    }
   }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    integral = false;
+    p++;
+    bool exp_negative = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+      exp_negative = *p == '-';
+      p++;
+    }
+    if (p == end || !isDigit(*p)) {
+      return failAt(JsonErrc::bad_number, begin);
+    }
+    int64_t exp = 0;
+    while (p != end && isDigit(*p)) {
+      if (exp < 100000) {
+        exp = exp * 10 + (*p - '0');
+      }
+      p++;
+    }
+    exp10 += exp_negative ? -exp : exp;
+  }
+  const char* first = begin;
+  begin = p;
+
+  if (integral && !truncated) {
+    if (!negative && mantissa <= uint64_t(INT64_MAX)) {
+      integer = int64_t(mantissa);
+      return tok_int;
+    } else if (!negative) {
+      uinteger = mantissa;
+      return tok_uint;
+    } else if (mantissa <= uint64_t(INT64_MAX) + 1) {
+      integer = int64_t(0 - mantissa);
+      return tok_int;
+    }
+  }
+  if (!truncated && mantissa <= (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+    number = double(mantissa);
+    number = exp10 < 0 ? number / pow10[-exp10] : number * pow10[exp10];
+    number = negative ? -number : number;
+    return tok_number;
+  }
+  auto ret = std::from_chars(first, p, number);
+  if (ret.ec != std::errc() && ret.ec != std::errc::result_out_of_range) {
+    return failAt(JsonErrc::bad_number, first);
+  }
+  if (ret.ec == std::errc::result_out_of_range) {
+    number = exp10 > 0 ? HUGE_VAL : 0.0;
+    number = negative ? -number : number;
+  }
+  return tok_number;
 }
 
 void Lexer::getNextLine() {
   begin = start;
-  while(*start != EOF && *start != '\n') {
-    start++;
-  }
-  end = *start == '\n' ? start++ : start;
+  line_begin = start;
+  const char* newline = static_cast<const char*>(memchr(start, '\n', limit - start));
+  end = newline ? newline : limit;
+  start = newline ? newline + 1 : limit;
 }
\ No newline at end of file
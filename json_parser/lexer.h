@@ -3,6 +3,11 @@
 
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <charconv>
+#include <cmath>
 #include <assert.h>
 #include <iostream>
 
@@ -19,13 +24,59 @@ enum Token : int {
   tok_null = 3,
   tok_true = 4,
   tok_false = 5,
+  tok_int = 6,
+  tok_uint = 7,
 
   tok_eof = -1,
+  tok_error = -2,
 };
 
+enum class JsonErrc : int {
+  ok = 0,
+  io_error,
+  unexpected_char,
+  unterminated_string,
+  control_char,
+  bad_escape,
+  bad_unicode,
+  bad_utf8,
+  bad_number,
+  bad_literal,
+  unexpected_token,
+  unexpected_eof,
+  too_deep,
+  trailing_content,
+};
+
+// The first error found in the input. row and col are 1-based; col counts
+// bytes from the start of the line.
+struct JsonError {
+  JsonErrc code = JsonErrc::ok;
+  int64_t row = 0;
+  int64_t col = 0;
+
+  explicit operator bool() const {
+    return code != JsonErrc::ok;
+  }
+  const char* message() const;
+  // "row:col: message"
+  std::string toString() const;
+};
+
+// ASCII digit test on raw input bytes: unlike isdigit() it is defined for
+// bytes >= 0x80 in a plain char and does not depend on the locale
+inline bool isDigit(char c) {
+  return unsigned(c - '0') < 10;
+}
+
 class Lexer {
 public:
   Lexer(std::string& filepath);
+  // lex an external buffer in place, e.g. one mmap'ed chunk of a larger file;
+  // the bytes must outlive the lexer.
+  Lexer(const char* data, size_t size);
+  // starts over on another external buffer, as if newly constructed on it
+  void reset(const char* data, size_t size);
   Lexer() = delete;
   Lexer(const Lexer&) = delete;
   Lexer(Lexer&&) = delete;
@@ -36,38 +87,81 @@ public:
     return str;
   }
 
+  // the current string token without copying it, valid until the next one
+  std::string_view viewString() const {
+    return str;
+  }
+
+  // moves the current string token out instead of copying it
+  std::string takeString() {
+    return std::move(str);
+  }
+
   double getNumber() {
     return number;
   }
 
+  int64_t getInt() {
+    return integer;
+  }
+
+  uint64_t getUint() {
+    return uinteger;
+  }
+
   int64_t getRow() {
     return row;
   }
 
   int64_t getCol() {
-    return col;
+    return begin && line_begin ? begin - line_begin : 0;
   }
   Token getCurrentToken() const {
     return curr_tok;
   }
 
+  // malformed input turns the current token into tok_error, which then
+  // sticks until recover(); getError() tells what and where
   void consumerCurrnetToken() {
-    curr_tok = getNextToken();
+    if (curr_tok != tok_error) {
+      curr_tok = getNextToken();
+    }
+  }
+
+  const JsonError& getError() const {
+    return error;
   }
+  // reports an error at the current token, for callers that find it does not
+  // fit the grammar; the first error is kept
+  void fail(JsonErrc code);
+  // fail() with unexpected_eof or unexpected_token, whichever applies
+  void unexpected();
+  // clears the error and resumes at the next line, for inputs such as NDJSON
+  // where a line is a document of its own
+  void recover();
 
 private:
   Token getNextToken();
+  Token getStringToken();
+  Token getLiteralToken(const char* word, Token tok);
+  Token getNumberToken();
+  Token failAt(JsonErrc code, const char* at);
   void getNextLine();
   std::fstream fr;
   std::string current_line;
   int64_t row;
-  int64_t col;
   char* buffer;
-  char* start;
-  char* begin;
-  char* end;
+  const char* start;
+  const char* begin;
+  const char* end;
+  const char* limit;
+  const char* line_begin;
+  const char* token_begin;
+  JsonError error;
   std::string str;
   double number;
+  int64_t integer;
+  uint64_t uinteger;
   Token curr_tok;
 };
 
@@ -1,8 +1,59 @@
 #include "lexer.h"
 #include "parser.h"
+#include "ndjson.h"
+#include "query.h"
+#include <chrono>
 #include <iostream>
 
-int main() {
+// json_parser_demo --ndjson <file>: parse a JSON-lines file in parallel
+static int parseNdjson(std::string filename) {
+  auto t1 = std::chrono::steady_clock::now();
+  NdjsonParser bulk(filename);
+  size_t docs = 0;
+  for (auto iter = bulk.begin(); iter != bulk.end(); ++iter) {
+    docs++;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  double sec = std::chrono::duration<double>(t2 - t1).count();
+  std::cout << "ndjson docs: " << docs << " chunks: " << bulk.chunkNum()
+            << " time: " << sec << "s" << std::endl;
+  for (const JsonError& error : bulk.errors()) {
+    std::cerr << filename << ":" << error.toString() << std::endl;
+  }
+  return 0;
+}
+
+// json_parser_demo --query <pointer or path> <file>: print the matches found
+// on the parsed tree and then by streaming over the lexer
+static int runQuery(const char* expr, std::string filename) {
+  JsonQuery query(expr);
+  if (!query.valid()) {
+    std::cerr << "invalid query: " << query.error() << std::endl;
+    return 1;
+  }
+  Parser parser(filename);
+  JsonResult result = parser.parse();
+  if (!result.ok()) {
+    std::cerr << filename << ":" << result.error.toString() << std::endl;
+    return 1;
+  }
+  for (const Json* match : query.evaluate(result.value)) {
+    std::cout << "dom: " << match->dump() << std::endl;
+  }
+  Lexer lexer(filename);
+  query.stream(lexer, [](const Json& match) {
+    std::cout << "stream: " << match.dump() << std::endl;
+  });
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 3 && std::string(argv[1]) == "--ndjson") {
+    return parseNdjson(argv[2]);
+  }
+  if (argc == 4 && std::string(argv[1]) == "--query") {
+    return runQuery(argv[2], argv[3]);
+  }
   std::string filename{"./test.json"};
   // Lexer lexer(filename);
   // Token token;
@@ -40,7 +91,11 @@ int main() {
   // }
   // assert(token == tok_eof);
   Parser parser(filename);
-  Json json = parser.parser_all();
-  json.print();
+  JsonResult result = parser.parse();
+  if (!result.ok()) {
+    std::cerr << filename << ":" << result.error.toString() << std::endl;
+    return 1;
+  }
+  result.value.print();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "ndjson.h"
+#include <cassert>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "parser.h"
+#include "../threads_pool/threads_pool.h"
+
+NdjsonParser::NdjsonParser(std::string& filepath, size_t chunk_size) {
+  assert(chunk_size > 0);
+  file_size = 0;
+  mapped = nullptr;
+  fd = open(filepath.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    io_error.code = JsonErrc::io_error;
+    return;
+  }
+  if (st.st_size == 0) {
+    return;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    io_error.code = JsonErrc::io_error;
+    return;
+  }
+  mapped = static_cast<char*>(addr);
+  file_size = st.st_size;
+  madvise(mapped, file_size, MADV_SEQUENTIAL);
+
+  ThreadsPool* threads_pool = Singleton<ThreadsPool>::get_instance();
+  const char* limit = mapped + file_size;
+  const char* pos = mapped;
+  while (pos < limit) {
+    const char* stop = limit;
+    if (static_cast<size_t>(limit - pos) > chunk_size) {
+      // a chunk always ends right after a newline so no line is split
+      const char* newline = static_cast<const char*>(
+          memchr(pos + chunk_size, '\n', limit - pos - chunk_size));
+      stop = newline ? newline + 1 : limit;
+    }
+    auto chunk = std::make_unique<Chunk>();
+    chunk->data = pos;
+    chunk->size = stop - pos;
+    Chunk* raw = chunk.get();
+    chunk->done = threads_pool->submit([raw]() { parseChunk(raw); });
+    chunks.push_back(std::move(chunk));
+    pos = stop;
+  }
+}
+
+NdjsonParser::~NdjsonParser() {
+  // workers still read the mapping, let them finish first
+  for (auto& chunk : chunks) {
+    chunk->done.wait();
+  }
+  if (mapped) {
+    munmap(mapped, file_size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+size_t NdjsonParser::size() {
+  size_t num = 0;
+  for (auto& chunk : chunks) {
+    chunk->done.wait();
+    num += chunk->docs.size();
+  }
+  return num;
+}
+
+std::vector<JsonError> NdjsonParser::errors() {
+  std::vector<JsonError> all;
+  if (io_error) {
+    all.push_back(io_error);
+  }
+  int64_t rows = 0;
+  for (auto& chunk : chunks) {
+    chunk->done.wait();
+    for (JsonError error : chunk->errors) {
+      error.row += rows;
+      all.push_back(error);
+    }
+    rows += chunk->rows;
+  }
+  return all;
+}
+
+// Every line is lexed on its own, bounded at its newline, so a document can
+// neither run into the next line nor span several: a malformed line is
+// reported and costs only itself, and the result does not depend on where
+// the chunks were cut.
+void NdjsonParser::parseChunk(Chunk* chunk) {
+  Parser parser(chunk->data, 0);
+  int64_t rows = 0;
+  const char* pos = chunk->data;
+  const char* limit = chunk->data + chunk->size;
+  while (pos < limit) {
+    const char* newline = static_cast<const char*>(memchr(pos, '\n', limit - pos));
+    const char* stop = newline ? newline : limit;
+    parser.reset(pos, stop - pos);
+    // blank lines hold no document
+    if (!parser.finished() || parser.error()) {
+      JsonResult result = parser.parse();
+      if (result.error) {
+        result.error.row += rows;
+        chunk->errors.push_back(result.error);
+      } else {
+        chunk->docs.emplace_back(std::move(result.value));
+      }
+    }
+    if (!newline) {
+      break;
+    }
+    rows++;
+    pos = newline + 1;
+  }
+  chunk->rows = rows;
+}
+
+void NdjsonParser::iterator::skipEmpty() {
+  while (chunk < owner->chunks.size()) {
+    owner->chunks[chunk]->done.wait();
+    if (index < owner->chunks[chunk]->docs.size()) {
+      return;
+    }
+    chunk++;
+    index = 0;
+  }
+}
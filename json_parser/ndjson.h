@@ -0,0 +1,91 @@
+#ifndef __NDJSON_H
+#define __NDJSON_H
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "json.h"
+#include "lexer.h"
+
+// Bulk parser for newline-delimited JSON (one document per line).
+// The file is mmap'ed and cut into chunks at newline boundaries, every chunk
+// is parsed on the ThreadsPool into its own document vector, so workers never
+// share results. Iteration yields the documents in file order and only waits
+// for the chunk it is about to enter.
+class NdjsonParser {
+  struct Chunk {
+    const char* data;
+    size_t size;
+    std::vector<Json> docs;
+    // rows are relative to the chunk until errors() offsets them
+    std::vector<JsonError> errors;
+    int64_t rows;
+    std::future<void> done;
+  };
+
+public:
+  class iterator {
+  public:
+    iterator(NdjsonParser* owner, size_t chunk): owner(owner), chunk(chunk), index(0) {
+      skipEmpty();
+    }
+    Json& operator*() const {
+      return owner->chunks[chunk]->docs[index];
+    }
+    Json* operator->() const {
+      return &owner->chunks[chunk]->docs[index];
+    }
+    iterator& operator++() {
+      index++;
+      skipEmpty();
+      return *this;
+    }
+    bool operator==(const iterator& other) const {
+      return chunk == other.chunk && index == other.index;
+    }
+    bool operator!=(const iterator& other) const {
+      return !(*this == other);
+    }
+
+  private:
+    void skipEmpty();
+    NdjsonParser* owner;
+    size_t chunk;
+    size_t index;
+  };
+
+  NdjsonParser(std::string& filepath, size_t chunk_size = 4 << 20);
+  NdjsonParser(const NdjsonParser&) = delete;
+  NdjsonParser(NdjsonParser&&) = delete;
+  NdjsonParser& operator=(const NdjsonParser&) = delete;
+  NdjsonParser& operator=(NdjsonParser&&) = delete;
+  ~NdjsonParser();
+
+  iterator begin() {
+    return iterator(this, 0);
+  }
+  iterator end() {
+    return iterator(this, chunks.size());
+  }
+  size_t chunkNum() const {
+    return chunks.size();
+  }
+  // blocks until every chunk is parsed and returns the document count.
+  size_t size();
+  // blocks like size() and returns the lines that failed to parse, which are
+  // skipped by iteration; rows count lines of the whole file. A file that
+  // cannot be opened or mapped yields no documents and one io_error.
+  std::vector<JsonError> errors();
+
+private:
+  static void parseChunk(Chunk* chunk);
+
+  int fd;
+  char* mapped;
+  size_t file_size;
+  JsonError io_error;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include "ondemand.h"
+#include "lexer.h"
+#include "parser.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char* skipSpace(const char* p, const char* limit) {
+  while (p != limit && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+// first quote or backslash in [p, limit)
+static const char* findQuote(const char* p, const char* limit) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (limit - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p != limit && *p != '"' && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+// first quote or bracket in [p, limit); '[' | 0x20 == '{' and ']' | 0x20 == '}'
+static const char* findStructural(const char* p, const char* limit) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i open = _mm_set1_epi8('{');
+  const __m128i close = _mm_set1_epi8('}');
+  const __m128i lower = _mm_set1_epi8(0x20);
+  while (limit - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i folded = _mm_or_si128(chunk, lower);
+    int mask = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(chunk, quote),
+        _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close))));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p != limit && *p != '"' && (*p | 0x20) != '{' && (*p | 0x20) != '}') {
+    p++;
+  }
+  return p;
+}
+
+// p is on the opening quote, returns the byte after the closing one
+static const char* skipString(const char* p, const char* limit) {
+  p++;
+  while (true) {
+    p = findQuote(p, limit);
+    if (p == limit) {
+      return limit;
+    }
+    if (*p == '"') {
+      return p + 1;
+    }
+    // backslash: the escaped byte can't end the string
+    p += 2;
+    if (p >= limit) {
+      return limit;
+    }
+  }
+}
+
+// p is on the first byte of a value, returns the byte after it
+static const char* skipValue(const char* p, const char* limit) {
+  if (p == limit) {
+    return limit;
+  }
+  if (*p == '"') {
+    return skipString(p, limit);
+  }
+  if (*p == '{' || *p == '[') {
+    int64_t depth = 1;
+    p++;
+    while (depth > 0) {
+      p = findStructural(p, limit);
+      if (p == limit) {
+        return limit;
+      }
+      if (*p == '"') {
+        p = skipString(p, limit);
+      } else {
+        depth += *p == '{' || *p == '[' ? 1 : -1;
+        p++;
+      }
+    }
+    return p;
+  }
+  while (p != limit && *p != ',' && *p != '}' && *p != ']' &&
+         *p != ' ' && *p != '\n' && *p != '\t' && *p != '\r') {
+    p++;
+  }
+  return p;
+}
+
+OnDemandValue::iterator::iterator(const char* pos, const char* limit, bool object)
+  : value(nullptr), limit(limit), object(object) {
+  if (pos) {
+    readEntry(pos + 1);
+  }
+}
+
+void OnDemandValue::iterator::readEntry(const char* pos) {
+  value = nullptr;
+  pos = skipSpace(pos, limit);
+  if (pos == limit || *pos == '}' || *pos == ']') {
+    return;
+  }
+  if (object) {
+    if (*pos != '"') {
+      return;
+    }
+    const char* key_end = skipString(pos, limit);
+    if (key_end - pos < 2 || key_end[-1] != '"') {
+      return;
+    }
+    key_view = std::string_view(pos + 1, key_end - pos - 2);
+    pos = skipSpace(key_end, limit);
+    if (pos == limit || *pos != ':') {
+      return;
+    }
+    pos = skipSpace(pos + 1, limit);
+  }
+  if (pos != limit) {
+    value = pos;
+  }
+}
+
+OnDemandValue::iterator& OnDemandValue::iterator::operator++() {
+  const char* pos = skipSpace(skipValue(value, limit), limit);
+  if (pos != limit && *pos == ',') {
+    readEntry(pos + 1);
+  } else {
+    value = nullptr;
+  }
+  return *this;
+}
+
+OnDemandValue::iterator OnDemandValue::begin() const {
+  if (!valid() || (*pos != '{' && *pos != '[')) {
+    return end();
+  }
+  return iterator(pos, limit, *pos == '{');
+}
+
+OnDemandValue::iterator OnDemandValue::end() const {
+  return iterator(nullptr, limit, false);
+}
+
+Json::Type OnDemandValue::type() const {
+  if (!valid()) {
+    return Json::Type::null_type;
+  }
+  switch (*pos) {
+    case '{':
+      return Json::Type::map_type;
+    case '[':
+      return Json::Type::array_type;
+    case '"':
+      return Json::Type::str_type;
+    case 't':
+    case 'f':
+      return Json::Type::bool_type;
+    case 'n':
+      return Json::Type::null_type;
+  }
+  Lexer lexer(pos, skipValue(pos, limit) - pos);
+  Token tok = lexer.getCurrentToken();
+  return tok == tok_int ? Json::Type::int_type
+       : tok == tok_uint ? Json::Type::uint_type
+       : Json::Type::num_type;
+}
+
+OnDemandValue OnDemandValue::operator[](std::string_view key) const {
+  if (!valid() || *pos != '{') {
+    return OnDemandValue();
+  }
+  for (auto iter = begin(); iter != end(); ++iter) {
+    std::string_view name = iter.key();
+    if (name.find('\\') == std::string_view::npos) {
+      if (name == key) {
+        return *iter;
+      }
+    } else {
+      // escaped key, let the lexer decode it before comparing
+      Lexer lexer(name.data() - 1, name.size() + 2);
+      if (lexer.getString() == key) {
+        return *iter;
+      }
+    }
+  }
+  return OnDemandValue();
+}
+
+OnDemandValue OnDemandValue::operator[](size_t index) const {
+  if (!valid() || *pos != '[') {
+    return OnDemandValue();
+  }
+  for (auto iter = begin(); iter != end(); ++iter, --index) {
+    if (index == 0) {
+      return *iter;
+    }
+  }
+  return OnDemandValue();
+}
+
+size_t OnDemandValue::size() const {
+  size_t num = 0;
+  for (auto iter = begin(); iter != end(); ++iter) {
+    num++;
+  }
+  return num;
+}
+
+bool OnDemandValue::getBool() const {
+  return valid() && *pos == 't';
+}
+
+int64_t OnDemandValue::getInt() const {
+  if (!valid()) {
+    return 0;
+  }
+  Lexer lexer(pos, skipValue(pos, limit) - pos);
+  if (lexer.getCurrentToken() == tok_int) {
+    return lexer.getInt();
+  } else if (lexer.getCurrentToken() == tok_uint) {
+    return int64_t(lexer.getUint());
+  } else if (lexer.getCurrentToken() == tok_number) {
+    return int64_t(lexer.getNumber());
+  }
+  return 0;
+}
+
+uint64_t OnDemandValue::getUint() const {
+  if (!valid()) {
+    return 0;
+  }
+  Lexer lexer(pos, skipValue(pos, limit) - pos);
+  if (lexer.getCurrentToken() == tok_uint) {
+    return lexer.getUint();
+  }
+  return uint64_t(getInt());
+}
+
+double OnDemandValue::getNumber() const {
+  if (!valid()) {
+    return 0;
+  }
+  Lexer lexer(pos, skipValue(pos, limit) - pos);
+  if (lexer.getCurrentToken() == tok_int) {
+    return double(lexer.getInt());
+  } else if (lexer.getCurrentToken() == tok_uint) {
+    return double(lexer.getUint());
+  } else if (lexer.getCurrentToken() == tok_number) {
+    return lexer.getNumber();
+  }
+  return 0;
+}
+
+std::string OnDemandValue::getString() const {
+  if (!valid() || *pos != '"') {
+    return std::string();
+  }
+  Lexer lexer(pos, skipValue(pos, limit) - pos);
+  return lexer.takeString();
+}
+
+std::string_view OnDemandValue::raw() const {
+  if (!valid()) {
+    return std::string_view();
+  }
+  return std::string_view(pos, skipValue(pos, limit) - pos);
+}
+
+Json OnDemandValue::toJson() const {
+  if (!valid()) {
+    return Json();
+  }
+  Parser parser(pos, skipValue(pos, limit) - pos);
+  return parser.parser_all();
+}
+
+OnDemandDocument::OnDemandDocument(const char* data, size_t size) {
+  const char* limit = data + size;
+  root_value = OnDemandValue(skipSpace(data, limit), limit);
+}
@@ -0,0 +1,97 @@
+#ifndef __ONDEMAND_H
+#define __ONDEMAND_H
+
+#include <string>
+#include <string_view>
+#include "json.h"
+
+// On-demand access to JSON text, in the spirit of simdjson's ondemand API.
+//
+// An OnDemandValue is two pointers into the caller's buffer. Nothing is parsed
+// up front: obj["field"] scans the object from its opening brace, compares the
+// keys in place and jumps over the values in between with a bracket-depth
+// skip that only stops at quotes and brackets. Scalars are decoded by the
+// Lexer when one of the get* accessors asks for them. The cost of a lookup
+// therefore follows the bytes in front of the value, not the document size.
+//
+// The input is trusted to be well formed; on malformed text lookups return
+// an invalid value rather than reading past the buffer. The buffer must
+// outlive every value taken from it.
+class OnDemandValue {
+public:
+  class iterator {
+  public:
+    iterator(const char* pos, const char* limit, bool object);
+    OnDemandValue operator*() const {
+      return OnDemandValue(value, limit);
+    }
+    // raw spelling of the current key, objects only
+    std::string_view key() const {
+      return key_view;
+    }
+    iterator& operator++();
+    bool operator==(const iterator& other) const {
+      return value == other.value;
+    }
+    bool operator!=(const iterator& other) const {
+      return value != other.value;
+    }
+
+  private:
+    void readEntry(const char* pos);
+    const char* value;
+    const char* limit;
+    bool object;
+    std::string_view key_view;
+  };
+
+  OnDemandValue(): pos(nullptr), limit(nullptr) {}
+  // pos is the first byte of the value, limit the end of the buffer
+  OnDemandValue(const char* pos, const char* limit): pos(pos), limit(limit) {}
+
+  bool valid() const {
+    return pos != nullptr && pos != limit;
+  }
+  Json::Type type() const;
+  OnDemandValue operator[](std::string_view key) const;
+  OnDemandValue operator[](size_t index) const;
+  // element count, walks the whole container
+  size_t size() const;
+  // elements of an array or values of an object, see iterator::key()
+  iterator begin() const;
+  iterator end() const;
+
+  bool getBool() const;
+  int64_t getInt() const;
+  uint64_t getUint() const;
+  // any number widened to double
+  double getNumber() const;
+  std::string getString() const;
+  // the text of the value as it appears in the buffer
+  std::string_view raw() const;
+  // parses this value into a tree
+  Json toJson() const;
+
+private:
+  const char* pos;
+  const char* limit;
+};
+
+class OnDemandDocument {
+public:
+  OnDemandDocument(const char* data, size_t size);
+  OnDemandValue root() const {
+    return root_value;
+  }
+  OnDemandValue operator[](std::string_view key) const {
+    return root_value[key];
+  }
+  OnDemandValue operator[](size_t index) const {
+    return root_value[index];
+  }
+
+private:
+  OnDemandValue root_value;
+};
+
+#endif
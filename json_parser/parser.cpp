@@ -1,65 +1,90 @@
 #include "parser.h"
 
-Parser::Parser(std::string& filename):lexer(filename) {
+Parser::Parser(std::string& filename)
+  : owned_lexer(new Lexer(filename)), lexer(*owned_lexer), depth(0) {
 
 }
 
+Parser::Parser(const char* data, size_t size)
+  : owned_lexer(new Lexer(data, size)), lexer(*owned_lexer), depth(0) {
+
+}
+
+Parser::Parser(Lexer& lexer):lexer(lexer), depth(0) {
+
+}
+
+// Children are collected on a stack shared by the whole parse and moved into
+// a container of the exact size once it closes, so objects and arrays never
+// regrow while they fill up.
 Json Parser::parser_map() {
+  size_t base = entry_stack.size();
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() != tok_bracket_close) {
+    while (true) {
+      if (lexer.getCurrentToken() != tok_string) {
+        lexer.unexpected();
+        break;
+      }
+      JsonKey key = keys.intern(lexer.viewString());
+      lexer.consumerCurrnetToken();
+      if (lexer.getCurrentToken() != tok_colon) {
+        lexer.unexpected();
+        break;
+      }
+      lexer.consumerCurrnetToken();
+      Json value = parser_value();
+      entry_stack.emplace_back(std::move(key), std::move(value));
+      lexer.consumerCurrnetToken();
+      if (lexer.getCurrentToken() != tok_comma) {
+        if (lexer.getCurrentToken() != tok_bracket_close) {
+          lexer.unexpected();
+        }
+        break;
+      }
+      lexer.consumerCurrnetToken();
+    }
+  }
   Json json;
   Json::Data data;
   json.setType(Json::Type::map_type);
-  std::map<std::string, Json>* real_value = new std::map<std::string, Json>;
+  JsonMap* real_value = new JsonMap;
   data.map = real_value;
   json.setData(data);
-  std::string key;
-  Json value;
-  do {
-    lexer.consumerCurrnetToken();
-    if (lexer.getCurrentToken() == tok_bracket_close) {
-      break;
-    }
-    assert(lexer.getCurrentToken() == tok_string);
-    key = lexer.getString();
-    lexer.consumerCurrnetToken();
-    assert(lexer.getCurrentToken() == tok_colon);
-    lexer.consumerCurrnetToken();
-    if (lexer.getCurrentToken() == tok_bracket_open) {
-      value = parser_map();
-    } else if (lexer.getCurrentToken() == tok_sbracket_open) {
-      value = parser_array();
-    } else {
-      value = parser_elem();
-    }
-    (*real_value)[key] = std::move(value);
-    lexer.consumerCurrnetToken();
-  } while(lexer.getCurrentToken() == tok_comma);
-  assert(lexer.getCurrentToken() == tok_bracket_close);
+  real_value->reserve(entry_stack.size() - base);
+  for (size_t i = base; i < entry_stack.size(); i++) {
+    // a later duplicate key wins
+    (*real_value)[std::move(entry_stack[i].first)] = std::move(entry_stack[i].second);
+  }
+  entry_stack.resize(base);
   return json;
 }
 
 Json Parser::parser_array() {
+  size_t base = value_stack.size();
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() != tok_sbracket_close) {
+    while (true) {
+      Json value = parser_value();
+      value_stack.push_back(std::move(value));
+      lexer.consumerCurrnetToken();
+      if (lexer.getCurrentToken() != tok_comma) {
+        if (lexer.getCurrentToken() != tok_sbracket_close) {
+          lexer.unexpected();
+        }
+        break;
+      }
+      lexer.consumerCurrnetToken();
+    }
+  }
   Json json;
   Json::Data data;
   json.setType(Json::Type::array_type);
-  std::vector<Json>* real_value = new std::vector<Json>;
+  JsonArray* real_value = new JsonArray(std::make_move_iterator(value_stack.begin() + base),
+                                        std::make_move_iterator(value_stack.end()));
   data.array = real_value;
   json.setData(data);
-  Json value;
-  do {
-    lexer.consumerCurrnetToken();
-    if (lexer.getCurrentToken() == tok_sbracket_close) {
-      break;
-    } else if (lexer.getCurrentToken() == tok_bracket_open) {
-      value = parser_map();
-    } else if (lexer.getCurrentToken() == tok_sbracket_open) {
-      value = parser_array();
-    } else {
-      value = parser_elem();
-    }
-    real_value->emplace_back(value);
-    lexer.consumerCurrnetToken();
-  } while(lexer.getCurrentToken() == tok_comma);
-  assert(lexer.getCurrentToken() == tok_sbracket_close);
+  value_stack.resize(base);
   return json;
 }
 
@@ -70,12 +95,22 @@ Json Parser::parser_elem() {
     data.value = 0;
     json.setType(Json::Type::null_type);
   } else if (lexer.getCurrentToken() == tok_string) {
-    json.setType(Json::Type::str_type);
-    data.str = new std::string;
-    *(data.str) = std::move(lexer.getString());
+    // short strings are copied inline and the lexer keeps its buffer
+    if (lexer.viewString().size() <= Json::kSmallString) {
+      json.setString(lexer.viewString());
+    } else {
+      json.setString(lexer.takeString());
+    }
+    return json;
   } else if (lexer.getCurrentToken() == tok_number) {
     json.setType(Json::Type::num_type);
     data.value = lexer.getNumber();
+  } else if (lexer.getCurrentToken() == tok_int) {
+    json.setType(Json::Type::int_type);
+    data.integer = lexer.getInt();
+  } else if (lexer.getCurrentToken() == tok_uint) {
+    json.setType(Json::Type::uint_type);
+    data.uinteger = lexer.getUint();
   } else if (lexer.getCurrentToken() == tok_true) {
     json.setType(Json::Type::bool_type);
     data.flag = true;
@@ -83,18 +118,52 @@ Json Parser::parser_elem() {
     json.setType(Json::Type::bool_type);
     data.flag = false;
   } else {
-    std::cout << "current token is not support " << lexer.getCurrentToken() << std::endl;
-    assert(false);
+    lexer.unexpected();
+    data.value = 0;
+    json.setType(Json::Type::null_type);
   }
   json.setData(data);
   return json;
 }
 
+Json Parser::parser_value() {
+  Token tok = lexer.getCurrentToken();
+  if (tok != tok_bracket_open && tok != tok_sbracket_open) {
+    return parser_elem();
+  }
+  if (depth == kMaxDepth) {
+    lexer.fail(JsonErrc::too_deep);
+    return Json();
+  }
+  depth++;
+  Json json = tok == tok_bracket_open ? parser_map() : parser_array();
+  depth--;
+  return json;
+}
+
 Json Parser::parser_all() {
-  if (lexer.getCurrentToken() == tok_bracket_open) {
-    return parser_map();
-  } else if (lexer.getCurrentToken() == tok_sbracket_open) {
-    return parser_array();
+  Json json;
+  if (lexer.getCurrentToken() == tok_eof) {
+    return json;
+  }
+  json = parser_value();
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() == tok_error) {
+    json.clear();
+  }
+  return json;
+}
+
+JsonResult Parser::parse() {
+  JsonResult result;
+  result.value = parser_value();
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() != tok_eof) {
+    lexer.fail(JsonErrc::trailing_content);
+  }
+  result.error = lexer.getError();
+  if (result.error) {
+    result.value.clear();
   }
-  return Json();
+  return result;
 }
\ No newline at end of file
@@ -1,20 +1,69 @@
 #ifndef __PARSER_H
 #define __PARSER_H
 
+#include <memory>
 #include "lexer.h"
 #include "json.h"
 
+// A parse result: value is null whenever error is set.
+struct JsonResult {
+  Json value;
+  JsonError error;
+
+  bool ok() const {
+    return !error;
+  }
+};
+
+// Malformed input never aborts: the lexer reports it as tok_error, every
+// parser_* call unwinds with what it has built so far, and error() tells the
+// first problem with its row and column.
 class Parser {
 public:
+  static constexpr int64_t kMaxDepth = 1024;
+
   Parser(std::string& filename);
+  Parser(const char* data, size_t size);
+  // parses from a lexer owned by the caller, starting at its current token
+  Parser(Lexer& lexer);
+
+  // starts over on another buffer of an owned in-place lexer, keeping the
+  // interned keys and scratch stacks; see Lexer::reset
+  void reset(const char* data, size_t size) {
+    lexer.reset(data, size);
+    depth = 0;
+  }
 
+  // parses exactly one document, anything but whitespace after it is an error
+  JsonResult parse();
+  // parses the next top level value and steps past it, so calling it until
+  // finished() walks a stream of concatenated documents. A document with an
+  // error comes back null; recover() skips to the next line.
   Json parser_all();
+  bool finished() const {
+    return lexer.getCurrentToken() == tok_eof || lexer.getCurrentToken() == tok_error;
+  }
+  const JsonError& error() const {
+    return lexer.getError();
+  }
+  void recover() {
+    lexer.recover();
+  }
+  // parses the value starting at the current token and leaves the lexer on
+  // its last token.
+  Json parser_value();
   Json parser_map();
   Json parser_array();
   Json parser_elem();
 
 private:
-  Lexer lexer;
+  std::unique_ptr<Lexer> owned_lexer;
+  Lexer& lexer;
+  JsonStringTable keys;
+  // children of the containers still open, see parser_map
+  std::vector<JsonObject::Entry> entry_stack;
+  std::vector<Json> value_stack;
+  int64_t depth;
   Json json;
 };
 
@@ -0,0 +1,424 @@
+#include "query.h"
+#include <charconv>
+#include "parser.h"
+
+static bool parseInt(std::string_view text, int64_t& value) {
+  while (!text.empty() && text.front() == ' ') {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && text.back() == ' ') {
+    text.remove_suffix(1);
+  }
+  if (text.empty()) {
+    return false;
+  }
+  auto ret = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ret.ec == std::errc() && ret.ptr == text.data() + text.size();
+}
+
+JsonQuery::JsonQuery(std::string_view expr) {
+  if (expr.empty() || expr[0] == '/') {
+    compilePointer(expr);
+  } else if (expr[0] == '$') {
+    compilePath(expr);
+  } else {
+    fail("query must start with '/' or '$'");
+  }
+  if (steps.size() > kMaxSteps) {
+    fail("query has too many steps");
+  }
+}
+
+bool JsonQuery::fail(const std::string& msg) {
+  error_msg = msg;
+  steps.clear();
+  return false;
+}
+
+bool JsonQuery::compilePointer(std::string_view expr) {
+  size_t pos = 0;
+  while (pos < expr.size()) {
+    size_t next = expr.find('/', pos + 1);
+    if (next == std::string_view::npos) {
+      next = expr.size();
+    }
+    std::string_view raw = expr.substr(pos + 1, next - pos - 1);
+    Step step;
+    step.type = StepType::pointer;
+    for (size_t i = 0; i < raw.size(); i++) {
+      if (raw[i] != '~') {
+        step.name += raw[i];
+      } else if (i + 1 < raw.size() && raw[i + 1] == '0') {
+        step.name += '~';
+        i++;
+      } else if (i + 1 < raw.size() && raw[i + 1] == '1') {
+        step.name += '/';
+        i++;
+      } else {
+        return fail("invalid '~' escape in pointer");
+      }
+    }
+    // array index: digits without leading zero, "-" (past the end) never matches
+    step.index = -1;
+    bool digits = !step.name.empty() && step.name.size() < 19 &&
+                  (step.name.size() == 1 || step.name[0] != '0');
+    for (char c : step.name) {
+      digits = digits && isDigit(c);
+    }
+    if (digits) {
+      parseInt(step.name, step.index);
+    }
+    steps.push_back(std::move(step));
+    pos = next;
+  }
+  return true;
+}
+
+bool JsonQuery::compilePath(std::string_view expr) {
+  size_t pos = 1;
+  while (pos < expr.size()) {
+    Step step;
+    if (expr[pos] == '.') {
+      pos++;
+      if (pos < expr.size() && expr[pos] == '.') {
+        step.recursive = true;
+        pos++;
+      }
+      if (pos == expr.size()) {
+        return fail("expected a name after '.'");
+      }
+      if (expr[pos] == '*') {
+        step.type = StepType::wildcard;
+        pos++;
+        steps.push_back(std::move(step));
+        continue;
+      }
+      if (expr[pos] != '[') {
+        size_t stop = pos;
+        while (stop < expr.size() && expr[stop] != '.' && expr[stop] != '[') {
+          stop++;
+        }
+        if (stop == pos) {
+          return fail("expected a name after '.'");
+        }
+        step.type = StepType::key;
+        step.name = std::string(expr.substr(pos, stop - pos));
+        pos = stop;
+        steps.push_back(std::move(step));
+        continue;
+      }
+      if (!step.recursive) {
+        return fail("unexpected '[' after '.'");
+      }
+    }
+    if (expr[pos] != '[') {
+      return fail("unexpected character at " + std::to_string(pos));
+    }
+    pos++;
+    if (pos < expr.size() && (expr[pos] == '\'' || expr[pos] == '"')) {
+      char quote = expr[pos++];
+      step.type = StepType::key;
+      while (pos < expr.size() && expr[pos] != quote) {
+        if (expr[pos] == '\\' && pos + 1 < expr.size()) {
+          pos++;
+        }
+        step.name += expr[pos++];
+      }
+      if (pos == expr.size()) {
+        return fail("unterminated quoted name");
+      }
+      pos++;
+      if (pos == expr.size() || expr[pos] != ']') {
+        return fail("expected ']'");
+      }
+      pos++;
+      steps.push_back(std::move(step));
+      continue;
+    }
+    size_t close = expr.find(']', pos);
+    if (close == std::string_view::npos) {
+      return fail("expected ']'");
+    }
+    std::string_view body = expr.substr(pos, close - pos);
+    pos = close + 1;
+    if (body == "*") {
+      step.type = StepType::wildcard;
+    } else if (body.find(':') == std::string_view::npos) {
+      step.type = StepType::index;
+      if (!parseInt(body, step.index)) {
+        return fail("invalid array index '" + std::string(body) + "'");
+      }
+    } else {
+      step.type = StepType::slice;
+      std::string_view parts[3];
+      size_t num = 0;
+      while (num < 3) {
+        size_t colon = body.find(':');
+        parts[num++] = body.substr(0, colon);
+        if (colon == std::string_view::npos) {
+          break;
+        }
+        body.remove_prefix(colon + 1);
+      }
+      if (num == 3 && body.find(':') != std::string_view::npos) {
+        return fail("too many ':' in slice");
+      }
+      if (!parts[0].empty() && !(step.has_start = parseInt(parts[0], step.start))) {
+        return fail("invalid slice start");
+      }
+      if (!parts[1].empty() && !(step.has_end = parseInt(parts[1], step.end))) {
+        return fail("invalid slice end");
+      }
+      if (num == 3 && !parts[2].empty() && !parseInt(parts[2], step.step)) {
+        return fail("invalid slice step");
+      }
+      if (step.step == 0) {
+        return fail("slice step must not be 0");
+      }
+    }
+    steps.push_back(std::move(step));
+  }
+  return true;
+}
+
+bool JsonQuery::matchIndex(const Step& step, int64_t index, int64_t array_size) const {
+  if (step.type == StepType::index) {
+    int64_t want = step.index;
+    if (want < 0) {
+      if (array_size < 0) {
+        return false;
+      }
+      want += array_size;
+    }
+    return index == want;
+  }
+  // Python style slice semantics
+  if (step.step > 0) {
+    int64_t start = step.has_start ? step.start : 0;
+    int64_t end = step.has_end ? step.end : INT64_MAX;
+    if (start < 0 || end < 0) {
+      if (array_size < 0) {
+        return false;
+      }
+      start = start < 0 ? std::max<int64_t>(start + array_size, 0) : start;
+      end = end < 0 ? std::max<int64_t>(end + array_size, 0) : end;
+    }
+    return index >= start && index < end && (index - start) % step.step == 0;
+  }
+  if (array_size < 0) {
+    return false;
+  }
+  int64_t start = step.has_start ? step.start : array_size - 1;
+  int64_t end = step.has_end ? step.end : -array_size - 1;
+  start = start < 0 ? start + array_size : std::min(start, array_size - 1);
+  end = end < 0 ? std::max<int64_t>(end + array_size, -1) : end;
+  return index <= start && index > end && (start - index) % -step.step == 0;
+}
+
+uint64_t JsonQuery::nextKey(uint64_t states, std::string_view key) const {
+  uint64_t next = 0;
+  for (size_t s = 0; s < steps.size(); s++) {
+    if (!(states & (uint64_t(1) << s))) {
+      continue;
+    }
+    const Step& step = steps[s];
+    if (step.recursive) {
+      next |= uint64_t(1) << s;
+    }
+    if (step.type == StepType::wildcard ||
+        ((step.type == StepType::key || step.type == StepType::pointer) && step.name == key)) {
+      next |= uint64_t(1) << (s + 1);
+    }
+  }
+  return next;
+}
+
+uint64_t JsonQuery::nextIndex(uint64_t states, int64_t index, int64_t array_size) const {
+  uint64_t next = 0;
+  for (size_t s = 0; s < steps.size(); s++) {
+    if (!(states & (uint64_t(1) << s))) {
+      continue;
+    }
+    const Step& step = steps[s];
+    if (step.recursive) {
+      next |= uint64_t(1) << s;
+    }
+    bool match = false;
+    if (step.type == StepType::wildcard) {
+      match = true;
+    } else if (step.type == StepType::pointer) {
+      match = step.index == index;
+    } else if (step.type == StepType::index || step.type == StepType::slice) {
+      match = matchIndex(step, index, array_size);
+    }
+    if (match) {
+      next |= uint64_t(1) << (s + 1);
+    }
+  }
+  return next;
+}
+
+bool JsonQuery::visit(const Json& node, uint64_t states,
+                      const std::function<bool(const Json&)>& callback) const {
+  if ((states & finalState()) && !callback(node)) {
+    return false;
+  }
+  return visitChildren(node, states & ~finalState(), callback);
+}
+
+bool JsonQuery::visitChildren(const Json& node, uint64_t states,
+                              const std::function<bool(const Json&)>& callback) const {
+  if (states == 0) {
+    return true;
+  }
+  // one plain key/index step: jump to the child instead of scanning
+  bool single = (states & (states - 1)) == 0;
+  size_t s = __builtin_ctzll(states);
+  if (node.value.type == Json::Type::array_type && node.value.data.array) {
+    const std::vector<Json>& array = *node.value.data.array;
+    int64_t size = array.size();
+    if (single && !steps[s].recursive &&
+        (steps[s].type == StepType::index || steps[s].type == StepType::pointer)) {
+      int64_t index = steps[s].index;
+      if (steps[s].type == StepType::index && index < 0) {
+        index += size;
+      }
+      if (index < 0 || index >= size) {
+        return true;
+      }
+      return visit(array[index], uint64_t(1) << (s + 1), callback);
+    }
+    for (int64_t i = 0; i < size; i++) {
+      uint64_t next = nextIndex(states, i, size);
+      if (next && !visit(array[i], next, callback)) {
+        return false;
+      }
+    }
+  } else if (node.value.type == Json::Type::map_type && node.value.data.map) {
+    const JsonObject& object = *node.value.data.map;
+    if (single && !steps[s].recursive &&
+        (steps[s].type == StepType::key || steps[s].type == StepType::pointer)) {
+      const Json* child = object.find(steps[s].name);
+      return !child || visit(*child, uint64_t(1) << (s + 1), callback);
+    }
+    for (const auto& elem : object) {
+      uint64_t next = nextKey(states, elem.first);
+      if (next && !visit(elem.second, next, callback)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<const Json*> JsonQuery::evaluate(const Json& root) const {
+  std::vector<const Json*> matches;
+  if (valid()) {
+    visit(root, 1, [&matches](const Json& json) {
+      matches.push_back(&json);
+      return true;
+    });
+  }
+  return matches;
+}
+
+const Json* JsonQuery::first(const Json& root) const {
+  const Json* match = nullptr;
+  if (valid()) {
+    visit(root, 1, [&match](const Json& json) {
+      match = &json;
+      return false;
+    });
+  }
+  return match;
+}
+
+void JsonQuery::skip(Lexer& lexer) const {
+  Token tok = lexer.getCurrentToken();
+  if (tok != tok_bracket_open && tok != tok_sbracket_open) {
+    return;
+  }
+  int64_t depth = 1;
+  while (depth > 0) {
+    lexer.consumerCurrnetToken();
+    tok = lexer.getCurrentToken();
+    if (tok == tok_eof || tok == tok_error) {
+      lexer.unexpected();
+      return;
+    }
+    if (tok == tok_bracket_open || tok == tok_sbracket_open) {
+      depth++;
+    } else if (tok == tok_bracket_close || tok == tok_sbracket_close) {
+      depth--;
+    }
+  }
+}
+
+void JsonQuery::walk(Lexer& lexer, uint64_t states, const Callback& callback,
+                     int64_t depth) const {
+  if (states & finalState()) {
+    // materialize the match, deeper matches are found in the built subtree
+    Parser parser(lexer);
+    Json json = parser.parser_value();
+    if (parser.error()) {
+      return;
+    }
+    callback(json);
+    visitChildren(json, states & ~finalState(), [&callback](const Json& match) {
+      callback(match);
+      return true;
+    });
+    return;
+  }
+  Token tok = lexer.getCurrentToken();
+  if (states == 0 || (tok != tok_bracket_open && tok != tok_sbracket_open)) {
+    skip(lexer);
+    return;
+  }
+  // the same limit as Parser::parser_value, the recursion must not run out
+  // of stack on hostile input
+  if (depth == Parser::kMaxDepth) {
+    lexer.fail(JsonErrc::too_deep);
+    return;
+  }
+  Token close = tok == tok_bracket_open ? tok_bracket_close : tok_sbracket_close;
+  int64_t index = 0;
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() == close) {
+    return;
+  }
+  while (true) {
+    if (tok == tok_bracket_open) {
+      if (lexer.getCurrentToken() != tok_string) {
+        lexer.unexpected();
+        return;
+      }
+      std::string key = lexer.getString();
+      lexer.consumerCurrnetToken();
+      if (lexer.getCurrentToken() != tok_colon) {
+        lexer.unexpected();
+        return;
+      }
+      lexer.consumerCurrnetToken();
+      walk(lexer, nextKey(states, key), callback, depth + 1);
+    } else {
+      walk(lexer, nextIndex(states, index++, -1), callback, depth + 1);
+    }
+    lexer.consumerCurrnetToken();
+    if (lexer.getCurrentToken() != tok_comma) {
+      break;
+    }
+    lexer.consumerCurrnetToken();
+  }
+  if (lexer.getCurrentToken() != close) {
+    lexer.unexpected();
+  }
+}
+
+void JsonQuery::stream(Lexer& lexer, const Callback& callback) const {
+  if (!valid() || lexer.getCurrentToken() == tok_eof) {
+    return;
+  }
+  walk(lexer, 1, callback, 0);
+  lexer.consumerCurrnetToken();
+}
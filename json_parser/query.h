@@ -0,0 +1,88 @@
+#ifndef __QUERY_H
+#define __QUERY_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "json.h"
+#include "lexer.h"
+
+// A path expression compiled once and run many times, either over a parsed
+// Json tree or streaming over a Lexer without building the document.
+//
+// Accepted syntax:
+//   RFC 6901 JSON Pointer: "", "/members/0/name", "~0" and "~1" escapes
+//   JSONPath subset: $ .name ['name'] [n] [-n] [*] .* [start:end:step]
+//                    and recursive descent ..name ..* ..[n]
+//
+// The steps run as a small NFA over the path from the root, so recursive
+// descent costs one state bit instead of a backtracking search. Matches are
+// reported in document order. In streaming mode array lengths are unknown,
+// so negative indices and slice bounds never match there.
+class JsonQuery {
+public:
+  using Callback = std::function<void(const Json&)>;
+  static constexpr size_t kMaxSteps = 63;
+
+  JsonQuery(std::string_view expr);
+
+  bool valid() const {
+    return error_msg.empty();
+  }
+  const std::string& error() const {
+    return error_msg;
+  }
+
+  std::vector<const Json*> evaluate(const Json& root) const;
+  // first match, stops walking as soon as it is found
+  const Json* first(const Json& root) const;
+  // walks the value at the lexer's current token and leaves the lexer on the
+  // token after it. Only matched subtrees are materialized. On malformed
+  // input the walk stops and lexer.getError() tells why.
+  void stream(Lexer& lexer, const Callback& callback) const;
+
+private:
+  enum class StepType {
+    key,
+    index,
+    slice,
+    wildcard,
+    // JSON Pointer reference token: object key or, if numeric, array index
+    pointer
+  };
+  struct Step {
+    StepType type;
+    // ..step: the step may also skip any number of levels
+    bool recursive = false;
+    std::string name;
+    int64_t index = 0;
+    bool has_start = false;
+    bool has_end = false;
+    int64_t start = 0;
+    int64_t end = 0;
+    int64_t step = 1;
+  };
+  // array_size < 0 when it is not known yet
+  bool matchIndex(const Step& step, int64_t index, int64_t array_size) const;
+  uint64_t nextKey(uint64_t states, std::string_view key) const;
+  uint64_t nextIndex(uint64_t states, int64_t index, int64_t array_size) const;
+  uint64_t finalState() const {
+    return uint64_t(1) << steps.size();
+  }
+  bool visit(const Json& node, uint64_t states,
+             const std::function<bool(const Json&)>& callback) const;
+  bool visitChildren(const Json& node, uint64_t states,
+                     const std::function<bool(const Json&)>& callback) const;
+  void walk(Lexer& lexer, uint64_t states, const Callback& callback, int64_t depth) const;
+  void skip(Lexer& lexer) const;
+
+  bool compilePointer(std::string_view expr);
+  bool compilePath(std::string_view expr);
+  bool fail(const std::string& msg);
+
+  std::vector<Step> steps;
+  std::string error_msg;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "sax.h"
+#include <vector>
+
+// reads `"key" :` and leaves the lexer on the member's value
+static bool readKey(Lexer& lexer, JsonHandler& handler) {
+  if (lexer.getCurrentToken() != tok_string) {
+    lexer.unexpected();
+    return false;
+  }
+  handler.onKey(lexer.viewString());
+  lexer.consumerCurrnetToken();
+  if (lexer.getCurrentToken() != tok_colon) {
+    lexer.unexpected();
+    return false;
+  }
+  lexer.consumerCurrnetToken();
+  return true;
+}
+
+JsonError jsonSax(Lexer& lexer, JsonHandler& handler) {
+  // closing tokens of the containers still open
+  std::vector<Token> stack;
+  while (true) {
+    // a value starts at the current token
+    Token tok = lexer.getCurrentToken();
+    bool opened = false;
+    switch (tok) {
+      case tok_bracket_open:
+        handler.onStartObject();
+        lexer.consumerCurrnetToken();
+        if (lexer.getCurrentToken() == tok_bracket_close) {
+          handler.onEndObject();
+        } else {
+          stack.push_back(tok_bracket_close);
+          opened = true;
+        }
+        break;
+      case tok_sbracket_open:
+        handler.onStartArray();
+        lexer.consumerCurrnetToken();
+        if (lexer.getCurrentToken() == tok_sbracket_close) {
+          handler.onEndArray();
+        } else {
+          stack.push_back(tok_sbracket_close);
+          opened = true;
+        }
+        break;
+      case tok_null:
+        handler.onNull();
+        break;
+      case tok_true:
+      case tok_false:
+        handler.onBool(tok == tok_true);
+        break;
+      case tok_int:
+        handler.onInt(lexer.getInt());
+        break;
+      case tok_uint:
+        handler.onUint(lexer.getUint());
+        break;
+      case tok_number:
+        handler.onNumber(lexer.getNumber());
+        break;
+      case tok_string:
+        handler.onString(lexer.viewString());
+        break;
+      default:
+        lexer.unexpected();
+        return lexer.getError();
+    }
+    if (opened) {
+      if (stack.back() == tok_bracket_close && !readKey(lexer, handler)) {
+        return lexer.getError();
+      }
+      continue;
+    }
+    // the value is complete: close containers until a comma continues one
+    while (true) {
+      lexer.consumerCurrnetToken();
+      tok = lexer.getCurrentToken();
+      if (stack.empty()) {
+        if (tok != tok_eof) {
+          lexer.fail(JsonErrc::trailing_content);
+        }
+        return lexer.getError();
+      }
+      if (tok != stack.back()) {
+        break;
+      }
+      stack.pop_back();
+      if (tok == tok_bracket_close) {
+        handler.onEndObject();
+      } else {
+        handler.onEndArray();
+      }
+    }
+    if (tok != tok_comma) {
+      lexer.unexpected();
+      return lexer.getError();
+    }
+    lexer.consumerCurrnetToken();
+    if (stack.back() == tok_bracket_close && !readKey(lexer, handler)) {
+      return lexer.getError();
+    }
+  }
+}
+
+JsonError jsonSax(const char* data, size_t size, JsonHandler& handler) {
+  Lexer lexer(data, size);
+  return jsonSax(lexer, handler);
+}
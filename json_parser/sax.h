@@ -0,0 +1,35 @@
+#ifndef __SAX_H
+#define __SAX_H
+
+#include <cstdint>
+#include <string_view>
+#include "lexer.h"
+
+// Event interface for streaming over a document without building a tree.
+// Every callback defaults to doing nothing, so a handler overrides only
+// what it needs. Strings and keys are views into the lexer and are valid
+// only during the call.
+class JsonHandler {
+public:
+  virtual ~JsonHandler() = default;
+  virtual void onNull() {}
+  virtual void onBool(bool value) {}
+  virtual void onInt(int64_t value) {}
+  virtual void onUint(uint64_t value) {}
+  virtual void onNumber(double value) {}
+  virtual void onString(std::string_view value) {}
+  virtual void onKey(std::string_view key) {}
+  virtual void onStartObject() {}
+  virtual void onEndObject() {}
+  virtual void onStartArray() {}
+  virtual void onEndArray() {}
+};
+
+// Feeds one document to handler. Nesting is tracked on an explicit stack,
+// so there is no depth limit and no recursion. On malformed input the
+// events stop at the error, which is returned; a default JsonError means
+// the whole document was accepted.
+JsonError jsonSax(Lexer& lexer, JsonHandler& handler);
+JsonError jsonSax(const char* data, size_t size, JsonHandler& handler);
+
+#endif
@@ -0,0 +1,172 @@
+#include "lexer.h"
+#include "parser.h"
+#include "sax.h"
+#include "corpus.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Throughput of every stage on every corpus, for comparing builds:
+//
+//   json_parser_suite [--size MB] [--runs N] [--save dir]
+//
+// lex walks the tokens only, dom parses into a Json tree, sax streams the
+// events to a handler that only counts them, dump serializes the tree back.
+// Each figure is the best of N runs; alloc/MB is heap allocations per
+// megabyte of input (of output, for dump). --save writes the corpora out so
+// other parsers can be run on the same bytes.
+
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  if (void* ptr = malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+class CountingHandler : public JsonHandler {
+public:
+  void onNull() override { events++; }
+  void onBool(bool value) override { events++; }
+  void onInt(int64_t value) override { events++; }
+  void onUint(uint64_t value) override { events++; }
+  void onNumber(double value) override { events++; }
+  void onString(std::string_view value) override { events += 1 + value.size(); }
+  void onKey(std::string_view key) override { events += 1 + key.size(); }
+  void onStartObject() override { events++; }
+  void onEndObject() override { events++; }
+  void onStartArray() override { events++; }
+  void onEndArray() override { events++; }
+  size_t events = 0;
+};
+
+struct Measure {
+  double mb_per_sec = 0;
+  double allocs_per_mb = 0;
+};
+
+// best of runs; fn returns the bytes it processed
+template <typename F>
+static Measure measure(int runs, F fn) {
+  Measure best;
+  for (int run = 0; run < runs; run++) {
+    uint64_t before = allocations;
+    auto t1 = std::chrono::steady_clock::now();
+    size_t bytes = fn();
+    auto t2 = std::chrono::steady_clock::now();
+    double mb = double(bytes) / (1 << 20);
+    double rate = mb / std::chrono::duration<double>(t2 - t1).count();
+    if (rate > best.mb_per_sec) {
+      best.mb_per_sec = rate;
+    }
+    best.allocs_per_mb = (allocations - before) / mb;
+  }
+  return best;
+}
+
+static bool lexAll(const std::string& text) {
+  Lexer lexer(text.data(), text.size());
+  Token tok;
+  while ((tok = lexer.getCurrentToken()) != tok_eof && tok != tok_error) {
+    lexer.consumerCurrnetToken();
+  }
+  return tok == tok_eof;
+}
+
+static void benchCorpus(const Corpus& corpus, int runs) {
+  const std::string& text = corpus.text;
+  bool ok = lexAll(text);
+  JsonResult result = Parser(text.data(), text.size()).parse();
+  CountingHandler counter;
+  JsonError sax_error = jsonSax(text.data(), text.size(), counter);
+  if (!ok || !result.ok() || sax_error) {
+    std::cerr << corpus.name << ": corpus does not parse: "
+              << (result.ok() ? sax_error : result.error).toString() << std::endl;
+    exit(1);
+  }
+
+  Measure lex = measure(runs, [&] {
+    lexAll(text);
+    return text.size();
+  });
+  Measure dom = measure(runs, [&] {
+    Parser parser(text.data(), text.size());
+    JsonResult parsed = parser.parse();
+    return parsed.ok() ? text.size() : 0;
+  });
+  Measure sax = measure(runs, [&] {
+    CountingHandler handler;
+    jsonSax(text.data(), text.size(), handler);
+    return text.size();
+  });
+  std::string out;
+  out.reserve(text.size());
+  Measure dump = measure(runs, [&] {
+    out.clear();
+    result.value.dump(out);
+    return out.size();
+  });
+
+  char line[160];
+  snprintf(line, sizeof(line), "%-8s %7.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f",
+           corpus.name.c_str(), text.size() / double(1 << 20), lex.mb_per_sec,
+           dom.mb_per_sec, sax.mb_per_sec, dump.mb_per_sec, dom.allocs_per_mb,
+           sax.allocs_per_mb, dump.allocs_per_mb);
+  std::cout << line << std::endl;
+}
+
+int main(int argc, char** argv) {
+  double size_mb = 4;
+  int runs = 5;
+  const char* save_dir = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+      size_mb = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+      save_dir = argv[++i];
+    } else {
+      std::cerr << "usage: " << argv[0] << " [--size MB] [--runs N] [--save dir]" << std::endl;
+      return 1;
+    }
+  }
+  if (size_mb <= 0 || runs <= 0) {
+    std::cerr << "--size and --runs must be positive" << std::endl;
+    return 1;
+  }
+
+  std::vector<Corpus> corpora = makeCorpora(size_t(size_mb * (1 << 20)));
+  if (save_dir) {
+    for (const Corpus& corpus : corpora) {
+      std::string path = std::string(save_dir) + "/" + corpus.name + ".json";
+      std::ofstream file(path, std::ios::binary);
+      file.write(corpus.text.data(), corpus.text.size());
+      if (!file) {
+        std::cerr << "can't write " << path << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  std::cout << "                   ------------ MB/s ------------   ------ alloc/MB ------" << std::endl;
+  std::cout << "corpus      MB      lex      dom      sax     dump      dom      sax     dump" << std::endl;
+  for (const Corpus& corpus : corpora) {
+    benchCorpus(corpus, runs);
+  }
+  return 0;
+}
@@ -0,0 +1,212 @@
+#include "writer.h"
+#include <charconv>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+JsonWriter::JsonWriter(std::string& out, bool pretty)
+  : buffer(out), sink(nullptr), pos(out.size()), pretty(pretty) {
+}
+
+JsonWriter::JsonWriter(JsonSink& sink, bool pretty)
+  : buffer(own_buffer), sink(&sink), pos(0), pretty(pretty) {
+}
+
+JsonWriter::~JsonWriter() {
+  flush();
+}
+
+void JsonWriter::write(const Json& json) {
+  writeValue(json, 0);
+  if (!sink) {
+    // keep the target string exact after every document
+    buffer.resize(pos);
+  }
+}
+
+void JsonWriter::flush() {
+  if (sink) {
+    if (pos > 0) {
+      sink->write(buffer.data(), pos);
+    }
+    pos = 0;
+  } else {
+    buffer.resize(pos);
+  }
+}
+
+char* JsonWriter::reserve(size_t size) {
+  if (sink && pos > 0 && pos + size > kFlushSize) {
+    flush();
+  }
+  if (pos + size > buffer.size()) {
+    buffer.resize(std::max(pos + size, buffer.size() * 2));
+  }
+  return &buffer[pos];
+}
+
+void JsonWriter::writeIndent(int64_t indent) {
+  char* out = reserve(indent + 1);
+  out[0] = '\n';
+  memset(out + 1, ' ', indent);
+  pos += indent + 1;
+}
+
+static char* escapeChar(char* out, char c) {
+  static const char hex[] = "0123456789abcdef";
+  *out++ = '\\';
+  switch (c) {
+    case '"': *out++ = '"'; break;
+    case '\\': *out++ = '\\'; break;
+    case '\b': *out++ = 'b'; break;
+    case '\f': *out++ = 'f'; break;
+    case '\n': *out++ = 'n'; break;
+    case '\r': *out++ = 'r'; break;
+    case '\t': *out++ = 't'; break;
+    default:
+      *out++ = 'u';
+      *out++ = '0';
+      *out++ = '0';
+      *out++ = hex[(c >> 4) & 0xf];
+      *out++ = hex[c & 0xf];
+  }
+  return out;
+}
+
+static bool needEscape(char c) {
+  return static_cast<unsigned char>(c) < 0x20 || c == '"' || c == '\\';
+}
+
+void JsonWriter::writeString(const char* str, size_t size) {
+  // worst case every byte turns into \u00XX
+  char* out = reserve(size * 6 + 2);
+  char* p = out;
+  const char* end = str + size;
+  *p++ = '"';
+#ifdef __SSE2__
+  // 16 bytes per step; the block is stored before it is checked, the
+  // reservation above leaves room for that.
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+  while (end - str >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+    int mask = _mm_movemask_epi8(special);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), chunk);
+    if (mask == 0) {
+      str += 16;
+      p += 16;
+      continue;
+    }
+    int clean = __builtin_ctz(mask);
+    str += clean;
+    p = escapeChar(p + clean, *str++);
+  }
+#endif
+  while (str != end) {
+    char c = *str++;
+    if (needEscape(c)) {
+      p = escapeChar(p, c);
+    } else {
+      *p++ = c;
+    }
+  }
+  *p++ = '"';
+  pos += p - out;
+}
+
+void JsonWriter::writeDouble(double value) {
+  if (!std::isfinite(value)) {
+    // JSON has no inf/nan
+    append("null", 4);
+    return;
+  }
+  char* out = reserve(32);
+  // shortest representation that round trips (Ryu in libstdc++)
+  char* p = std::to_chars(out, out + 32, value).ptr;
+  bool integral = true;
+  for (char* c = out; c != p; c++) {
+    if (*c == '.' || *c == 'e' || *c == 'E') {
+      integral = false;
+      break;
+    }
+  }
+  if (integral) {
+    // keep it a double when read back
+    *p++ = '.';
+    *p++ = '0';
+  }
+  pos += p - out;
+}
+
+void JsonWriter::writeValue(const Json& json, int64_t indent) {
+  const Json::Value& value = json.value;
+  if (value.type == Json::Type::null_type) {
+    append("null", 4);
+  } else if (value.type == Json::Type::bool_type) {
+    if (value.data.flag) {
+      append("true", 4);
+    } else {
+      append("false", 5);
+    }
+  } else if (value.type == Json::Type::num_type) {
+    writeDouble(value.data.value);
+  } else if (value.type == Json::Type::int_type) {
+    char* out = reserve(24);
+    pos += std::to_chars(out, out + 24, value.data.integer).ptr - out;
+  } else if (value.type == Json::Type::uint_type) {
+    char* out = reserve(24);
+    pos += std::to_chars(out, out + 24, value.data.uinteger).ptr - out;
+  } else if (value.type == Json::Type::str_type) {
+    std::string_view str = json.getString();
+    writeString(str.data(), str.size());
+  } else if (value.type == Json::Type::array_type) {
+    append('[');
+    if (value.data.array && !value.data.array->empty()) {
+      bool first = true;
+      for (const Json& elem : *value.data.array) {
+        if (!first) {
+          append(',');
+        }
+        first = false;
+        if (pretty) {
+          writeIndent(indent + 2);
+        }
+        writeValue(elem, indent + 2);
+      }
+      if (pretty) {
+        writeIndent(indent);
+      }
+    }
+    append(']');
+  } else {
+    append('{');
+    if (value.data.map && !value.data.map->empty()) {
+      bool first = true;
+      for (const auto& elem : *value.data.map) {
+        if (!first) {
+          append(',');
+        }
+        first = false;
+        if (pretty) {
+          writeIndent(indent + 2);
+        }
+        writeString(elem.first.data(), elem.first.size());
+        if (pretty) {
+          append(": ", 2);
+        } else {
+          append(':');
+        }
+        writeValue(elem.second, indent + 2);
+      }
+      if (pretty) {
+        writeIndent(indent);
+      }
+    }
+    append('}');
+  }
+}
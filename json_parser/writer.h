@@ -0,0 +1,54 @@
+#ifndef __WRITER_H
+#define __WRITER_H
+
+#include <string>
+#include "json.h"
+
+// Destination for JsonWriter when the output should not be kept in one
+// string, e.g. a file or a socket. It receives the output in blocks.
+class JsonSink {
+public:
+  virtual ~JsonSink() = default;
+  virtual void write(const char* data, size_t size) = 0;
+};
+
+// Serializes Json into a contiguous buffer. With a std::string target the
+// text is appended to it directly, so reusing the same string across dumps
+// keeps its capacity. With a JsonSink target the writer buffers internally
+// and flushes every kFlushSize bytes and on flush()/destruction.
+class JsonWriter {
+public:
+  static constexpr size_t kFlushSize = 64 << 10;
+
+  explicit JsonWriter(std::string& out, bool pretty = false);
+  explicit JsonWriter(JsonSink& sink, bool pretty = false);
+  JsonWriter(const JsonWriter&) = delete;
+  JsonWriter& operator=(const JsonWriter&) = delete;
+  ~JsonWriter();
+
+  void write(const Json& json);
+  void flush();
+
+private:
+  void writeValue(const Json& json, int64_t indent);
+  void writeString(const char* str, size_t size);
+  void writeDouble(double value);
+  void writeIndent(int64_t indent);
+  char* reserve(size_t size);
+  void append(const char* data, size_t size) {
+    memcpy(reserve(size), data, size);
+    pos += size;
+  }
+  void append(char c) {
+    *reserve(1) = c;
+    pos++;
+  }
+
+  std::string own_buffer;
+  std::string& buffer;
+  JsonSink* sink;
+  size_t pos;
+  bool pretty;
+};
+
+#endif
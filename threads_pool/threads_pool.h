@@ -52,17 +52,28 @@ public:
             std::bind(std::forward<Func>(func), std::forward<Args>(args)...)
         ); 
         std::future<Ret> res = task->get_future();
-        channels_[index_%threads_num_].push(
-            [task](){
-                (*task)();
-            }
-        );
-        index_++;
+        execute([task](){
+            (*task)();
+        });
         return res;
     }
 
+    // runs func on one of the threads, without a future
+    template<typename Func>
+    void execute(Func&& func) {
+        size_t index = index_.fetch_add(1, std::memory_order_relaxed);
+        channels_[index % threads_num_].push(std::forward<Func>(func));
+    }
+
+    // co_await pool.submit_async(func, args...) is submit() for coroutines:
+    // the awaiting coroutine is resumed with the result once func has run,
+    // without a thread blocking on a future. Defined by the coroutine
+    // runtime, see coroutine/runtime/offload.h.
+    template<typename Func, typename ...Args>
+    auto submit_async(Func&& func, Args&& ...args);
+
     ~ThreadsPool() {
-        for(int i = 0; i < threads_num_; i++) {
+        for(size_t i = 0; i < threads_num_; i++) {
             channels_[i].close();
             if (threads_[i].joinable()) {
                 threads_[i].join();
@@ -71,7 +82,8 @@ public:
     }
 
 private:
-    size_t index_;
+    // submit() may be called from several threads at once
+    std::atomic<size_t> index_;
     const size_t threads_num_;
     std::vector<BlockQueue<std::function<void()>>> channels_;
     std::vector<std::thread> threads_; 